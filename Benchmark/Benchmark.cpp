@@ -0,0 +1,468 @@
+// Benchmarks for the per-frame code paths of NerDisco.
+// Every case is run repeatedly for a fixed time after a warm-up and the average time per call is printed,
+// so changes to these paths can be compared on the same machine. Build with optimizations enabled.
+// Usage: NerDisco_Benchmark [encoder] [colortable] [uniforms] [network]
+//   encoder    DisplayEncoder::encode() with 1k, 10k and 50k LEDs.
+//   colortable ColorTable::apply() on 64x64 and 256x256 images, using the scalar loop and AVX2.
+//   uniforms   Uploading 64 script uniforms by handle like DeckRenderer does, compared to looking them up by name.
+//              Needs OpenGL. On machines without a display add "-platform offscreen".
+//   network    Loopback check of NetworkOutput. Sends 10240 LEDs per frame with E1.31, Art-Net and DDP to 127.0.0.1,
+//              receives and checks the packets and prints the time frames take to be written. Needs the UDP ports of the
+//              protocols to be free, so do not run LEDStream_Host at the same time.
+// Without arguments all benchmarks are run. Returns 0 if all benchmarks ran and their results were correct.
+
+#include "DisplayEncoder.h"
+#include "ImageOperations.h"
+#include "DeckRenderer.h"
+#include "ShaderCache.h"
+#include "LiveView.h"
+#include "NetworkOutput.h"
+#include "LatencyStatistics.h"
+
+#include <QGuiApplication>
+#include <QStringList>
+#include <QElapsedTimer>
+#include <QImage>
+#include <QVector>
+#include <QOffscreenSurface>
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+#include <QOpenGLShaderProgram>
+#include <QUdpSocket>
+#include <QThread>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+
+
+namespace
+{
+	/// @brief Time a function. It is called until at least minimumTime milliseconds have passed.
+	/// @return Average time per call in microseconds.
+	template <typename FUNCTION>
+	double measure(FUNCTION function, int minimumTime = 250)
+	{
+		//warm up caches and let buffers reach their final size
+		for (int i = 0; i < 10; ++i)
+		{
+			function();
+		}
+		QElapsedTimer timer;
+		timer.start();
+		qint64 calls = 0;
+		do
+		{
+			function();
+			++calls;
+		} while (timer.elapsed() < minimumTime);
+		return timer.nsecsElapsed() / 1000.0 / calls;
+	}
+
+	/// @brief Build test images that differ in every pixel, so frames are never identical.
+	QVector<QImage> testImages(int width, int height, int count = 2)
+	{
+		QVector<QImage> images;
+		for (int i = 0; i < count; ++i)
+		{
+			QImage image(width, height, QImage::Format_RGB32);
+			for (int y = 0; y < height; ++y)
+			{
+				QRgb * line = reinterpret_cast<QRgb *>(image.scanLine(y));
+				for (int x = 0; x < width; ++x)
+				{
+					line[x] = qRgb((x * 7 + i * 31) & 0xFF, (y * 5 + i * 17) & 0xFF, ((x ^ y) + i * 59) & 0xFF);
+				}
+			}
+			images.append(image);
+		}
+		return images;
+	}
+
+	void printResult(const char * name, int ledCount, double time, const char * unit = "LED")
+	{
+		printf("  %-28s %6d %ss %10.2f us/frame %8.2f ns/%s\n", name, ledCount, unit, time, time * 1000.0 / ledCount, unit);
+		fflush(stdout);
+	}
+
+	bool benchmarkEncoder()
+	{
+		printf("DisplayEncoder::encode()\n");
+		//display sizes with about 1k, 10k and 50k LEDs
+		const QSize sizes[] = { QSize(32, 32), QSize(100, 100), QSize(250, 200) };
+		for (const QSize & size : sizes)
+		{
+			const int ledCount = size.width() * size.height();
+			const QVector<QImage> images = testImages(size.width(), size.height());
+			const QVector<QImage> largeImages = testImages(2 * size.width(), 2 * size.height());
+			const QVector<QImage> stripImages = testImages(ledCount, 1);
+			int frame = 0;
+			int bytes = 0;
+			DisplayEncoder encoder;
+			//display image of display size, as rendered by the GPU mixer
+			encoder.setLayout(size.width(), size.height(), false, true, AlternatingStartLeft);
+			printResult("grid", ledCount, measure([&]() { bytes += encoder.encode(images.at(frame++ & 1)).size(); }));
+			//LEDs average 2x2 pixels of a larger image
+			printResult("grid, averaging 2x2", ledCount, measure([&]() { bytes += encoder.encode(largeImages.at(frame++ & 1)).size(); }));
+			//LED colors in strip order, as sampled from an LED layout
+			encoder.setStripLayout(ledCount);
+			printResult("strip", ledCount, measure([&]() { bytes += encoder.encode(stripImages.at(frame++ & 1)).size(); }));
+			//compressed protocol. all LEDs change every frame, which is the worst case
+			encoder.setLayout(size.width(), size.height(), false, true, AlternatingStartLeft);
+			encoder.setCompression(true, 50);
+			printResult("grid, compressed", ledCount, measure([&]() { bytes += encoder.encode(images.at(frame++ & 1)).size(); }));
+			//the bytes are only summed up, so the compiler can not remove the calls
+			if (bytes == 0)
+			{
+				printf("  No data encoded!\n");
+				return false;
+			}
+		}
+		return true;
+	}
+
+	bool benchmarkColorTable()
+	{
+		printf("ColorTable::apply()\n");
+		ColorTable table;
+		table.set(0.1f, 1.2f, 0.8f);
+		bool correct = true;
+		const int sizes[] = { 64, 256 };
+		for (int size : sizes)
+		{
+			const int pixelCount = size * size;
+			QImage image = testImages(size, size, 1).first();
+			//both code paths must produce the same pixels
+			QImage scalarImage = image.copy();
+			QImage vectorImage = image.copy();
+			ColorTable::setVectorized(false);
+			table.apply(scalarImage);
+			const double scalarTime = measure([&]() { table.apply(image); });
+			printResult("scalar", pixelCount, scalarTime, "pixel");
+			ColorTable::setVectorized(true);
+			if (!ColorTable::isVectorized())
+			{
+				printf("  AVX2 is not supported on this machine or by the compiler.\n");
+				continue;
+			}
+			table.apply(vectorImage);
+			const double vectorTime = measure([&]() { table.apply(image); });
+			printResult("AVX2", pixelCount, vectorTime, "pixel");
+			printf("  AVX2 speedup %.2fx%s\n", scalarTime / vectorTime, scalarImage == vectorImage ? "" : ", but results differ from the scalar loop!");
+			correct = correct && scalarImage == vectorImage;
+		}
+		return correct;
+	}
+
+	bool benchmarkUniforms()
+	{
+		printf("Script uniforms\n");
+		QOffscreenSurface surface;
+		surface.setFormat(LiveView::getDefaultFormat());
+		surface.create();
+		QOpenGLContext context;
+		context.setFormat(LiveView::getDefaultFormat());
+		if (!context.create() || !context.makeCurrent(&surface))
+		{
+			printf("  Failed to create OpenGL context!\n");
+			return false;
+		}
+		QOpenGLFunctions * functions = context.functions();
+		//script using 64 uniforms, so none of them is optimized away
+		const int uniformCount = 64;
+		QStringList names;
+		QString declarations;
+		QString sum = "0.0";
+		for (int i = 0; i < uniformCount; ++i)
+		{
+			names << QString("value%1").arg(i);
+			declarations += QString("uniform float value%1;\n").arg(i);
+			sum += QString(" + value%1").arg(i);
+		}
+		const QString script = declarations + "varying vec2 texcoordVar;\nvoid main() {\n\tgl_FragColor = vec4(fract(" + sum + "), texcoordVar, 1.0);\n}\n";
+		const QString vertexPrefix = context.isOpenGLES() ? LiveView::m_vertexPrefixGLES2 : LiveView::m_vertexPrefixGL2;
+		const QString fragmentPrefix = context.isOpenGLES() ? LiveView::m_fragmentPrefixGLES2 : LiveView::m_fragmentPrefixGL2;
+		QVector<float> values(uniformCount);
+		int frame = 0;
+		//values change every frame, except for the cases measuring unchanged values
+		auto nextValues = [&]() {
+			++frame;
+			for (int i = 0; i < uniformCount; ++i)
+			{
+				values[i] = frame * 0.001f + i;
+			}
+		};
+		try
+		{
+			ShaderCache shaderCache("");
+			QOpenGLShaderProgram * program = shaderCache.acquire(vertexPrefix + LiveView::m_defaultVertexCode, fragmentPrefix + script);
+			program->bind();
+			//set uniforms by name every frame, like scripts did before they used handles
+			printResult("upload by name", uniformCount, measure([&]() {
+				nextValues();
+				for (int i = 0; i < uniformCount; ++i)
+				{
+					program->setUniformValue(names.at(i).toLocal8Bit().constData(), values.at(i));
+				}
+			}), "uniform");
+			//look up locations once and upload changed values only, like DeckRenderer::renderPass()
+			QVector<int> locations;
+			QVector<float> uploadedValues;
+			for (int i = 0; i < uniformCount; ++i)
+			{
+				locations.append(program->uniformLocation(names.at(i)));
+				uploadedValues.append(-1.0f);
+			}
+			auto uploadByHandle = [&]() {
+				for (int i = 0; i < uniformCount; ++i)
+				{
+					if (locations.at(i) >= 0 && !(values.at(i) == uploadedValues.at(i)))
+					{
+						functions->glUniform1f(locations.at(i), values.at(i));
+						uploadedValues[i] = values.at(i);
+					}
+				}
+			};
+			printResult("upload by handle", uniformCount, measure([&]() { nextValues(); uploadByHandle(); }), "uniform");
+			printResult("upload by handle, unchanged", uniformCount, measure(uploadByHandle), "uniform");
+			program->release();
+			shaderCache.release(program);
+			//whole frames of a 64x64 deck rendered by DeckRenderer. glFinish() makes sure the frame was rendered
+			DeckRenderer renderer(shaderCache);
+			renderer.setScript(script);
+			const QSize size(64, 64);
+			printResult("DeckRenderer frame", uniformCount, measure([&]() {
+				nextValues();
+				renderer.setValues(names, values);
+				renderer.render(size);
+				functions->glFinish();
+			}), "uniform");
+			printResult("DeckRenderer frame, unchanged", uniformCount, measure([&]() {
+				renderer.setValues(names, values);
+				renderer.render(size);
+				functions->glFinish();
+			}), "uniform");
+		}
+		catch (std::runtime_error e)
+		{
+			printf("  Failed to compile script: %s\n", e.what());
+			context.doneCurrent();
+			return false;
+		}
+		context.doneCurrent();
+		return true;
+	}
+
+	inline int getU16(const unsigned char * data)
+	{
+		return (data[0] << 8) | data[1];
+	}
+
+	/// @brief Copy the LED data of a packet sent by NetworkOutput to its place in the frame.
+	/// @param firstUniverse Universe of the first LED for E1.31 and Art-Net.
+	/// @return Number of LED data bytes copied. 0 for packets without LED data, e.g. sync packets.
+	int receivePacket(int protocol, int firstUniverse, const QByteArray & datagram, QByteArray & frame)
+	{
+		const unsigned char * packet = reinterpret_cast<const unsigned char *>(datagram.constData());
+		int offset = -1;
+		int length = 0;
+		const unsigned char * data = nullptr;
+		if (protocol == NetworkOutput::E131 && datagram.size() >= 126 && packet[43] == 0x02)
+		{
+			//data packet. the property value count includes the DMX start code
+			offset = 510 * (getU16(packet + 113) - firstUniverse);
+			length = getU16(packet + 123) - 1;
+			data = packet + 126;
+		}
+		else if (protocol == NetworkOutput::ArtNet && datagram.size() >= 18 && memcmp(packet, "Art-Net", 8) == 0 && packet[9] == 0x50)
+		{
+			//OpDmx packet
+			offset = 510 * ((packet[14] | (packet[15] << 8)) - firstUniverse);
+			length = getU16(packet + 16);
+			data = packet + 18;
+		}
+		else if (protocol == NetworkOutput::DDP && datagram.size() >= 10)
+		{
+			offset = (packet[4] << 24) | (packet[5] << 16) | (packet[6] << 8) | packet[7];
+			length = getU16(packet + 8);
+			data = packet + 10;
+		}
+		//Art-Net pads the data to an even length, so clip it to the frame
+		length = qMin(length, frame.size() - offset);
+		if (offset < 0 || length <= 0 || (data + length) > packet + datagram.size())
+		{
+			return 0;
+		}
+		memcpy(frame.data() + offset, data, length);
+		return length;
+	}
+
+	bool benchmarkNetwork()
+	{
+		printf("NetworkOutput loopback\n");
+		//display with 10k LEDs
+		const QSize size(128, 80);
+		const int ledCount = size.width() * size.height();
+		const int frameCount = 200;
+		const int firstUniverse = 1;
+		const char * protocolNames[] = { "E1.31", "Art-Net", "DDP" };
+		//same ports NetworkOutput sends to
+		const quint16 ports[] = { 5568, 6454, 4048 };
+		const QVector<QImage> images = testImages(size.width(), size.height());
+		OutputSettings settings;
+		settings.stripOrder = false;
+		settings.displayWidth = size.width();
+		settings.displayHeight = size.height();
+		settings.flipHorizontal = false;
+		settings.flipVertical = false;
+		settings.scanlineDirection = ConstantLeftToRight;
+		settings.firstLed = 0;
+		settings.ledCount = ledCount;
+		settings.compressedProtocol = false;
+		settings.keyFrameInterval = 1;
+		settings.displayInterval = 20;
+		//expected LED data of the test images. the network protocols send RGB
+		QVector<QByteArray> expected;
+		DisplayEncoder encoder;
+		encoder.setLayout(size.width(), size.height(), false, false, ConstantLeftToRight);
+		encoder.setColorOrder(DisplayEncoder::OrderRGB);
+		for (const QImage & image : images)
+		{
+			encoder.encode(image);
+			expected.append(QByteArray(reinterpret_cast<const char *>(encoder.ledData()), 3 * ledCount));
+		}
+		bool correct = true;
+		for (int protocol = NetworkOutput::E131; protocol <= NetworkOutput::DDP; ++protocol)
+		{
+			QUdpSocket receiver;
+			if (!receiver.bind(QHostAddress::LocalHost, ports[protocol]))
+			{
+				printf("  %-8s Failed to listen on port %d: %s\n", protocolNames[protocol], ports[protocol], qPrintable(receiver.errorString()));
+				correct = false;
+				continue;
+			}
+			//a whole frame must fit into the receive buffer, as it is sent in one burst
+			receiver.setSocketOption(QAbstractSocket::ReceiveBufferSizeSocketOption, 4 * 1024 * 1024);
+			LatencyStatistics::SPtr latency(new LatencyStatistics);
+			NetworkOutput output;
+			output.protocol = protocol;
+			output.host = QString("127.0.0.1");
+			output.universe = firstUniverse;
+			output.sync = true;
+			output.setLatencyStatistics(latency);
+			output.setSending(true);
+			int correctFrames = 0;
+			int datagrams = 0;
+			QByteArray frame(3 * ledCount, 0);
+			QByteArray datagram;
+			for (int i = 0; i < frameCount; ++i)
+			{
+				//send frame. Tick and Queued are the same, so the total latency is the time from sendFrame() to the wire
+				const int sentFrames = output.sentFrames();
+				FrameTiming timing;
+				timing.mark(FrameTiming::Tick);
+				timing.mark(FrameTiming::Queued);
+				output.sendFrame(images.at(i & 1), QVector<quint16>(), i, timing, settings);
+				//receive LED data until the frame is complete
+				frame.fill(0);
+				int receivedBytes = 0;
+				QElapsedTimer timeout;
+				timeout.start();
+				while (receivedBytes < frame.size() && timeout.elapsed() < 1000)
+				{
+					if (!receiver.hasPendingDatagrams() && !receiver.waitForReadyRead(100))
+					{
+						continue;
+					}
+					while (receiver.hasPendingDatagrams())
+					{
+						datagram.resize(receiver.pendingDatagramSize());
+						receiver.readDatagram(datagram.data(), datagram.size());
+						receivedBytes += receivePacket(protocol, firstUniverse, datagram, frame);
+						++datagrams;
+					}
+				}
+				if (receivedBytes == frame.size() && frame == expected.at(i & 1))
+				{
+					++correctFrames;
+				}
+				//keep one frame in flight, so no frames are dropped
+				while (output.sentFrames() == sentFrames && timeout.elapsed() < 1000)
+				{
+					QThread::usleep(100);
+				}
+			}
+			printf("  %-8s %5d LEDs %5.1f packets/frame %4d/%d frames correct, write p50 %5lld p99 %5lld us, sendFrame() to wire p50 %5lld p99 %5lld us\n",
+				protocolNames[protocol], ledCount, (float)datagrams / frameCount, correctFrames, frameCount,
+				latency->percentile(LatencyStatistics::Write, 50.0f), latency->percentile(LatencyStatistics::Write, 99.0f),
+				latency->percentile(LatencyStatistics::Total, 50.0f), latency->percentile(LatencyStatistics::Total, 99.0f));
+			fflush(stdout);
+			correct = correct && correctFrames == frameCount;
+		}
+		return correct;
+	}
+}
+
+
+/// @brief Get the benchmark names from the command line, skipping Qt options like "-platform offscreen".
+/// An option is followed by its value unless the next argument is a benchmark name or another option.
+QStringList getBenchmarkNames(int argc, char *argv[])
+{
+	static const char * names[] = {"encoder", "colortable", "uniforms", "network"};
+	QStringList benchmarks;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (argv[i][0] == '-')
+		{
+			if (i + 1 < argc && argv[i + 1][0] != '-' && std::find_if(std::begin(names), std::end(names), [&](const char * name) { return strcmp(argv[i + 1], name) == 0; }) == std::end(names))
+			{
+				++i;
+			}
+		}
+		else
+		{
+			benchmarks << QString::fromLocal8Bit(argv[i]);
+		}
+	}
+	return benchmarks;
+}
+
+int main(int argc, char *argv[])
+{
+	//OpenGL needs a QGuiApplication. check for it before creating the application, so the other benchmarks run without a display
+	QStringList benchmarks = getBenchmarkNames(argc, argv);
+	const bool needsOpenGL = benchmarks.isEmpty() || benchmarks.contains("uniforms");
+	std::unique_ptr<QCoreApplication> application(needsOpenGL ? new QGuiApplication(argc, argv) : new QCoreApplication(argc, argv));
+	if (benchmarks.isEmpty())
+	{
+		benchmarks << "encoder" << "colortable" << "uniforms" << "network";
+	}
+	bool correct = true;
+	for (const QString & benchmark : benchmarks)
+	{
+		if (benchmark == "encoder")
+		{
+			correct = benchmarkEncoder() && correct;
+		}
+		else if (benchmark == "colortable")
+		{
+			correct = benchmarkColorTable() && correct;
+		}
+		else if (benchmark == "uniforms")
+		{
+			correct = benchmarkUniforms() && correct;
+		}
+		else if (benchmark == "network")
+		{
+			correct = benchmarkNetwork() && correct;
+		}
+		else
+		{
+			printf("Unknown benchmark \"%s\"!\n", qPrintable(benchmark));
+			printf("Usage: NerDisco_Benchmark [encoder] [colortable] [uniforms] [network]\n");
+			return -1;
+		}
+	}
+	return correct ? 0 : 1;
+}
@@ -0,0 +1,573 @@
+// Host-side reference decoder for the LED protocols NerDisco sends.
+// Creates a pseudo-terminal and decodes the Adalight ("Ada") and compressed ("Adz") frames written to it,
+// just like the LEDStream_WS2812B sketch does on an Arduino, so the protocols can be tested without hardware.
+// Set the serial port of NerDisco to the device name printed on startup (e.g. "/dev/pts/5" as "portName" in settings.xml).
+// The decoder prints frame statistics once per second. Like the sketch it sends "Ada\n" when idle or when it
+// lost synchronization, which makes NerDisco send a key frame.
+// It can also receive the UDP protocols of NetworkOutput (E1.31, Art-Net and DDP) on the local machine. Set the host of
+// the network segment to 127.0.0.1 then. Packet contents are checked and the time it takes a frame to arrive is measured.
+// Usage: LEDStream_Host [-v] [-u e131|artnet|ddp]
+//   -v Print the first LEDs of every decoded frame.
+//   -u Receive UDP packets of the given protocol instead of serial data.
+// See DisplayEncoder.h for a description of the compressed protocol.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+#include <vector>
+#include <chrono>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+
+class StreamDecoder
+{
+public:
+	StreamDecoder(int fd, bool verbose)
+		: m_fd(fd)
+		, m_verbose(verbose)
+		, m_synchronized(false)
+		, m_frames(0)
+		, m_keyFrames(0)
+		, m_deltaFrames(0)
+		, m_errors(0)
+		, m_bytes(0)
+	{
+	}
+
+	void feed(const uint8_t * data, size_t size)
+	{
+		m_buffer.insert(m_buffer.end(), data, data + size);
+		m_bytes += size;
+		size_t consumed = 0;
+		while (decodeFrame(consumed))
+		{
+		}
+		m_buffer.erase(m_buffer.begin(), m_buffer.begin() + consumed);
+	}
+
+	void requestKeyFrame()
+	{
+		//same identifier the sketch sends. NerDisco will answer with a key frame
+		if (write(m_fd, "Ada\n", 4) != 4)
+		{
+			perror("Failed to write to pseudo-terminal");
+		}
+	}
+
+	void printStatistics(double seconds)
+	{
+		uint32_t hash = 2166136261u;
+		for (uint8_t value : m_leds)
+		{
+			hash = (hash ^ value) * 16777619u;
+		}
+		printf("%zu LEDs, %.1f fps, %.1f bytes/frame, %u key frames, %u delta frames, %u errors, frame hash %08x\n",
+			m_leds.size() / 3, m_frames / seconds, m_frames > 0 ? (double)m_bytes / m_frames : 0.0, m_keyFrames, m_deltaFrames, m_errors, hash);
+		fflush(stdout);
+		m_frames = 0;
+		m_keyFrames = 0;
+		m_deltaFrames = 0;
+		m_errors = 0;
+		m_bytes = 0;
+	}
+
+private:
+	/// @brief Try to decode a frame from the buffer starting at offset.
+	/// @return True if data was consumed and decoding should continue, false if more data is needed.
+	bool decodeFrame(size_t & offset)
+	{
+		//synchronize transmission using magic word, sizes and checksum
+		while (offset + 3 <= m_buffer.size() && !(m_buffer[offset] == 'A' && m_buffer[offset + 1] == 'd' && (m_buffer[offset + 2] == 'a' || m_buffer[offset + 2] == 'z')))
+		{
+			++offset;
+		}
+		if (offset + 6 > m_buffer.size())
+		{
+			return false;
+		}
+		const uint8_t * header = &m_buffer[offset];
+		if (header[5] != (header[3] ^ header[4] ^ 0x55))
+		{
+			//not a real header. skip magic word
+			offset += 3;
+			return true;
+		}
+		const size_t count = (header[3] << 8) | header[4];
+		if (header[2] == 'a')
+		{
+			//regular Adalight frame. LED data follows directly
+			if (offset + 6 + 3 * count > m_buffer.size())
+			{
+				return false;
+			}
+			m_leds.assign(header + 6, header + 6 + 3 * count);
+			offset += 6 + 3 * count;
+			frameDecoded(true);
+			return true;
+		}
+		//compressed frame. read type and payload size
+		if (offset + 9 > m_buffer.size())
+		{
+			return false;
+		}
+		const uint8_t type = header[6];
+		const size_t payloadSize = (header[7] << 8) | header[8];
+		if (offset + 10 + payloadSize > m_buffer.size())
+		{
+			return false;
+		}
+		const uint8_t * payload = header + 9;
+		uint8_t checksum = 0;
+		for (size_t i = 0; i < payloadSize; ++i)
+		{
+			checksum += payload[i];
+		}
+		offset += 10 + payloadSize;
+		if (checksum != payload[payloadSize] || (type != 'K' && type != 'D'))
+		{
+			error("Bad payload checksum or frame type");
+			return true;
+		}
+		if (type == 'D' && (!m_synchronized || m_leds.size() != 3 * count))
+		{
+			//delta to a frame we don't have. wait for the next key frame
+			error("Delta frame without key frame");
+			return true;
+		}
+		if (type == 'K')
+		{
+			m_leds.assign(3 * count, 0);
+		}
+		if (!applyCommands(payload, payloadSize))
+		{
+			error("Invalid command in payload");
+			return true;
+		}
+		frameDecoded(type == 'K');
+		return true;
+	}
+
+	bool applyCommands(const uint8_t * payload, size_t size)
+	{
+		const size_t count = m_leds.size() / 3;
+		size_t led = 0;
+		size_t i = 0;
+		while (i < size)
+		{
+			const uint8_t command = payload[i++];
+			if (command < 0x80)
+			{
+				//literal LEDs
+				const size_t n = command + 1;
+				if (led + n > count || i + 3 * n > size)
+				{
+					return false;
+				}
+				memcpy(&m_leds[3 * led], payload + i, 3 * n);
+				i += 3 * n;
+				led += n;
+			}
+			else if (command < 0xC0)
+			{
+				//run of one color
+				const size_t n = command - 0x80 + 1;
+				if (led + n > count || i + 3 > size)
+				{
+					return false;
+				}
+				for (size_t j = 0; j < n; ++j, ++led)
+				{
+					memcpy(&m_leds[3 * led], payload + i, 3);
+				}
+				i += 3;
+			}
+			else
+			{
+				//unchanged LEDs
+				if (i >= size)
+				{
+					return false;
+				}
+				const size_t n = (((command - 0xC0) << 8) | payload[i++]) + 1;
+				if (led + n > count)
+				{
+					return false;
+				}
+				led += n;
+			}
+		}
+		return true;
+	}
+
+	void frameDecoded(bool keyFrame)
+	{
+		m_synchronized = true;
+		++m_frames;
+		if (keyFrame)
+		{
+			++m_keyFrames;
+		}
+		else
+		{
+			++m_deltaFrames;
+		}
+		if (m_verbose)
+		{
+			printf("%c frame:", keyFrame ? 'K' : 'D');
+			for (size_t i = 0; i < m_leds.size() && i < 24; i += 3)
+			{
+				printf(" %02x%02x%02x", m_leds[i], m_leds[i + 1], m_leds[i + 2]);
+			}
+			printf("\n");
+		}
+	}
+
+	void error(const char * message)
+	{
+		if (m_verbose)
+		{
+			printf("Error: %s\n", message);
+		}
+		++m_errors;
+		m_synchronized = false;
+		requestKeyFrame();
+	}
+
+	int m_fd;
+	bool m_verbose;
+	bool m_synchronized;
+	std::vector<uint8_t> m_buffer;
+	std::vector<uint8_t> m_leds;
+	unsigned int m_frames;
+	unsigned int m_keyFrames;
+	unsigned int m_deltaFrames;
+	unsigned int m_errors;
+	size_t m_bytes;
+};
+
+class UdpDecoder
+{
+public:
+	enum Protocol { E131, ArtNet, DDP };
+
+	UdpDecoder(Protocol protocol, bool verbose)
+		: m_protocol(protocol)
+		, m_verbose(verbose)
+		, m_frames(0)
+		, m_packets(0)
+		, m_errors(0)
+		, m_bytes(0)
+		, m_frameTime(0.0)
+		, m_framePackets(0)
+		, m_framePixels(0)
+		, m_firstUniverse(-1)
+	{
+	}
+
+	static uint16_t port(Protocol protocol)
+	{
+		return protocol == E131 ? 5568 : (protocol == ArtNet ? 6454 : 4048);
+	}
+
+	void feed(const uint8_t * data, size_t size)
+	{
+		++m_packets;
+		m_bytes += size;
+		const bool ok = m_protocol == E131 ? decodeE131(data, size) : (m_protocol == ArtNet ? decodeArtNet(data, size) : decodeDDP(data, size));
+		if (!ok)
+		{
+			++m_errors;
+			if (m_verbose)
+			{
+				printf("Error: Invalid packet of %zu bytes\n", size);
+			}
+		}
+	}
+
+	void printStatistics(double seconds)
+	{
+		printf("%zu LEDs, %.1f fps, %.1f packets/s, %.1f bytes/frame, %.1f us/frame on the wire, %u errors\n",
+			m_leds.size() / 3, m_frames / seconds, m_packets / seconds, m_frames > 0 ? (double)m_bytes / m_frames : 0.0, m_frames > 0 ? 1000000.0 * m_frameTime / m_frames : 0.0, m_errors);
+		fflush(stdout);
+		m_frames = 0;
+		m_packets = 0;
+		m_errors = 0;
+		m_bytes = 0;
+		m_frameTime = 0.0;
+	}
+
+private:
+	void pixelData(size_t offset, const uint8_t * data, size_t size)
+	{
+		if (m_framePackets++ == 0)
+		{
+			m_frameStart = std::chrono::steady_clock::now();
+		}
+		if (m_leds.size() < offset + size)
+		{
+			m_leds.resize(offset + size);
+		}
+		memcpy(&m_leds[offset], data, size);
+		m_framePixels += size / 3;
+	}
+
+	void frameComplete()
+	{
+		if (m_framePackets == 0)
+		{
+			return;
+		}
+		m_frameTime += std::chrono::duration<double>(std::chrono::steady_clock::now() - m_frameStart).count();
+		++m_frames;
+		if (m_verbose)
+		{
+			printf("Frame: %zu packets, %zu LEDs:", m_framePackets, m_framePixels);
+			for (size_t i = 0; i < m_leds.size() && i < 24; i += 3)
+			{
+				printf(" %02x%02x%02x", m_leds[i], m_leds[i + 1], m_leds[i + 2]);
+			}
+			printf("\n");
+		}
+		m_framePackets = 0;
+		m_framePixels = 0;
+	}
+
+	/// @brief Without sync packets a frame is complete when the first universe arrives again.
+	void universeReceived(int universe, bool sync)
+	{
+		if (!sync)
+		{
+			if (m_firstUniverse < 0 || universe <= m_firstUniverse)
+			{
+				frameComplete();
+				m_firstUniverse = universe;
+			}
+		}
+	}
+
+	bool decodeE131(const uint8_t * data, size_t size)
+	{
+		static const uint8_t identifier[12] = { 'A', 'S', 'C', '-', 'E', '1', '.', '1', '7', 0, 0, 0 };
+		if (size < 49 || memcmp(data + 4, identifier, 12) != 0 || ((data[16] << 8 | data[17]) & 0x0FFF) != size - 16)
+		{
+			return false;
+		}
+		const uint32_t vector = data[18] << 24 | data[19] << 16 | data[20] << 8 | data[21];
+		if (vector == 0x00000008)
+		{
+			//universe synchronization
+			frameComplete();
+			return true;
+		}
+		if (vector != 0x00000004 || size < 126 || data[117] != 0x02 || data[118] != 0xA1 || data[125] != 0x00)
+		{
+			return false;
+		}
+		const size_t channels = (data[123] << 8 | data[124]) - 1;
+		const int universe = data[113] << 8 | data[114];
+		const bool sync = (data[109] << 8 | data[110]) != 0;
+		if (channels != size - 126 || universe < 1)
+		{
+			return false;
+		}
+		universeReceived(universe, sync);
+		m_firstUniverse = m_firstUniverse < 0 || universe < m_firstUniverse ? universe : m_firstUniverse;
+		pixelData((universe - m_firstUniverse) * 510, data + 126, channels);
+		return true;
+	}
+
+	bool decodeArtNet(const uint8_t * data, size_t size)
+	{
+		static const uint8_t identifier[8] = { 'A', 'r', 't', '-', 'N', 'e', 't', 0 };
+		if (size < 14 || memcmp(data, identifier, 8) != 0 || data[11] != 14)
+		{
+			return false;
+		}
+		const int opcode = data[9] << 8 | data[8];
+		if (opcode == 0x5200)
+		{
+			//ArtSync
+			m_artSync = true;
+			frameComplete();
+			return true;
+		}
+		if (opcode != 0x5000 || size < 18)
+		{
+			return false;
+		}
+		const size_t length = data[16] << 8 | data[17];
+		const int universe = (data[15] & 0x7F) << 8 | data[14];
+		if (length != size - 18 || (length & 1) != 0 || length > 512)
+		{
+			return false;
+		}
+		universeReceived(universe, m_artSync);
+		m_firstUniverse = m_firstUniverse < 0 || universe < m_firstUniverse ? universe : m_firstUniverse;
+		//data is padded to an even length. only complete LEDs are used
+		pixelData((universe - m_firstUniverse) * 510, data + 18, length - length % 3);
+		return true;
+	}
+
+	bool decodeDDP(const uint8_t * data, size_t size)
+	{
+		if (size < 10 || (data[0] & 0xC0) != 0x40)
+		{
+			return false;
+		}
+		const size_t offset = data[4] << 24 | data[5] << 16 | data[6] << 8 | data[7];
+		const size_t length = data[8] << 8 | data[9];
+		if (length != size - 10 || length % 3 != 0)
+		{
+			return false;
+		}
+		pixelData(offset, data + 10, length);
+		if (data[0] & 0x01)
+		{
+			//push flag. display frame
+			frameComplete();
+		}
+		return true;
+	}
+
+	Protocol m_protocol;
+	bool m_verbose;
+	bool m_artSync = false;
+	std::vector<uint8_t> m_leds;
+	unsigned int m_frames;
+	unsigned int m_packets;
+	unsigned int m_errors;
+	size_t m_bytes;
+	double m_frameTime;
+	std::chrono::steady_clock::time_point m_frameStart;
+	size_t m_framePackets;
+	size_t m_framePixels;
+	int m_firstUniverse;
+};
+
+int receiveUdp(UdpDecoder::Protocol protocol, bool verbose)
+{
+	int fd = socket(AF_INET, SOCK_DGRAM, 0);
+	sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_ANY);
+	address.sin_port = htons(UdpDecoder::port(protocol));
+	const int receiveBufferSize = 4 * 1024 * 1024;
+	setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &receiveBufferSize, sizeof(receiveBufferSize));
+	if (fd < 0 || bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0)
+	{
+		perror("Failed to open UDP socket");
+		return EXIT_FAILURE;
+	}
+	printf("Decoding LED data sent to UDP port %u\n", UdpDecoder::port(protocol));
+	fflush(stdout);
+	UdpDecoder decoder(protocol, verbose);
+	auto lastStatistics = std::chrono::steady_clock::now();
+	uint8_t data[65536];
+	while (true)
+	{
+		pollfd pfd = { fd, POLLIN, 0 };
+		if (poll(&pfd, 1, 1000) > 0 && (pfd.revents & POLLIN))
+		{
+			const ssize_t size = recv(fd, data, sizeof(data), 0);
+			if (size > 0)
+			{
+				decoder.feed(data, size);
+			}
+			else if (size < 0 && errno != EAGAIN && errno != EINTR)
+			{
+				perror("Failed to receive UDP packet");
+				break;
+			}
+		}
+		const auto now = std::chrono::steady_clock::now();
+		const double seconds = std::chrono::duration<double>(now - lastStatistics).count();
+		if (seconds >= 1.0)
+		{
+			decoder.printStatistics(seconds);
+			lastStatistics = now;
+		}
+	}
+	close(fd);
+	return EXIT_SUCCESS;
+}
+
+int main(int argc, char * argv[])
+{
+	bool verbose = false;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "-v") == 0)
+		{
+			verbose = true;
+		}
+		else if (strcmp(argv[i], "-u") == 0 && i + 1 < argc)
+		{
+			const char * name = argv[++i];
+			const UdpDecoder::Protocol protocol = strcmp(name, "artnet") == 0 ? UdpDecoder::ArtNet : (strcmp(name, "ddp") == 0 ? UdpDecoder::DDP : UdpDecoder::E131);
+			return receiveUdp(protocol, verbose);
+		}
+	}
+	//open pseudo-terminal master and set it to raw mode
+	int fd = posix_openpt(O_RDWR | O_NOCTTY);
+	if (fd < 0 || grantpt(fd) != 0 || unlockpt(fd) != 0)
+	{
+		perror("Failed to open pseudo-terminal");
+		return EXIT_FAILURE;
+	}
+	termios settings;
+	if (tcgetattr(fd, &settings) == 0)
+	{
+		cfmakeraw(&settings);
+		tcsetattr(fd, TCSANOW, &settings);
+	}
+	printf("Decoding LED data sent to %s\n", ptsname(fd));
+	fflush(stdout);
+	StreamDecoder decoder(fd, verbose);
+	auto lastStatistics = std::chrono::steady_clock::now();
+	uint8_t data[4096];
+	while (true)
+	{
+		pollfd pfd = { fd, POLLIN, 0 };
+		const int result = poll(&pfd, 1, 1000);
+		if (result > 0 && (pfd.revents & POLLIN))
+		{
+			const ssize_t size = read(fd, data, sizeof(data));
+			if (size > 0)
+			{
+				decoder.feed(data, size);
+			}
+			else if (size < 0 && errno != EIO && errno != EAGAIN)
+			{
+				perror("Failed to read from pseudo-terminal");
+				break;
+			}
+		}
+		else if (result == 0)
+		{
+			//nothing received for a second. tell the host we're here, like the sketch does
+			decoder.requestKeyFrame();
+		}
+		if (result > 0 && (pfd.revents & POLLHUP))
+		{
+			//no one has the slave side open. don't spin
+			usleep(100000);
+		}
+		const auto now = std::chrono::steady_clock::now();
+		const double seconds = std::chrono::duration<double>(now - lastStatistics).count();
+		if (seconds >= 1.0)
+		{
+			decoder.printStatistics(seconds);
+			lastStatistics = now;
+		}
+	}
+	close(fd);
+	return EXIT_SUCCESS;
+}
@@ -2,6 +2,9 @@
 // Uses Adalight protocol and is compatible with Boblight, Prismatik etc.
 // The "magic word" for synchronisation is "Ada" followed by LED count high and low byte and a checksum (the low and high byte XORed with 0x55).
 // The interface sends the string "Ada\n" in 1000ms intervals when idle, so the software can detect the display.
+// Additionally the compressed NerDisco protocol is supported. Its frames start with "Adz" followed by LED count high and low byte,
+// the checksum, the frame type ('K' = key frame, 'D' = delta frame), the payload size high and low byte, the payload and a payload checksum.
+// See DisplayEncoder.h in NerDisco for the payload commands. If a compressed frame can not be applied, "Ada\n" is sent to request a key frame.
 
 #include <FastLED.h>
 
@@ -9,10 +12,13 @@
 #define SERIAL_TIMEOUT 1000 //turn display off after a second. this is also the SCK send interval
 
 //Adalight sends a "magic word" (defined in /etc/boblight.conf) before sending the pixel data
-static const uint8_t magic[] = { 'A', 'd', 'a' };
-uint8_t hi, lo, checksum;
+//the third character is 'a' for regular and 'z' for compressed frames
+static const uint8_t magic[] = { 'A', 'd' };
+uint8_t hi, lo, checksum, type;
 uint16_t i;
 unsigned long lastReceiveTime = 0;
+//true if the LED buffer contains a complete frame delta frames can be applied to
+bool synchronized = false;
 
 //LED strip setup
 #define CALIBRATION_TEMPERATURE TypicalLEDStrip
@@ -52,24 +58,33 @@ void setup()
 void loop() {
 	//synchronize transmission using magic word, sizes and checksum
 	//read individual bytes of magic word from serial port and compare them
-	for (i = 0; i < sizeof magic; ++i) {
+	for (i = 0; i < sizeof magic;) {
 		if (waitForBytes(1) == false) {
 			return;
 		}
-		// Check next byte in magic word
-		if (magic[i] == Serial.read()) continue;
-		// otherwise, wait for first byte again...
-		i = 0;
+		// Check next byte in magic word, otherwise wait for first byte again...
+		uint8_t c = Serial.read();
+		if (magic[i] == c) {
+			++i;
+		}
+		else {
+			i = (magic[0] == c) ? 1 : 0;
+		}
 	}
-	//read count high and low byte and checksum
-	if (waitForBytes(3) == false) {
+	//read frame type, count high and low byte and checksum
+	if (waitForBytes(4) == false) {
             return;
 	}
+	type = Serial.read();
 	hi = Serial.read();
 	lo = Serial.read();
 	checksum = Serial.read();
 	// if checksum does not match go back synchronize again
-	if (checksum != (hi ^ lo ^ 0x55)) {
+	if ((type != 'a' && type != 'z') || checksum != (hi ^ lo ^ 0x55)) {
+		return;
+	}
+	if (type == 'z') {
+		readCompressedFrame();
 		return;
 	}
 	//clear led color buffer to black
@@ -82,6 +97,7 @@ void loop() {
 		Serial.readBytes((uint8_t*)(&leds[i]), 45);
                 i += 15;
 	}
+	synchronized = true;
 	// shows new values
 	FastLED.show();
 	//If you have problems, try one of these two:
@@ -93,6 +109,110 @@ void loop() {
 	}*/
 }
 
+void readCompressedFrame()
+{
+	//read frame type and payload size
+	if (waitForBytes(3) == false) {
+		return;
+	}
+	uint8_t frameType = Serial.read();
+	uint16_t remaining = Serial.read() << 8;
+	remaining |= Serial.read();
+	//we can only apply delta frames if we have the frame they're based on
+	if ((frameType != 'K' && frameType != 'D') || (frameType == 'D' && !synchronized) || ((hi << 8) | lo) != NUM_LEDS) {
+		requestKeyFrame();
+		return;
+	}
+	if (frameType == 'K') {
+		memset(leds, 0, NUM_LEDS * sizeof(struct CRGB));
+	}
+	//apply payload commands to LED buffer
+	uint8_t * data = (uint8_t*)leds;
+	uint8_t sum = 0;
+	uint16_t led = 0;
+	uint16_t count;
+	while (remaining > 0) {
+		if (waitForBytes(1) == false) {
+			return;
+		}
+		uint8_t command = Serial.read();
+		sum += command;
+		--remaining;
+		if (command < 0x80) {
+			//literal LEDs follow
+			count = command + 1;
+			if (led + count > NUM_LEDS || 3 * count > remaining || readPayload(data + 3 * led, 3 * count, sum) == false) {
+				requestKeyFrame();
+				return;
+			}
+			remaining -= 3 * count;
+		}
+		else if (command < 0xC0) {
+			//run of one color
+			count = command - 0x80 + 1;
+			if (led + count > NUM_LEDS || 3 > remaining || readPayload(data + 3 * led, 3, sum) == false) {
+				requestKeyFrame();
+				return;
+			}
+			for (i = 1; i < count; ++i) {
+				leds[led + i] = leds[led];
+			}
+			remaining -= 3;
+		}
+		else {
+			//skip unchanged LEDs
+			if (remaining < 1 || waitForBytes(1) == false) {
+				requestKeyFrame();
+				return;
+			}
+			uint8_t low = Serial.read();
+			sum += low;
+			--remaining;
+			count = (((command - 0xC0) << 8) | low) + 1;
+			if (led + count > NUM_LEDS) {
+				requestKeyFrame();
+				return;
+			}
+		}
+		led += count;
+	}
+	//check payload checksum. if it doesn't match, the LED buffer is broken
+	if (waitForBytes(1) == false) {
+		return;
+	}
+	if (Serial.read() != sum) {
+		requestKeyFrame();
+		return;
+	}
+	synchronized = true;
+	// shows new values
+	FastLED.show();
+}
+
+boolean readPayload(uint8_t * data, uint16_t count, uint8_t & sum)
+{
+	while (count > 0) {
+		uint16_t chunk = count > 45 ? 45 : count;
+		if (waitForBytes(chunk) == false) {
+			return false;
+		}
+		Serial.readBytes(data, chunk);
+		for (i = 0; i < chunk; ++i) {
+			sum += data[i];
+		}
+		data += chunk;
+		count -= chunk;
+	}
+	return true;
+}
+
+void requestKeyFrame()
+{
+	//the LED buffer is not valid anymore. send identifier, so the host sends a key frame
+	synchronized = false;
+	Serial.print("Ada\n");
+}
+
 boolean waitForBytes(int numberOfBytes)
 {
 	lastReceiveTime = millis();
@@ -103,6 +223,7 @@ boolean waitForBytes(int numberOfBytes)
 			//erase display
 			memset(leds, 0, NUM_LEDS * sizeof(struct CRGB));
 			FastLED.show();
+			synchronized = false;
 			//Send standard identifier string to host
 			Serial.print("Ada\n");
 			return false;
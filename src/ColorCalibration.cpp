@@ -0,0 +1,179 @@
+#include "ColorCalibration.h"
+
+#include <QFile>
+#include <QTextStream>
+#include <QStringList>
+#include <QRegExp>
+#include <QMap>
+#include <stdexcept>
+#include <algorithm>
+
+
+namespace
+{
+	const float Identity[9] = {1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f};
+
+	/// @brief Parse a list of numbers. Returns false if a value is not a number.
+	bool parseValues(const QStringList & strings, int first, int count, float * values)
+	{
+		for (int i = 0; i < count; ++i)
+		{
+			bool ok = false;
+			values[i] = strings.at(first + i).toFloat(&ok);
+			//keep coefficients in a range that can not overflow the fixed-point math
+			if (!ok || values[i] < -8.0f || values[i] > 8.0f)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	QStringList splitValues(const QString & values)
+	{
+		return values.trimmed().split(QRegExp("[\\s,;]+"), QString::SkipEmptyParts);
+	}
+}
+
+
+ColorCalibration::ColorCalibration()
+	: m_ledCount(0)
+	, m_identity(true)
+{
+	std::copy(Identity, Identity + 9, m_matrix);
+	std::fill(m_gain, m_gain + 3, 1.0f);
+	combine();
+}
+
+void ColorCalibration::setMatrix(const QString & values)
+{
+	const QStringList strings = splitValues(values);
+	float matrix[9];
+	if (strings.isEmpty())
+	{
+		std::copy(Identity, Identity + 9, matrix);
+	}
+	else if (strings.size() != 9 || !parseValues(strings, 0, 9, matrix))
+	{
+		throw std::runtime_error(QString("Invalid color matrix \"%1\". It needs 9 values in [-8,8]!").arg(values).toStdString());
+	}
+	std::copy(matrix, matrix + 9, m_matrix);
+	combine();
+}
+
+void ColorCalibration::setGain(const QString & values)
+{
+	const QStringList strings = splitValues(values);
+	float gain[3] = {1.0f, 1.0f, 1.0f};
+	if (!strings.isEmpty() && (strings.size() != 3 || !parseValues(strings, 0, 3, gain)))
+	{
+		throw std::runtime_error(QString("Invalid color gain \"%1\". It needs 3 values in [-8,8]!").arg(values).toStdString());
+	}
+	std::copy(gain, gain + 3, m_gain);
+	combine();
+}
+
+void ColorCalibration::loadLedFile(const QString & fileName)
+{
+	if (fileName.isEmpty())
+	{
+		m_ledMatrices.clear();
+		m_ledCount = 0;
+		combine();
+		return;
+	}
+	QFile file(fileName);
+	if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+	{
+		throw std::runtime_error(QString("Failed to open LED calibration file \"%1\"!").arg(fileName).toStdString());
+	}
+	//read matrices, sorted by LED index
+	QMap<int, QVector<float>> matrices;
+	QTextStream stream(&file);
+	int lineNumber = 0;
+	while (!stream.atEnd())
+	{
+		const QString line = stream.readLine().trimmed();
+		++lineNumber;
+		if (line.isEmpty() || line.startsWith('#'))
+		{
+			continue;
+		}
+		const QStringList strings = splitValues(line);
+		bool ok = false;
+		const int index = strings.isEmpty() ? -1 : strings.at(0).toInt(&ok);
+		QVector<float> matrix(9);
+		std::copy(Identity, Identity + 9, matrix.begin());
+		if (strings.size() == 4)
+		{
+			//per-channel gain on the diagonal
+			float gain[3];
+			ok = ok && parseValues(strings, 1, 3, gain);
+			matrix[0] = gain[0];
+			matrix[4] = gain[1];
+			matrix[8] = gain[2];
+		}
+		else if (strings.size() == 10)
+		{
+			ok = ok && parseValues(strings, 1, 9, matrix.data());
+		}
+		else
+		{
+			ok = false;
+		}
+		if (!ok || index < 0 || index > 0xFFFFF)
+		{
+			throw std::runtime_error(QString("Invalid LED in line %1 of calibration file \"%2\"!").arg(lineNumber).arg(fileName).toStdString());
+		}
+		if (matrices.contains(index))
+		{
+			throw std::runtime_error(QString("Duplicate LED index %1 in line %2 of calibration file \"%3\"!").arg(index).arg(lineNumber).arg(fileName).toStdString());
+		}
+		matrices.insert(index, matrix);
+	}
+	//store matrices for all LEDs up to the highest index, using the identity matrix for missing LEDs
+	m_ledCount = matrices.isEmpty() ? 0 : matrices.lastKey() + 1;
+	m_ledMatrices.resize(9 * m_ledCount);
+	for (int led = 0; led < m_ledCount; ++led)
+	{
+		std::copy(Identity, Identity + 9, m_ledMatrices.begin() + 9 * led);
+	}
+	for (auto it = matrices.constBegin(); it != matrices.constEnd(); ++it)
+	{
+		std::copy(it.value().constBegin(), it.value().constEnd(), m_ledMatrices.begin() + 9 * it.key());
+	}
+	combine();
+}
+
+bool ColorCalibration::isIdentity() const
+{
+	return m_identity;
+}
+
+void ColorCalibration::combine()
+{
+	m_fixed.resize(9 * (m_ledCount + 1));
+	m_identity = true;
+	const int one = 1 << FixedShift;
+	for (int led = -1; led < m_ledCount; ++led)
+	{
+		//combine gain * segment matrix * LED matrix. entry -1 is the segment matrix alone
+		const float * ledMatrix = led < 0 ? Identity : m_ledMatrices.constData() + 9 * led;
+		int * fixed = m_fixed.data() + 9 * (led + 1);
+		for (int row = 0; row < 3; ++row)
+		{
+			for (int column = 0; column < 3; ++column)
+			{
+				float value = 0.0f;
+				for (int i = 0; i < 3; ++i)
+				{
+					value += m_matrix[3 * row + i] * ledMatrix[3 * i + column];
+				}
+				//limit combined coefficients, so 8bit colors times the matrix always fit into 32bit
+				value = qBound(-16.0f, value * m_gain[row], 16.0f);
+				fixed[3 * row + column] = qRound(value * one);
+				m_identity = m_identity && fixed[3 * row + column] == (row == column ? one : 0);
+			}
+		}
+	}
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <QString>
+#include <QVector>
+#include <memory>
+
+
+/// @brief Color calibration of the LEDs of a display segment, e.g. to match the white points of different strip batches.
+/// The color sent for an LED is gain * segment matrix * LED matrix * color, with the matrices being 3x3 matrices
+/// applied to (red, green, blue) column vectors. The combined matrices are stored in 20.12 fixed-point format,
+/// so they can be applied in the pass that builds the output packet at little cost.
+/// An LED calibration file is a text file with one LED per line, as "index r g b" to set per-channel gains,
+/// or as "index m00 m01 m02 m10 m11 m12 m20 m21 m22" to set a matrix in row-major order.
+/// index is the position of the LED in the segment starting at 0. LEDs not in the file are not changed.
+/// Values can be separated by spaces, tabs, commas or semicolons. Lines starting with '#' are comments.
+class ColorCalibration
+{
+public:
+	/// brief Shared pointer of ColorCalibration object.
+	typedef std::shared_ptr<ColorCalibration> SPtr;
+
+	/// @brief Number of fractional bits of the fixed-point matrices.
+	static const int FixedShift = 12;
+
+	/// @brief Construct an identity calibration.
+	ColorCalibration();
+
+	/// @brief Set the matrix applied to all LEDs of the segment.
+	/// @param values 9 values in row-major order. Pass an empty string for the identity matrix.
+	/// @throw std::runtime_error if the values can not be parsed.
+	void setMatrix(const QString & values);
+
+	/// @brief Set the per-channel gain applied to all LEDs of the segment.
+	/// @param values 3 values for red, green and blue. Pass an empty string for a gain of 1.
+	/// @throw std::runtime_error if the values can not be parsed.
+	void setGain(const QString & values);
+
+	/// @brief Load per-LED calibration from a file.
+	/// @param fileName Path to calibration file. Pass an empty string to remove the per-LED calibration.
+	/// @throw std::runtime_error if the file can not be read or is invalid.
+	void loadLedFile(const QString & fileName);
+
+	/// @brief Check if the calibration does not change any colors, so it can be skipped.
+	bool isIdentity() const;
+
+	/// @brief Get the fixed-point matrix of an LED.
+	/// @param led Index of the LED in the segment.
+	/// @return 9 values in row-major order with FixedShift fractional bits.
+	inline const int * matrix(int led) const
+	{
+		return led < m_ledCount ? m_fixed.constData() + 9 * (led + 1) : m_fixed.constData();
+	}
+
+private:
+	/// @brief Rebuild the fixed-point matrices from the segment matrix, gain and LED matrices.
+	void combine();
+
+	float m_matrix[9];
+	float m_gain[3];
+	/// @brief 9 values per LED. LEDs without calibration hold the identity matrix.
+	QVector<float> m_ledMatrices;
+	int m_ledCount;
+	/// @brief Combined segment matrix, followed by the combined matrices of all calibrated LEDs.
+	QVector<int> m_fixed;
+	bool m_identity;
+};
@@ -4,16 +4,22 @@
 
 #include <QFileDialog>
 #include <QMessageBox>
-#include <QDirIterator>
 
 
 Deck::Deck(QWidget *parent)
 	: QWidget(parent)
 	, ui(new Ui::CodeDeck)
+	, m_renderThread(nullptr)
+	, m_deckIndex(0)
+	, m_valueAHandle(-1)
+	, m_valueBHandle(-1)
+	, m_valueCHandle(-1)
+	, m_valueDHandle(-1)
+	, m_triggerAHandle(-1)
+	, m_triggerBHandle(-1)
+	, m_scriptLibrary(nullptr)
 	, m_codeEdit(new CodeEdit())
-	, m_scriptTime(QTime::currentTime())
 	, m_scriptModified(false)
-	, m_commentExp("^//(\\w+)\\s*=\\s*(\\S+)$")
 	, m_errorExp("\\b(ERROR|Error|error)\\b:\\s?(\\d+):\\s?(\\d+):\\s?(.*)\\n")
 	, m_errorExp2("\\s?(\\d+):(\\d+)\\(\\d+\\):\\s?(ERROR|Error|error):\\s?(.*)\\n")
 	, m_midiInterface(MIDIInterface::getInstance())
@@ -29,6 +35,8 @@ Deck::Deck(QWidget *parent)
 	, triggerB("triggerB", false)
 	, autoCycleScripts("autoCycleScripts", false)
 	, autoCycleInterval("autoCycleInterval", 15, 1, 120)
+	, opacity("opacity", 100, 0, 100)
+	, blendMode("blendMode", BlendNormal, 0, BlendModeCount - 1)
 {
     ui->setupUi(this);
 	QVBoxLayout * deckLayout = (QVBoxLayout*)ui->groupBox->layout();
@@ -51,9 +59,11 @@ Deck::Deck(QWidget *parent)
 	connectParameter(valueD, ui->valueD);
 	connectParameter(triggerA, ui->triggerA);
 	connectParameter(triggerB, ui->triggerB);
+	connectParameter(opacity, ui->opacity);
+	//the entries of the combo box are in the order of BlendMode
+	connectParameter(blendMode, ui->blendMode);
 	//connect other parameters to functions
 	connect(updateInterval.GetSharedParameter().get(), SIGNAL(valueChanged(int)), this, SLOT(setUpdateInterval(int)));
-	connect(asynchronousCompilation.GetSharedParameter().get(), SIGNAL(valueChanged(bool)), m_liveView, SLOT(enableAsynchronousCompilation(bool)));
 	connect(frameBufferWidth.GetSharedParameter().get(), SIGNAL(valueChanged(int)), this, SLOT(setFrameBufferWidth(int)));
 	connect(frameBufferHeight.GetSharedParameter().get(), SIGNAL(valueChanged(int)), this, SLOT(setFrameBufferHeight(int)));
 	//connect parameters for script autocycling
@@ -66,14 +76,11 @@ Deck::Deck(QWidget *parent)
 	m_midiInterface->getParameterMapping()->registerMIDIParameter(valueD.GetSharedParameter());
 	m_midiInterface->getParameterMapping()->registerMIDIParameter(triggerA.GetSharedParameter());
 	m_midiInterface->getParameterMapping()->registerMIDIParameter(triggerB.GetSharedParameter());
+	m_midiInterface->getParameterMapping()->registerMIDIParameter(opacity.GetSharedParameter());
+	m_midiInterface->getParameterMapping()->registerMIDIParameter(blendMode.GetSharedParameter());
 	//set up regular expression for error parsing
-	m_commentExp.setMinimal(true);
 	m_errorExp.setMinimal(true);
 	m_errorExp2.setMinimal(true);
-    //when the script changes either sucessfully or has errors, we get notified
-	connect(m_liveView, SIGNAL(fragmentScriptChanged()), this, SLOT(scriptCompiledOk()));
-	connect(m_liveView, SIGNAL(fragmentScriptErrors(const QString &)), this, SLOT(scriptHasErrors(const QString &)));
-	connect(m_liveView, SIGNAL(renderingFinished()), this, SIGNAL(renderingFinished()));
     //when the script is being modified, we keep track of that in the GUI
     connect(m_codeEdit->document(), SIGNAL(modificationChanged(bool)), this, SLOT(scriptModified(bool)));
     //when the script is edited a timer is started to wait a bit before updating the script
@@ -81,13 +88,18 @@ Deck::Deck(QWidget *parent)
     //set up timer that waits while the user edits the document
     connect(&m_editTimer, SIGNAL(timeout()), this, SLOT(updateScriptFromText()));
     m_editTimer.setSingleShot(true);
-    //set up timer for updating the time property
-//    connect(&m_updateTimer, SIGNAL(timeout()), this, SLOT(updateTime()));
-//	m_updateTimer.start(updateInterval);
+	//pass values to the render thread when they change
+	connect(valueA.GetSharedParameter().get(), SIGNAL(valueChanged(int)), this, SLOT(updateScriptValues()));
+	connect(valueB.GetSharedParameter().get(), SIGNAL(valueChanged(int)), this, SLOT(updateScriptValues()));
+	connect(valueC.GetSharedParameter().get(), SIGNAL(valueChanged(int)), this, SLOT(updateScriptValues()));
+	connect(valueD.GetSharedParameter().get(), SIGNAL(valueChanged(int)), this, SLOT(updateScriptValues()));
+	connect(triggerA.GetSharedParameter().get(), SIGNAL(valueChanged(bool)), this, SLOT(updateScriptValues()));
+	connect(triggerB.GetSharedParameter().get(), SIGNAL(valueChanged(bool)), this, SLOT(updateScriptValues()));
+	//notify the mixer when the layer changes
+	connect(opacity.GetSharedParameter().get(), SIGNAL(valueChanged(int)), this, SIGNAL(layerChanged()));
+	connect(blendMode.GetSharedParameter().get(), SIGNAL(valueChanged(int)), this, SIGNAL(layerChanged()));
 	//load default script
 	loadScript(":/effects/default.fs");
-    //reset elapsed time
-    m_scriptTime.start();
 }
 
 Deck::~Deck()
@@ -125,6 +137,8 @@ void Deck::toXML(QDomElement & parent) const
 	triggerB.toXML(element);
 	autoCycleScripts.toXML(element);
 	autoCycleInterval.toXML(element);
+	opacity.toXML(element);
+	blendMode.toXML(element);
 	parent.appendChild(element);
 }
 
@@ -161,12 +175,34 @@ Deck & Deck::fromXML(const QDomElement & parent)
 			asynchronousCompilation.fromXML(child);
 			autoCycleScripts.fromXML(child);
 			autoCycleInterval.fromXML(child);
+			opacity.fromXML(child);
+			blendMode.fromXML(child);
 			return *this;
 		}
 	}
 	throw std::runtime_error("No settings found for deck!");
 }
 
+void Deck::setRenderThread(RenderThread * renderThread, int deckIndex)
+{
+	m_renderThread = renderThread;
+	m_deckIndex = deckIndex;
+	//when the script changes either sucessfully or has errors, we get notified
+	connect(m_renderThread, SIGNAL(scriptChanged(int)), this, SLOT(scriptCompiledOk(int)));
+	connect(m_renderThread, SIGNAL(scriptErrors(int, const QString &)), this, SLOT(scriptHasErrors(int, const QString &)));
+	//get uniform handles once, so values need not be looked up by name for every frame
+	m_valueAHandle = m_renderThread->uniformHandle(valueA.name());
+	m_valueBHandle = m_renderThread->uniformHandle(valueB.name());
+	m_valueCHandle = m_renderThread->uniformHandle(valueC.name());
+	m_valueDHandle = m_renderThread->uniformHandle(valueD.name());
+	m_triggerAHandle = m_renderThread->uniformHandle(triggerA.name());
+	m_triggerBHandle = m_renderThread->uniformHandle(triggerB.name());
+	//send current script and values
+	m_currentText = m_codeEdit->toPlainText();
+	m_renderThread->setScript(m_deckIndex, m_currentText);
+	updateScriptValues();
+}
+
 void Deck::setDeckName(const QString & name)
 {
 	setObjectName(name);
@@ -177,6 +213,16 @@ void Deck::setDeckName(const QString & name)
 	m_midiInterface->getParameterMapping()->registerMIDIParameter(valueD.GetSharedParameter(), name);
 	m_midiInterface->getParameterMapping()->registerMIDIParameter(triggerA.GetSharedParameter(), name);
 	m_midiInterface->getParameterMapping()->registerMIDIParameter(triggerB.GetSharedParameter(), name);
+	m_midiInterface->getParameterMapping()->registerMIDIParameter(opacity.GetSharedParameter(), name);
+	m_midiInterface->getParameterMapping()->registerMIDIParameter(blendMode.GetSharedParameter(), name);
+}
+
+DeckLayer Deck::layer() const
+{
+	DeckLayer layer;
+	layer.opacity = opacity.normalizedValue();
+	layer.blendMode = (BlendMode)qBound(0, (int)blendMode, BlendModeCount - 1);
+	return layer;
 }
 
 void Deck::setAutoCycleScripts(bool enable)
@@ -201,37 +247,17 @@ void Deck::setAutoCycleInterval(int seconds)
 
 void Deck::loadNextScript()
 {
-	if (!m_scriptPath.isEmpty())
+	if (m_scriptLibrary)
 	{
-		QStringList scripts = buildScriptList(m_scriptPath);
-		if (!scripts.isEmpty())
+		//go to next script and load it
+		const QString nextScript = m_scriptLibrary->nextScript(m_currentScriptPath);
+		if (!nextScript.isEmpty())
 		{
-			//try to find current script in list of scripts
-			int scriptIndex = scripts.indexOf(m_currentScriptPath);
-			//go to next script and load it
-			scriptIndex = (scriptIndex + 1) % scripts.size();
-			loadScript(scripts.at(scriptIndex));
+			loadScript(nextScript);
 		}
 	}
 }
 
-QStringList Deck::buildScriptList(const QString & path)
-{
-	QStringList list;
-	QDirIterator it(path, QStringList() << "*.fs", QDir::Files, QDirIterator::Subdirectories);
-	while (it.hasNext()) {
-		if (it.fileInfo().isDir())
-		{
-			list.append(buildScriptList(it.path()));
-		}
-		else
-		{
-			list << it.next();
-		}
-	}
-	return list;
-}
-
 void Deck::setUpdateInterval(int interval)
 {
 	m_updateTimer.setInterval(interval);
@@ -250,41 +276,45 @@ void Deck::setFrameBufferHeight(int height)
 	m_liveView->setRenderSize(frameBufferWidth, frameBufferHeight);
 }
 
-void Deck::setScriptPath(const QString & scriptPath)
+void Deck::setScriptLibrary(ScriptLibrary * scriptLibrary)
 {
-	m_scriptPath = scriptPath;
+	m_scriptLibrary = scriptLibrary;
 }
 
 bool Deck::loadScript(const QString & path)
 {
-    QFile file(path);
-    if (file.open(QFile::ReadOnly))
-    {
-        //set script in editor. compilation will run automatically
-		QByteArray data = file.readAll();
-        m_codeEdit->setPlainText(data);
-        m_codeEdit->document()->setModified(false);
-        m_currentScriptPath = path;
-        if (!m_currentScriptPath.startsWith(":/"))
-        {
-            m_currentScriptPath = QDir::current().relativeFilePath(path);
-        }
-		ui->groupBox->setTitle(objectName() + " (" + m_currentScriptPath + ")");
-		//find any variables in comments
-		QList<QByteArray> lines = data.split(QChar::LineFeed);
-		for (auto line : lines)
+	QString text;
+	QList<QPair<QString, QString>> parameters;
+	const QString scriptPath = ScriptLibrary::libraryPath(path);
+	if (m_scriptLibrary && m_scriptLibrary->contains(scriptPath))
+	{
+		//scripts from the library are in memory already
+		const ScriptInfo script = m_scriptLibrary->script(scriptPath);
+		text = script.text;
+		parameters = script.parameters;
+	}
+	else
+	{
+		QFile file(path);
+		if (!file.open(QFile::ReadOnly))
 		{
-			if (m_commentExp.indexIn(line) >= 0)
-			{
-				//get variable name and value from line
-				QString variable = m_commentExp.cap(1);
-				QString value = m_commentExp.cap(2);
-				setScriptParameter(variable, value);
-			}
+			return false;
 		}
-        return true;
-    }
-    return false;
+		QByteArray data = file.readAll();
+		text = data;
+		parameters = ScriptLibrary::parseParameters(data);
+	}
+	//set script in editor. compilation will run automatically
+	m_codeEdit->setPlainText(text);
+	m_codeEdit->document()->setModified(false);
+	m_currentScriptPath = scriptPath;
+	ui->groupBox->setTitle(objectName() + " (" + m_currentScriptPath + ")");
+	//set variables found in comments
+	for (auto parameter : parameters)
+	{
+		setScriptParameter(parameter.first, parameter.second);
+	}
+	return true;
 }
 
 bool Deck::saveScript()
@@ -350,8 +380,11 @@ void Deck::updateScriptFromText()
     {
         //store new current text
         m_currentText = m_codeEdit->toPlainText();
-		//send script to live view to compile it
-		m_liveView->setFragmentScript(m_currentText.toLocal8Bit());
+		//send script to render thread to compile it
+		if (m_renderThread)
+		{
+			m_renderThread->setScript(m_deckIndex, m_currentText);
+		}
     }
 }
 
@@ -368,16 +401,24 @@ void Deck::scriptModified(bool modified)
 	ui->groupBox->setTitle(objectName() + " (" + m_currentScriptPath + ")" + (m_scriptModified ? "*" : ""));
 }
 
-void Deck::scriptCompiledOk()
+void Deck::scriptCompiledOk(int deck)
 {
+	if (deck != m_deckIndex)
+	{
+		return;
+	}
 	m_codeEdit->setErrors();
 	updateScriptValues();
 }
 
-void Deck::scriptHasErrors(const QString & errors)
+void Deck::scriptHasErrors(int deck, const QString & errors)
 {
+	if (deck != m_deckIndex)
+	{
+		return;
+	}
 	//figure out line number adjustment due to script prefix
-	const int prefixLineCount = m_liveView->currentScriptPrefix().count(QLatin1Char('\n'));
+	const int prefixLineCount = m_renderThread->scriptPrefix().count(QLatin1Char('\n'));
 	//parse errors
 	QVector<CodeEdit::Error> list;
 	CodeEdit::Error error;
@@ -448,54 +489,60 @@ void Deck::setScriptParameter(const QString & name, const QString & value)
 	}
 }
 
-void Deck::updateScriptValues()
-{
-    //update properties in new active script
-    m_liveView->setFragmentScriptProperty("time", (float)m_scriptTime.elapsed() / 1000.0f);
-	m_liveView->setFragmentScriptProperty(valueA.name(), valueA.normalizedValue());
-	m_liveView->setFragmentScriptProperty(valueB.name(), valueB.normalizedValue());
-	m_liveView->setFragmentScriptProperty(valueC.name(), valueC.normalizedValue());
-	m_liveView->setFragmentScriptProperty(valueD.name(), valueD.normalizedValue());
-	m_liveView->setFragmentScriptProperty(triggerA.name(), triggerA.normalizedValue());
-	m_liveView->setFragmentScriptProperty(triggerB.name(), triggerB.normalizedValue());
-}
-
-void Deck::render()
+void Deck::setScriptValue(int handle, float value)
 {
-	updateScriptValues();
-	m_liveView->render();
-}
-
-void Deck::grabFramebufferAfterSwap()
-{
-	m_liveView->grabFramebufferAfterSwap();
+	if (m_renderThread && handle >= 0)
+	{
+		if (handle >= m_scriptValues.size())
+		{
+			m_scriptValues.resize(handle + 1);
+		}
+		m_scriptValues[handle] = value;
+		m_renderThread->setScriptValues(m_deckIndex, m_scriptValues);
+	}
 }
 
-QImage Deck::getGrabbedFramebuffer()
+void Deck::updateScriptValues()
 {
-	return m_liveView->getGrabbedFramebuffer();
+	if (!m_renderThread)
+	{
+		return;
+	}
+	//update properties in new active script. handles are assigned in order, so triggerB has the highest one
+	m_scriptValues.resize(qMax(m_scriptValues.size(), m_triggerBHandle + 1));
+	m_scriptValues[m_valueAHandle] = valueA.normalizedValue();
+	m_scriptValues[m_valueBHandle] = valueB.normalizedValue();
+	m_scriptValues[m_valueCHandle] = valueC.normalizedValue();
+	m_scriptValues[m_valueDHandle] = valueD.normalizedValue();
+	m_scriptValues[m_triggerAHandle] = triggerA.normalizedValue();
+	m_scriptValues[m_triggerBHandle] = triggerB.normalizedValue();
+	m_renderThread->setScriptValues(m_deckIndex, m_scriptValues);
 }
 
-void Deck::updateTime()
+void Deck::showFrame(GLuint texture, const QSize & size)
 {
-	m_liveView->setFragmentScriptProperty("time", (float)m_scriptTime.elapsed() / 1000.0f);
+	m_liveView->setTexture(texture, size);
 }
 
 void Deck::parameterChanged(NodeBase * parameter)
 {
+	if (!m_renderThread)
+	{
+		return;
+	}
 	if (dynamic_cast<ParameterBool*>(parameter))
 	{
 		ParameterBool * p = dynamic_cast<ParameterBool*>(parameter);
-		m_liveView->setFragmentScriptProperty(p->name(), *p);
+		setScriptValue(m_renderThread->uniformHandle(p->name()), *p ? 1.0f : 0.0f);
 	}
 	else if (dynamic_cast<ParameterInt*>(parameter))
 	{
 		ParameterInt * p = dynamic_cast<ParameterInt*>(parameter);
-		m_liveView->setFragmentScriptProperty(p->name(), p->normalizedValue());
+		setScriptValue(m_renderThread->uniformHandle(p->name()), p->normalizedValue());
 	}
 	else if (dynamic_cast<ParameterFloat*>(parameter))
 	{
 		ParameterFloat * p = dynamic_cast<ParameterFloat*>(parameter);
-		m_liveView->setFragmentScriptProperty(p->name(), p->normalizedValue());
+		setScriptValue(m_renderThread->uniformHandle(p->name()), p->normalizedValue());
 	}
 }
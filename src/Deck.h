@@ -1,13 +1,14 @@
 #pragma once
 
 #include "LiveView.h"
+#include "RenderThread.h"
+#include "ScriptLibrary.h"
 #include "CodeEdit.h"
 #include "Parameters.h"
 #include "MIDIInterface.h"
 
 #include <QWidget>
 #include <QTimer>
-#include <QTime>
 
 namespace Ui { class CodeDeck; }
 
@@ -28,6 +29,7 @@ public:
 	void setDeckName(const QString & name);
 
 	ParameterInt updateInterval;
+	/// @brief Unused. Scripts are always compiled in the render thread. Kept so settings files stay compatible.
 	ParameterBool asynchronousCompilation;
 	ParameterInt frameBufferWidth;
 	ParameterInt frameBufferHeight;
@@ -42,27 +44,39 @@ public:
 	ParameterBool autoCycleScripts;
 	ParameterInt autoCycleInterval;
 
-	void setScriptPath(const QString & scriptPath);
+	/// @brief Opacity of the deck when layered over the decks below it. [0,100]
+	ParameterInt opacity;
+	/// @brief How the deck is layered over the decks below it, see BlendMode.
+	ParameterInt blendMode;
+	/// @brief Get opacity and blend mode for mixing, see DisplayMixer.
+	DeckLayer layer() const;
+
+	/// @brief Set the library scripts are loaded from and auto-cycled through. Scripts not in the library are read from disk.
+	void setScriptLibrary(ScriptLibrary * scriptLibrary);
     bool loadScript(const QString & path);
     bool saveScript();
     bool saveAsScript(const QString & path = "");
-	static QStringList buildScriptList(const QString & path);
-
-	/// @brief Update view and emit signal renderingFinished when rendering and the asynchronous buffer swap have finished.
-	void render();
 
-	/// @brief Call when you want the framebuffer after the next buffer swap.
-	/// You can retrieve the last grabbed framebuffer using QImage getGrabbedFrameBuffer().
-	void grabFramebufferAfterSwap();
+	/// @brief Set the thread the deck is rendered in. The current script is compiled there and its errors are reported back to the deck.
+	/// @param renderThread Thread rendering all decks.
+	/// @param deckIndex Index of this deck in the render thread.
+	void setRenderThread(RenderThread * renderThread, int deckIndex);
 
-	/// @brief Retrieve the last grabbed framebuffer. Call void grabFrameBufferAfterSwap() to grab it after a buffer swap.
-	QImage getGrabbedFramebuffer();
+	/// @brief Display a frame rendered by the render thread.
+	/// @param texture Texture of the deck, see RenderedFrame::deckTextures.
+	/// @param size Size of the texture.
+	void showFrame(GLuint texture, const QSize & size);
 
     ~Deck();
 
 signals:
-	/// @brief render() was called and rendering and the asynchronous buffer swap have finished.
-	void renderingFinished();
+	/// @brief Emitted when opacity or blend mode changed.
+	void layerChanged();
+
+public slots:
+	/// @brief Pass the current values to the script. They are used for all frames rendered afterwards.
+	/// Called whenever a value changes. The time is passed by the render thread, see RenderTick.
+	void updateScriptValues();
 
 private slots:
 	void setAutoCycleScripts(bool enable);
@@ -78,31 +92,41 @@ private slots:
     void scriptTextChanged();
     void updateScriptFromText();
 
-	void scriptCompiledOk();
-	void scriptHasErrors(const QString & errors);
+	void scriptCompiledOk(int deck);
+	void scriptHasErrors(int deck, const QString & errors);
 
 	void setScriptParameter(ParameterBool parameter, const QString & value);
 	void setScriptParameter(ParameterInt parameter, const QString & value);
 	void setScriptParameter(const QString & name, const QString & value);
-	void updateScriptValues();
-    void updateTime();
 
 private:
-	QRegExp m_commentExp;
+	/// @brief Set a value passed to the script and send all values to the render thread.
+	/// @param handle Uniform handle, see RenderThread::uniformHandle().
+	void setScriptValue(int handle, float value);
+
 	QRegExp m_errorExp;
 	QRegExp m_errorExp2;
 
     Ui::CodeDeck *ui;
     LiveView * m_liveView;
+	RenderThread * m_renderThread;
+	int m_deckIndex;
+	/// @brief Values passed to the script indexed by uniform handle.
+	QVector<float> m_scriptValues;
+	int m_valueAHandle;
+	int m_valueBHandle;
+	int m_valueCHandle;
+	int m_valueDHandle;
+	int m_triggerAHandle;
+	int m_triggerBHandle;
+	ScriptLibrary * m_scriptLibrary;
     CodeEdit * m_codeEdit;
     QTimer m_updateTimer;
-    QTime m_scriptTime;
 
     QString m_currentText;
 	bool m_scriptModified;
     QTimer m_editTimer;
     QString m_currentScriptPath;
-	QString m_scriptPath;
 
 	QTimer m_cycleTimer;
 
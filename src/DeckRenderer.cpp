@@ -0,0 +1,331 @@
+#include "DeckRenderer.h"
+#include "LiveView.h"
+
+#include <QOpenGLContext>
+#include <QMatrix4x4>
+#include <QVector2D>
+#include <QRegExp>
+#include <limits>
+#include <stdexcept>
+
+
+QVector<ScriptPass> DeckRenderer::splitPasses(const QString & script)
+{
+	QRegExp passExp("^//pass\\s+(\\w+)\\s*$");
+	const QStringList lines = script.split(QChar::LineFeed);
+	//find the lines passes start at. the main pass starts at the first line
+	QStringList names("");
+	QList<int> startLines;
+	startLines << 0;
+	for (int i = 0; i < lines.size(); ++i)
+	{
+		if (passExp.indexIn(lines.at(i)) >= 0)
+		{
+			const QString name = passExp.cap(1);
+			if (names.contains(name) || name == "previousFrame")
+			{
+				throw std::runtime_error(QString("ERROR: 0:%1: Buffer name \"%2\" is already used\n").arg(i + 1).arg(name).toStdString());
+			}
+			names << name;
+			startLines << i;
+		}
+	}
+	//scripts without passes are used as they are
+	QVector<ScriptPass> passes;
+	if (names.size() == 1)
+	{
+		ScriptPass pass;
+		pass.source = script;
+		passes.append(pass);
+		return passes;
+	}
+	if (names.size() - 1 > MaxBufferCount)
+	{
+		throw std::runtime_error(QString("ERROR: 0:%1: Too many buffers. A script can use at most %2\n").arg(startLines.last() + 1).arg(MaxBufferCount).toStdString());
+	}
+	startLines << lines.size();
+	//empty the lines of other passes, so line numbers in error messages match the script
+	for (int i = 0; i < names.size(); ++i)
+	{
+		QStringList passLines;
+		for (int j = 0; j < lines.size(); ++j)
+		{
+			passLines << (j >= startLines.at(i) && j < startLines.at(i + 1) ? lines.at(j) : QString());
+		}
+		ScriptPass pass;
+		pass.name = names.at(i);
+		pass.source = passLines.join(QChar::LineFeed);
+		passes.append(pass);
+	}
+	//render the main pass last
+	passes.append(passes.takeFirst());
+	return passes;
+}
+
+DeckRenderer::DeckRenderer(ShaderCache & shaderCache)
+	: m_shaderCache(shaderCache)
+	, m_frameBufferIndex(0)
+{
+	for (int i = 0; i < FrameBufferCount; ++i)
+	{
+		m_frameBuffers[i] = nullptr;
+	}
+	//check which OpenGL backend we're using and switch shader prefixes accordingly
+	QOpenGLContext * context = QOpenGLContext::currentContext();
+	m_vertexPrefix = context->isOpenGLES() ? LiveView::m_vertexPrefixGLES2 : LiveView::m_vertexPrefixGL2;
+	m_fragmentPrefix = context->isOpenGLES() ? LiveView::m_fragmentPrefixGLES2 : LiveView::m_fragmentPrefixGL2;
+	m_functions.initializeOpenGLFunctions();
+}
+
+DeckRenderer::~DeckRenderer()
+{
+	releasePasses(m_passes);
+	for (auto buffer : m_buffers)
+	{
+		delete buffer.frameBuffers[0];
+		delete buffer.frameBuffers[1];
+	}
+	for (int i = 0; i < FrameBufferCount; ++i)
+	{
+		delete m_frameBuffers[i];
+	}
+}
+
+void DeckRenderer::releasePasses(QVector<Pass> & passes)
+{
+	//programs are kept in the cache, so switching back to them is fast
+	for (auto pass : passes)
+	{
+		m_shaderCache.release(pass.program);
+	}
+	passes.clear();
+}
+
+void DeckRenderer::setScript(const QString & script)
+{
+	//this throws if the passes are invalid
+	const QVector<ScriptPass> scriptPasses = splitPasses(script);
+	QVector<Pass> passes;
+	try
+	{
+		for (auto scriptPass : scriptPasses)
+		{
+			Pass pass;
+			pass.name = scriptPass.name;
+			//this throws if the pass fails to compile
+			pass.program = m_shaderCache.acquire(m_vertexPrefix + LiveView::m_defaultVertexCode, m_fragmentPrefix + scriptPass.source);
+			passes.append(pass);
+		}
+	}
+	catch (std::runtime_error e)
+	{
+		releasePasses(passes);
+		throw;
+	}
+	//keep buffers with the same names, so their content is kept
+	QVector<Buffer> buffers;
+	for (int i = 0; i < passes.size() - 1; ++i)
+	{
+		Buffer buffer;
+		buffer.name = passes.at(i).name;
+		buffer.frameBuffers[0] = nullptr;
+		buffer.frameBuffers[1] = nullptr;
+		buffer.index = 0;
+		for (int j = 0; j < m_buffers.size(); ++j)
+		{
+			if (m_buffers.at(j).name == buffer.name)
+			{
+				buffer = m_buffers.takeAt(j);
+				break;
+			}
+		}
+		buffers.append(buffer);
+	}
+	for (auto buffer : m_buffers)
+	{
+		delete buffer.frameBuffers[0];
+		delete buffer.frameBuffers[1];
+	}
+	m_buffers = buffers;
+	//replace old passes
+	releasePasses(m_passes);
+	m_passes = passes;
+	//look up locations once. uniforms of the new programs are 0 or hold values from when they were used before, so everything must be uploaded again
+	for (int i = 0; i < m_passes.size(); ++i)
+	{
+		Pass & pass = m_passes[i];
+		pass.positionLocation = pass.program->attributeLocation("position");
+		pass.texcoord0Location = pass.program->attributeLocation("texcoord0");
+		pass.projectionMatrixLocation = pass.program->uniformLocation("projectionMatrix");
+		pass.renderSizeLocation = pass.program->uniformLocation("renderSize");
+		pass.usesSamplers = false;
+		pass.samplersUploaded = false;
+		for (auto buffer : m_buffers)
+		{
+			pass.samplerLocations.append(pass.program->uniformLocation(buffer.name));
+		}
+		pass.samplerLocations.append(pass.program->uniformLocation("previousFrame"));
+		for (auto location : pass.samplerLocations)
+		{
+			pass.usesSamplers = pass.usesSamplers || location >= 0;
+		}
+	}
+	resolveUniforms();
+}
+
+void DeckRenderer::setValues(const QStringList & names, const QVector<float> & values)
+{
+	m_uniformNames = names;
+	m_values = values;
+	resolveUniforms();
+}
+
+void DeckRenderer::resolveUniforms()
+{
+	for (int i = 0; i < m_passes.size(); ++i)
+	{
+		Pass & pass = m_passes[i];
+		for (int j = pass.uniformLocations.size(); j < m_uniformNames.size(); ++j)
+		{
+			pass.uniformLocations.append(pass.program->uniformLocation(m_uniformNames.at(j)));
+			pass.uploadedValues.append(std::numeric_limits<float>::quiet_NaN());
+		}
+	}
+}
+
+void DeckRenderer::render(const QSize & size)
+{
+	if (m_passes.isEmpty() || size.isEmpty())
+	{
+		return;
+	}
+	//the output of the last frame can be read by all passes
+	const QOpenGLFramebufferObject * previousFrameBuffer = m_frameBuffers[m_frameBufferIndex];
+	const GLuint previousFrame = previousFrameBuffer && previousFrameBuffer->size() == size ? previousFrameBuffer->texture() : 0;
+	//render buffer passes
+	for (int i = 0; i < m_buffers.size(); ++i)
+	{
+		Buffer & buffer = m_buffers[i];
+		if (!buffer.frameBuffers[0] || buffer.frameBuffers[0]->size() != size)
+		{
+			//(re)allocate both framebuffers and clear them, so the pass reads black from the last frame
+			for (int j = 0; j < 2; ++j)
+			{
+				delete buffer.frameBuffers[j];
+				buffer.frameBuffers[j] = new QOpenGLFramebufferObject(size);
+				buffer.frameBuffers[j]->bind();
+				m_functions.glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+				m_functions.glClear(GL_COLOR_BUFFER_BIT);
+				buffer.frameBuffers[j]->release();
+			}
+		}
+		//render into the framebuffer not holding the last frame. the buffers are swapped, not copied
+		const int nextIndex = (buffer.index + 1) % 2;
+		renderPass(m_passes[i], buffer.frameBuffers[nextIndex], size, previousFrame);
+		buffer.index = nextIndex;
+	}
+	//(re)allocate next framebuffer
+	m_frameBufferIndex = (m_frameBufferIndex + 1) % FrameBufferCount;
+	QOpenGLFramebufferObject *& frameBuffer = m_frameBuffers[m_frameBufferIndex];
+	if (!frameBuffer || frameBuffer->size() != size)
+	{
+		delete frameBuffer;
+		QOpenGLFramebufferObjectFormat format;
+		format.setAttachment(QOpenGLFramebufferObject::CombinedDepthStencil);
+		frameBuffer = new QOpenGLFramebufferObject(size, format);
+	}
+	//render main pass
+	renderPass(m_passes.last(), frameBuffer, size, previousFrame);
+}
+
+void DeckRenderer::renderPass(Pass & pass, QOpenGLFramebufferObject * frameBuffer, const QSize & size, GLuint previousFrame)
+{
+	frameBuffer->bind();
+	m_functions.glViewport(0, 0, size.width(), size.height());
+	m_functions.glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+	m_functions.glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	pass.program->bind();
+	//the projection only changes with the size
+	if (pass.uploadedSize != size)
+	{
+		//setup orthographic projection matrix keeping the aspect ratio
+		const float aspect = (float)size.width() / (float)size.height();
+		QMatrix4x4 projectionMatrix;
+		if (aspect >= 1.0f)
+		{
+			projectionMatrix.ortho(-0.5f, 0.5f, -0.5f * aspect, 0.5f * aspect, 0.0f, 10.0f);
+		}
+		else
+		{
+			projectionMatrix.ortho(-0.5f, 0.5f, -0.5f / aspect, 0.5f / aspect, 0.0f, 10.0f);
+		}
+		pass.program->setUniformValue(pass.projectionMatrixLocation, projectionMatrix);
+		pass.program->setUniformValue(pass.renderSizeLocation, QVector2D(size.width(), size.height()));
+		pass.uploadedSize = size;
+	}
+	//upload changed values only. uniforms keep their values in the program between frames
+	const int count = qMin(m_values.size(), pass.uniformLocations.size());
+	for (int i = 0; i < count; ++i)
+	{
+		const float value = m_values.at(i);
+		if (pass.uniformLocations.at(i) >= 0 && !(value == pass.uploadedValues.at(i)))
+		{
+			m_functions.glUniform1f(pass.uniformLocations.at(i), value);
+			pass.uploadedValues[i] = value;
+		}
+	}
+	//bind the latest content of the buffers and the previous frame to texture units in that order
+	if (pass.usesSamplers)
+	{
+		for (int i = 0; i < m_buffers.size(); ++i)
+		{
+			const QOpenGLFramebufferObject * buffer = m_buffers.at(i).frameBuffers[m_buffers.at(i).index];
+			m_functions.glActiveTexture(GL_TEXTURE0 + i);
+			m_functions.glBindTexture(GL_TEXTURE_2D, buffer ? buffer->texture() : 0);
+		}
+		m_functions.glActiveTexture(GL_TEXTURE0 + m_buffers.size());
+		m_functions.glBindTexture(GL_TEXTURE_2D, previousFrame);
+		//texture units never change, so they are uploaded once
+		if (!pass.samplersUploaded)
+		{
+			for (int i = 0; i < pass.samplerLocations.size(); ++i)
+			{
+				if (pass.samplerLocations.at(i) >= 0)
+				{
+					m_functions.glUniform1i(pass.samplerLocations.at(i), i);
+				}
+			}
+			pass.samplersUploaded = true;
+		}
+	}
+	//render screen-sized quad
+	m_functions.glEnableVertexAttribArray(pass.positionLocation);
+	m_functions.glEnableVertexAttribArray(pass.texcoord0Location);
+	m_functions.glVertexAttribPointer(pass.positionLocation, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), &LiveView::m_quadData[0]);
+	m_functions.glVertexAttribPointer(pass.texcoord0Location, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), &LiveView::m_quadData[3]);
+	m_functions.glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+	m_functions.glDisableVertexAttribArray(pass.positionLocation);
+	m_functions.glDisableVertexAttribArray(pass.texcoord0Location);
+	if (pass.usesSamplers)
+	{
+		for (int i = m_buffers.size(); i >= 0; --i)
+		{
+			m_functions.glActiveTexture(GL_TEXTURE0 + i);
+			m_functions.glBindTexture(GL_TEXTURE_2D, 0);
+		}
+	}
+	pass.program->release();
+	frameBuffer->release();
+}
+
+GLuint DeckRenderer::texture() const
+{
+	const QOpenGLFramebufferObject * frameBuffer = m_frameBuffers[m_frameBufferIndex];
+	return frameBuffer ? frameBuffer->texture() : 0;
+}
+
+QSize DeckRenderer::size() const
+{
+	const QOpenGLFramebufferObject * frameBuffer = m_frameBuffers[m_frameBufferIndex];
+	return frameBuffer ? frameBuffer->size() : QSize();
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include "ShaderCache.h"
+
+#include <QSize>
+#include <QVector>
+#include <QStringList>
+#include <QOpenGLFunctions>
+#include <QOpenGLShaderProgram>
+#include <QOpenGLFramebufferObject>
+
+
+/// @brief Pass of a script, see DeckRenderer::splitPasses().
+struct ScriptPass
+{
+	/// @brief Name of the buffer the pass renders to. Empty for the main pass rendering the output of the deck.
+	QString name;
+	/// @brief Fragment shader source of the pass. Lines of other passes are empty, so line numbers match the script.
+	QString source;
+};
+
+/// @brief Renders the script of a deck into a framebuffer object. Scripts are rendered exactly like LiveView used to.
+/// Scripts can render extra passes into persistent buffers before the main pass, see splitPasses(). All passes can read all buffers
+/// and the previous output of the deck as "uniform sampler2D previousFrame", so effects can build on the last frame instead of
+/// computing everything again. Buffers have the render size and are double-buffered, so a pass reads its own buffer from the last frame.
+/// Does not own an OpenGL context. It is created, used and destroyed by RenderThread with its context current.
+class DeckRenderer
+{
+public:
+	/// @brief Maximum number of buffers a script can render to. Buffers and the previous frame each need a texture unit.
+	static const int MaxBufferCount = 7;
+
+	/// @brief Split a script into passes. A line "//pass name" starts a pass rendering into the buffer "name", which all passes
+	/// can read as "uniform sampler2D name". The text before the first such line is the main pass. Buffer passes are rendered in
+	/// the order they appear and the main pass is rendered last, so the main pass is the last element.
+	/// A pass reads buffers rendered before it in the same frame and all others, including its own, from the last frame.
+	/// @throw std::runtime_error if buffer names are used twice, are reserved or if there are too many buffers.
+	static QVector<ScriptPass> splitPasses(const QString & script);
+
+	/// @brief Create renderer.
+	/// @param shaderCache Cache programs are taken from. Must exist longer than the renderer.
+	DeckRenderer(ShaderCache & shaderCache);
+	~DeckRenderer();
+
+	/// @brief Compile a script, actually a fragment shader, or take it from the shader cache if it was used before.
+	/// The current script is kept if compilation fails.
+	/// Buffers are kept if the new script has passes with the same names, so editing a script does not reset its state.
+	/// @throw std::runtime_error with the error log if the script fails to compile or its passes are invalid.
+	void setScript(const QString & script);
+
+	/// @brief Set the uniform values passed to the script, e.g. "time" or "valueA".
+	/// Uniforms are addressed by handle, see RenderThread::uniformHandle(). Their locations are looked up once per script
+	/// and only values that changed since the last frame are uploaded.
+	/// @param names Uniform names. The index of a name is its handle. Names are only ever appended.
+	/// @param values Uniform values indexed by handle. May be shorter than names.
+	void setValues(const QStringList & names, const QVector<float> & values);
+
+	/// @brief Render the script. Framebuffers are rendered to in turn, so the texture of the previous frame
+	/// can still be displayed while the next frame is rendered.
+	/// @param size Size to render in.
+	void render(const QSize & size);
+
+	/// @brief Get the texture of the last frame rendered. 0 if nothing was rendered yet.
+	GLuint texture() const;
+	/// @brief Get the size of the last frame rendered.
+	QSize size() const;
+
+private:
+	/// @brief Program of a pass and the state uploaded to it.
+	struct Pass
+	{
+		/// @brief Name of the buffer the pass renders to. Empty for the main pass.
+		QString name;
+		QOpenGLShaderProgram * program;
+		int positionLocation;
+		int texcoord0Location;
+		int projectionMatrixLocation;
+		int renderSizeLocation;
+		/// @brief Size projectionMatrix and renderSize were uploaded for.
+		QSize uploadedSize;
+		/// @brief Uniform locations in the program indexed by handle. -1 if the program does not use the uniform.
+		QVector<int> uniformLocations;
+		/// @brief Values uploaded to the program. NaN if nothing was uploaded yet, so the value is always uploaded.
+		QVector<float> uploadedValues;
+		/// @brief Sampler locations of the buffers followed by previousFrame. -1 if the program does not use the sampler.
+		QVector<int> samplerLocations;
+		/// @brief True if the program uses any sampler, so textures need to be bound.
+		bool usesSamplers;
+		/// @brief True if the texture units have been uploaded to the samplers.
+		bool samplersUploaded;
+	};
+
+	/// @brief Persistent buffer a pass renders to. Rendered to in turn, so the last frame can be read while rendering.
+	struct Buffer
+	{
+		QString name;
+		QOpenGLFramebufferObject * frameBuffers[2];
+		/// @brief Index of the framebuffer rendered to last.
+		int index;
+	};
+
+	/// @brief Look up the locations of uniforms not resolved for the current passes yet.
+	void resolveUniforms();
+	/// @brief Render a pass into a framebuffer.
+	/// @param previousFrame Texture of the previous output of the deck. 0 if there is none.
+	void renderPass(Pass & pass, QOpenGLFramebufferObject * frameBuffer, const QSize & size, GLuint previousFrame);
+	/// @brief Release the programs of the passes to the shader cache.
+	void releasePasses(QVector<Pass> & passes);
+
+	/// @brief Number of framebuffers rendered to in turn.
+	static const int FrameBufferCount = 2;
+
+	QOpenGLFunctions m_functions;
+	ShaderCache & m_shaderCache;
+	QString m_vertexPrefix;
+	QString m_fragmentPrefix;
+	/// @brief Passes of the current script. Buffer passes in the order they are rendered, followed by the main pass.
+	QVector<Pass> m_passes;
+	/// @brief Buffers of the current script in the order of the passes rendering to them.
+	QVector<Buffer> m_buffers;
+	QStringList m_uniformNames;
+	QVector<float> m_values;
+	/// @brief Framebuffers the main pass renders to. They are kept when the script changes, so the last frame can still be displayed.
+	QOpenGLFramebufferObject * m_frameBuffers[FrameBufferCount];
+	/// @brief Index of the framebuffer rendered to last.
+	int m_frameBufferIndex;
+};
@@ -0,0 +1,533 @@
+#include "DisplayEncoder.h"
+
+#include <cstring>
+
+
+namespace
+{
+	inline bool sameColor(const unsigned char * a, const unsigned char * b)
+	{
+		return a[0] == b[0] && a[1] == b[1] && a[2] == b[2];
+	}
+
+	/// @brief Write compressed protocol commands for LED data.
+	/// @param current LED data of the current frame, 3 bytes per LED.
+	/// @param previous LED data of the previous frame or NULL for a key frame.
+	/// @param count Number of LEDs.
+	/// @param out Output buffer. Must hold at least 4 bytes per LED.
+	/// @return Number of bytes written to out.
+	int writeCommands(const unsigned char * current, const unsigned char * previous, int count, unsigned char * out)
+	{
+		unsigned char * start = out;
+		int i = 0;
+		while (i < count)
+		{
+			//skip LEDs that did not change since the previous frame
+			if (previous)
+			{
+				int skip = 0;
+				while (i + skip < count && skip < 16384 && sameColor(current + 3 * (i + skip), previous + 3 * (i + skip)))
+				{
+					++skip;
+				}
+				if (skip > 0)
+				{
+					*out++ = 0xC0 | ((skip - 1) >> 8);
+					*out++ = (skip - 1) & 0xFF;
+					i += skip;
+					continue;
+				}
+			}
+			//check for a run of identical colors
+			const unsigned char * color = current + 3 * i;
+			int run = 1;
+			while (i + run < count && run < 64 && sameColor(current + 3 * (i + run), color))
+			{
+				++run;
+			}
+			if (run > 1)
+			{
+				*out++ = 0x80 | (run - 1);
+				*out++ = color[0];
+				*out++ = color[1];
+				*out++ = color[2];
+				i += run;
+				continue;
+			}
+			//collect literal LEDs until a run or an unchanged LED starts
+			int literal = 1;
+			while (i + literal < count && literal < 128)
+			{
+				const unsigned char * next = current + 3 * (i + literal);
+				if ((i + literal + 1 < count && sameColor(next, next + 3)) || (previous && sameColor(next, previous + 3 * (i + literal))))
+				{
+					break;
+				}
+				++literal;
+			}
+			*out++ = literal - 1;
+			memcpy(out, color, 3 * literal);
+			out += 3 * literal;
+			i += literal;
+		}
+		return out - start;
+	}
+}
+
+
+DisplayEncoder::DisplayEncoder()
+	: m_width(0)
+	, m_height(0)
+	, m_flipHorizontal(false)
+	, m_flipVertical(false)
+	, m_direction(ConstantLeftToRight)
+	, m_stripOrder(false)
+	, m_firstLed(0)
+	, m_rangeCount(-1)
+	, m_colorOrder(OrderGRB)
+	, m_layoutChanged(true)
+	, m_sourceWidth(0)
+	, m_sourceHeight(0)
+	, m_sourceStride(0)
+	, m_averaging(false)
+	, m_compression(false)
+	, m_keyFrameInterval(50)
+	, m_framesSinceKeyFrame(0)
+	, m_keyFrameForced(true)
+{
+}
+
+void DisplayEncoder::setLayout(int width, int height, bool flipHorizontal, bool flipVertical, ScanlineDirection direction)
+{
+	if (m_stripOrder || m_width != width || m_height != height || m_flipHorizontal != flipHorizontal || m_flipVertical != flipVertical || m_direction != direction)
+	{
+		m_stripOrder = false;
+		m_width = width;
+		m_height = height;
+		m_flipHorizontal = flipHorizontal;
+		m_flipVertical = flipVertical;
+		m_direction = direction;
+		m_layoutChanged = true;
+	}
+}
+
+void DisplayEncoder::setStripLayout(int ledCount)
+{
+	if (!m_stripOrder || m_width != ledCount || m_height != 1)
+	{
+		m_stripOrder = true;
+		m_width = ledCount;
+		m_height = 1;
+		m_flipHorizontal = false;
+		m_flipVertical = false;
+		m_layoutChanged = true;
+	}
+}
+
+void DisplayEncoder::setRange(int firstLed, int count)
+{
+	if (m_firstLed != firstLed || m_rangeCount != count)
+	{
+		m_firstLed = firstLed > 0 ? firstLed : 0;
+		m_rangeCount = count;
+		m_layoutChanged = true;
+	}
+}
+
+int DisplayEncoder::ledCount() const
+{
+	const int total = m_width > 0 && m_height > 0 ? m_width * m_height : 0;
+	const int available = total > m_firstLed ? total - m_firstLed : 0;
+	return (m_rangeCount >= 0 && m_rangeCount < available) ? m_rangeCount : available;
+}
+
+void DisplayEncoder::setColorOrder(ColorOrder order)
+{
+	m_colorOrder = order;
+}
+
+const unsigned char * DisplayEncoder::ledData() const
+{
+	return reinterpret_cast<const unsigned char *>(m_packet.constData()) + 6;
+}
+
+void DisplayEncoder::setHighDepthData(const QVector<quint16> & data)
+{
+	m_highDepthData = data;
+}
+
+void DisplayEncoder::setCalibration(ColorCalibration::SPtr calibration)
+{
+	//skip calibration completely if it doesn't change anything
+	m_calibration = calibration && !calibration->isIdentity() ? calibration : nullptr;
+}
+
+void DisplayEncoder::setCompression(bool enabled, int keyFrameInterval)
+{
+	if (enabled && !m_compression)
+	{
+		m_keyFrameForced = true;
+	}
+	m_compression = enabled;
+	m_keyFrameInterval = keyFrameInterval > 1 ? keyFrameInterval : 1;
+}
+
+void DisplayEncoder::forceKeyFrame()
+{
+	m_keyFrameForced = true;
+}
+
+void DisplayEncoder::writeHeader()
+{
+	//set up display parameters
+	const unsigned int count = ledCount();
+	const unsigned char hi = (count >> 8) & 0xFF;
+	const unsigned char lo = count & 0xFF;
+	const unsigned char checksum = hi ^ lo ^ 0x55;
+	//allocate packet and store display parameters in it. the LED data follows the header
+	m_packet.resize(6 + 3 * count);
+	char * header = m_packet.data();
+	header[0] = 'A';
+	header[1] = 'd';
+	header[2] = 'a';
+	header[3] = hi;
+	header[4] = lo;
+	header[5] = checksum;
+}
+
+void DisplayEncoder::buildIndexMap(int sourceWidth, int sourceHeight, int sourceStride)
+{
+	m_sourceWidth = sourceWidth;
+	m_sourceHeight = sourceHeight;
+	m_sourceStride = sourceStride;
+	const int count = ledCount();
+	m_indexMap.resize(count);
+	m_footprints.resize(count);
+	m_averaging = false;
+	if (m_stripOrder)
+	{
+		//LEDs are in the first line of the image already
+		for (int led = 0; led < count; ++led)
+		{
+			mapPixel(led, m_firstLed + led, 0);
+		}
+	}
+	else
+	{
+		//get initial scan line direction. the whole strip is walked, but only LEDs in the range are stored
+		bool leftToRight = (m_direction == ConstantRightToLeft) || (m_direction == AlternatingStartRight);
+		const int rangeEnd = m_firstLed + count;
+		int stripIndex = 0;
+		int led = 0;
+		for (int y = 0; y < m_height && stripIndex < rangeEnd; ++y)
+		{
+			//apply vertical flipping
+			const int displayY = m_flipVertical ? m_height - 1 - y : y;
+			for (int i = 0; i < m_width; ++i, ++stripIndex)
+			{
+				if (stripIndex < m_firstLed || stripIndex >= rangeEnd)
+				{
+					continue;
+				}
+				//apply scanline direction and horizontal flipping
+				const int x = leftToRight ? i : m_width - 1 - i;
+				const int displayX = m_flipHorizontal ? m_width - 1 - x : x;
+				mapPixel(led++, displayX, displayY);
+			}
+			//if we have alternating lines, flip direction after every line
+			if ((m_direction == AlternatingStartLeft) || (m_direction == AlternatingStartRight))
+			{
+				leftToRight = !leftToRight;
+			}
+		}
+	}
+	//averaged colors are gathered in strip order
+	if (m_averaging)
+	{
+		m_averaged.resize(count);
+		m_averagedHighDepth.resize(3 * count);
+	}
+	else
+	{
+		m_averaged.clear();
+		m_averagedHighDepth.clear();
+	}
+	m_ditherError.fill(0, 3 * count);
+	writeHeader();
+	m_layoutChanged = false;
+}
+
+void DisplayEncoder::mapPixel(int led, int displayX, int displayY)
+{
+	//find the source pixels covered by the LED. if it covers less than two pixels, use the nearest one
+	int x0 = ((qint64)displayX * m_sourceWidth) / m_width;
+	int x1 = ((qint64)(displayX + 1) * m_sourceWidth) / m_width;
+	if (x1 - x0 < 2)
+	{
+		x0 = ((2 * (qint64)displayX + 1) * m_sourceWidth) / (2 * m_width);
+		x1 = x0 + 1;
+	}
+	int y0 = 0;
+	int y1 = 1;
+	if (!m_stripOrder)
+	{
+		y0 = ((qint64)displayY * m_sourceHeight) / m_height;
+		y1 = ((qint64)(displayY + 1) * m_sourceHeight) / m_height;
+		if (y1 - y0 < 2)
+		{
+			y0 = ((2 * (qint64)displayY + 1) * m_sourceHeight) / (2 * m_height);
+			y1 = y0 + 1;
+		}
+	}
+	m_indexMap[led] = y0 * m_sourceStride + x0;
+	m_footprints[led].width = x1 - x0;
+	m_footprints[led].height = y1 - y0;
+	m_averaging = m_averaging || x1 - x0 > 1 || y1 - y0 > 1;
+}
+
+void DisplayEncoder::average(const QRgb * pixels)
+{
+	const int * index = m_indexMap.constData();
+	const Footprint * footprint = m_footprints.constData();
+	const int count = m_indexMap.size();
+	QRgb * out = m_averaged.data();
+	for (int i = 0; i < count; ++i)
+	{
+		const int width = footprint[i].width;
+		const int height = footprint[i].height;
+		const unsigned int area = width * height;
+		unsigned int r = 0;
+		unsigned int g = 0;
+		unsigned int b = 0;
+		const QRgb * line = pixels + index[i];
+		for (int y = 0; y < height; ++y, line += m_sourceStride)
+		{
+			for (int x = 0; x < width; ++x)
+			{
+				r += qRed(line[x]);
+				g += qGreen(line[x]);
+				b += qBlue(line[x]);
+			}
+		}
+		out[i] = qRgb((r + area / 2) / area, (g + area / 2) / area, (b + area / 2) / area);
+	}
+}
+
+void DisplayEncoder::averageHighDepth(const quint16 * highDepth)
+{
+	const int * index = m_indexMap.constData();
+	const Footprint * footprint = m_footprints.constData();
+	const int count = m_indexMap.size();
+	const int stride = 3 * m_sourceStride;
+	quint16 * out = m_averagedHighDepth.data();
+	for (int i = 0; i < count; ++i, out += 3)
+	{
+		const int width = footprint[i].width;
+		const int height = footprint[i].height;
+		const quint64 area = width * height;
+		quint64 sum[3] = {0, 0, 0};
+		const quint16 * line = highDepth + 3 * index[i];
+		for (int y = 0; y < height; ++y, line += stride)
+		{
+			for (int x = 0; x < 3 * width; x += 3)
+			{
+				sum[0] += line[x];
+				sum[1] += line[x + 1];
+				sum[2] += line[x + 2];
+			}
+		}
+		out[0] = (sum[0] + area / 2) / area;
+		out[1] = (sum[1] + area / 2) / area;
+		out[2] = (sum[2] + area / 2) / area;
+	}
+}
+
+const QByteArray & DisplayEncoder::encode(const QImage & image)
+{
+	if (image.isNull() || ledCount() <= 0)
+	{
+		return m_empty;
+	}
+	//convert image to a 32bit format if necessary. this is the only place that might allocate memory
+	QImage converted;
+	const QImage * source = &image;
+	if (image.format() != QImage::Format_ARGB32
+		&& image.format() != QImage::Format_ARGB32_Premultiplied
+		&& image.format() != QImage::Format_RGB32)
+	{
+		converted = image.convertToFormat(QImage::Format_ARGB32);
+		source = &converted;
+	}
+	//rebuild index map if layout or image geometry changed
+	const int stride = source->bytesPerLine() / 4;
+	if (m_layoutChanged || source->width() != m_sourceWidth || source->height() != m_sourceHeight || stride != m_sourceStride)
+	{
+		buildIndexMap(source->width(), source->height(), stride);
+	}
+	//gather pixels in strip order into packet. if LEDs cover multiple pixels, they are averaged first
+	const QRgb * pixels = reinterpret_cast<const QRgb *>(source->constBits());
+	const int * index = m_indexMap.constData();
+	if (m_highDepthData.size() == 3 * stride * source->height())
+	{
+		if (m_averaging)
+		{
+			averageHighDepth(m_highDepthData.constData());
+			gatherDithered<true>(m_averagedHighDepth.constData(), index);
+		}
+		else
+		{
+			gatherDithered<false>(m_highDepthData.constData(), index);
+		}
+	}
+	else if (m_averaging)
+	{
+		average(pixels);
+		gather<true>(m_averaged.constData(), index);
+	}
+	else
+	{
+		gather<false>(pixels, index);
+	}
+	return m_compression ? compress() : m_packet;
+}
+
+template <bool CONTIGUOUS>
+void DisplayEncoder::gather(const QRgb * pixels, const int * index)
+{
+	if (m_calibration)
+	{
+		gatherCalibrated<CONTIGUOUS>(pixels, index);
+		return;
+	}
+	const int count = m_indexMap.size();
+	unsigned char * data = reinterpret_cast<unsigned char *>(m_packet.data()) + 6;
+	if (m_colorOrder == OrderRGB)
+	{
+		for (int i = 0; i < count; ++i, data += 3)
+		{
+			const QRgb pixel = pixels[CONTIGUOUS ? i : index[i]];
+			data[0] = qRed(pixel);
+			data[1] = qGreen(pixel);
+			data[2] = qBlue(pixel);
+		}
+	}
+	else
+	{
+		for (int i = 0; i < count; ++i, data += 3)
+		{
+			const QRgb pixel = pixels[CONTIGUOUS ? i : index[i]];
+			data[0] = qGreen(pixel);
+			data[1] = qRed(pixel);
+			data[2] = qBlue(pixel);
+		}
+	}
+}
+
+template <bool CONTIGUOUS>
+void DisplayEncoder::gatherCalibrated(const QRgb * pixels, const int * index)
+{
+	const int count = m_indexMap.size();
+	unsigned char * data = reinterpret_cast<unsigned char *>(m_packet.data()) + 6;
+	//position of red, green and blue in the packet
+	const int redOffset = m_colorOrder == OrderRGB ? 0 : 1;
+	const int greenOffset = m_colorOrder == OrderRGB ? 1 : 0;
+	const int round = 1 << (ColorCalibration::FixedShift - 1);
+	for (int i = 0; i < count; ++i, data += 3)
+	{
+		const QRgb pixel = pixels[CONTIGUOUS ? i : index[i]];
+		const int r = qRed(pixel);
+		const int g = qGreen(pixel);
+		const int b = qBlue(pixel);
+		const int * m = m_calibration->matrix(i);
+		data[redOffset] = qBound(0, (m[0] * r + m[1] * g + m[2] * b + round) >> ColorCalibration::FixedShift, 255);
+		data[greenOffset] = qBound(0, (m[3] * r + m[4] * g + m[5] * b + round) >> ColorCalibration::FixedShift, 255);
+		data[2] = qBound(0, (m[6] * r + m[7] * g + m[8] * b + round) >> ColorCalibration::FixedShift, 255);
+	}
+}
+
+template <bool CONTIGUOUS>
+void DisplayEncoder::gatherDithered(const quint16 * highDepth, const int * index)
+{
+	const int count = m_indexMap.size();
+	short * error = m_ditherError.data();
+	unsigned char * data = reinterpret_cast<unsigned char *>(m_packet.data()) + 6;
+	//position of red, green and blue in the packet
+	const int redOffset = m_colorOrder == OrderRGB ? 0 : 1;
+	const int greenOffset = m_colorOrder == OrderRGB ? 1 : 0;
+	const qint64 round = 1 << (ColorCalibration::FixedShift - 1);
+	int color[3];
+	for (int i = 0; i < count; ++i, data += 3, error += 3)
+	{
+		const quint16 * source = highDepth + 3 * (CONTIGUOUS ? i : index[i]);
+		if (m_calibration)
+		{
+			//16bit values times the matrix may not fit into 32bit
+			const int * m = m_calibration->matrix(i);
+			color[0] = qBound((qint64)0, (m[0] * (qint64)source[0] + m[1] * (qint64)source[1] + m[2] * (qint64)source[2] + round) >> ColorCalibration::FixedShift, (qint64)65535);
+			color[1] = qBound((qint64)0, (m[3] * (qint64)source[0] + m[4] * (qint64)source[1] + m[5] * (qint64)source[2] + round) >> ColorCalibration::FixedShift, (qint64)65535);
+			color[2] = qBound((qint64)0, (m[6] * (qint64)source[0] + m[7] * (qint64)source[1] + m[8] * (qint64)source[2] + round) >> ColorCalibration::FixedShift, (qint64)65535);
+		}
+		else
+		{
+			color[0] = source[0];
+			color[1] = source[1];
+			color[2] = source[2];
+		}
+		for (int c = 0; c < 3; ++c)
+		{
+			//add the error of the last frame, round to 8bit (65535 / 255 = 257) and keep the new error.
+			//the error is limited, so it does not build up when the value is clipped at 0 or 255
+			const int value = color[c] + error[c];
+			const int out = qBound(0, (value + 128) / 257, 255);
+			error[c] = qBound(-257, value - out * 257, 257);
+			data[c == 0 ? redOffset : (c == 1 ? greenOffset : 2)] = out;
+		}
+	}
+}
+
+const QByteArray & DisplayEncoder::compress()
+{
+	const int count = ledCount();
+	const unsigned char * current = reinterpret_cast<const unsigned char *>(m_packet.constData()) + 6;
+	const bool keyFrame = m_keyFrameForced || m_previousFrame.size() != 3 * count || m_framesSinceKeyFrame >= m_keyFrameInterval;
+	//make sure the packet can hold the worst case of 4 bytes per LED. this only allocates if the size grows
+	m_compressedPacket.resize(10 + 4 * count);
+	unsigned char * packet = reinterpret_cast<unsigned char *>(m_compressedPacket.data());
+	const int payloadSize = writeCommands(current, keyFrame ? nullptr : reinterpret_cast<const unsigned char *>(m_previousFrame.constData()), count, packet + 9);
+	//store current frame as reference for the next delta frame
+	if (m_previousFrame.size() != 3 * count)
+	{
+		m_previousFrame.resize(3 * count);
+	}
+	memcpy(m_previousFrame.data(), current, 3 * count);
+	//if compression doesn't help, send a regular packet, which is also a key frame
+	if (payloadSize + 10 >= m_packet.size() || payloadSize > 0xFFFF)
+	{
+		m_keyFrameForced = false;
+		m_framesSinceKeyFrame = 0;
+		return m_packet;
+	}
+	//copy LED count and checksum from regular header and add frame type and payload size
+	memcpy(packet, m_packet.constData(), 6);
+	packet[2] = 'z';
+	packet[6] = keyFrame ? 'K' : 'D';
+	packet[7] = (payloadSize >> 8) & 0xFF;
+	packet[8] = payloadSize & 0xFF;
+	unsigned char checksum = 0;
+	for (int i = 0; i < payloadSize; ++i)
+	{
+		checksum += packet[9 + i];
+	}
+	packet[9 + payloadSize] = checksum;
+	m_compressedPacket.resize(10 + payloadSize);
+	if (keyFrame)
+	{
+		m_keyFrameForced = false;
+		m_framesSinceKeyFrame = 0;
+	}
+	else
+	{
+		++m_framesSinceKeyFrame;
+	}
+	return m_compressedPacket;
+}
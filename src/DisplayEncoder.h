@@ -0,0 +1,146 @@
+#pragma once
+
+#include "ParameterScanlineDirection.h"
+#include "ColorCalibration.h"
+
+#include <QImage>
+#include <QByteArray>
+#include <QVector>
+
+
+/// @brief Converts display images to Adalight packets.
+/// The order in which pixels are sent to the LEDs is stored in an index map that is only rebuilt
+/// when the display layout or the source image geometry changes. Encoding a frame is then a single
+/// linear gather pass into a preallocated packet buffer that does not allocate memory.
+///
+/// Optionally frames can be sent using a compressed protocol. A compressed packet is:
+/// "Adz" + LED count high byte + low byte + checksum (high ^ low ^ 0x55), like an Adalight header,
+/// followed by the frame type ('K' = key frame, 'D' = delta frame), the payload size high and low byte,
+/// the payload and a payload checksum (all payload bytes summed up modulo 256).
+/// The payload is a list of commands applied to the LEDs starting at LED 0:
+/// 0x00-0x7F: Literal. (command + 1) LEDs with 3 bytes each follow.
+/// 0x80-0xBF: Run. Set (command - 0x80 + 1) LEDs to the 3 bytes that follow.
+/// 0xC0-0xFF: Skip. Leave (((command - 0xC0) << 8 | next byte) + 1) LEDs unchanged.
+/// Key frames clear all LEDs to black before applying the payload, delta frames change the LEDs of the last frame.
+/// If compression does not make a frame smaller, a regular "Ada" packet is sent instead, which is also a key frame.
+class DisplayEncoder
+{
+public:
+	/// @brief Order of the color components of an LED in the packet.
+	enum ColorOrder { OrderGRB, OrderRGB };
+
+	DisplayEncoder();
+
+	/// @brief Set up the display layout. The LED index map will be rebuilt on the next encode() if anything changed.
+	/// @param width Display width in LEDs.
+	/// @param height Display height in LEDs.
+	/// @param flipHorizontal Pass true to mirror the image horizontally.
+	/// @param flipVertical Pass true to mirror the image vertically.
+	/// @param direction Scanline direction of the LED strip.
+	void setLayout(int width, int height, bool flipHorizontal, bool flipVertical, ScanlineDirection direction);
+
+	/// @brief Set up a layout where the display image is one row holding the LED colors in strip order, e.g. sampled from an LEDLayout.
+	/// @param ledCount Number of LEDs in the strip.
+	void setStripLayout(int ledCount);
+
+	/// @brief Only encode a part of the LED strip, e.g. because the display is driven by multiple controllers.
+	/// The packet header then contains only the number of LEDs in the range.
+	/// @param firstLed Index of the first LED in strip order.
+	/// @param count Number of LEDs to encode. Pass -1 to encode all LEDs from firstLed to the end of the strip.
+	void setRange(int firstLed, int count = -1);
+
+	/// @brief Get the number of LEDs encoded with the current layout and range.
+	int ledCount() const;
+
+	/// @brief Set the order of color components sent. Adalight controllers driving WS2812B strips expect GRB, which is the default.
+	void setColorOrder(ColorOrder order);
+
+	/// @brief Get the LED data of the last frame encoded, without header. Holds 3 * ledCount() bytes.
+	/// @note Only valid after encode() returned a non-empty packet.
+	const unsigned char * ledData() const;
+
+	/// @brief Set LED colors with 16bit precision for the next encode() calls, e.g. as computed by ColorTable::apply16().
+	/// They are temporally dithered down to 8bit per channel: the rounding error of every LED is stored and added
+	/// to the LED in the next frame, so the average color over a few frames has more than 8bit precision.
+	/// @param data 3 values (red, green, blue) per pixel of the image passed to encode(), with lines of (bytesPerLine() / 4) pixels.
+	/// Pass an empty vector to encode the 8bit image colors directly. If the size does not match the image, the image colors are used too.
+	void setHighDepthData(const QVector<quint16> & data);
+
+	/// @brief Set the color calibration applied to the LEDs while building the packet.
+	/// @param calibration Calibration with LED indices relative to the first LED of the range. Pass nullptr to send colors unchanged.
+	void setCalibration(ColorCalibration::SPtr calibration);
+
+	/// @brief Enable or disable the compressed protocol.
+	/// @param enabled Pass true to send delta and run-length encoded frames.
+	/// @param keyFrameInterval Send a key frame after this many delta frames.
+	void setCompression(bool enabled, int keyFrameInterval);
+
+	/// @brief Make the next compressed frame a key frame, e.g. because the receiver lost synchronization.
+	void forceKeyFrame();
+
+	/// @brief Convert an image to an Adalight packet.
+	/// @param image Display image. Should be in Format_RGB32, Format_ARGB32 or Format_ARGB32_Premultiplied, else it will be converted.
+	/// If the image is larger than the display, every LED gets the average of the pixels it covers, like Qt::SmoothTransformation did.
+	/// If it is smaller, the nearest pixel is used. Averaging costs one pass over the covered pixels per frame, so for speed pass images of display size.
+	/// @return Packet with header and LED data or an empty array if the image could not be encoded.
+	/// @note The returned buffer is reused for the next frame. Do not keep copies of it, or the next call will need to reallocate.
+	/// With compression enabled every frame returned is expected to be sent, as the next frame may be a delta to it.
+	const QByteArray & encode(const QImage & image);
+
+private:
+	/// @brief Source pixels an LED averages. The top-left pixel is stored in the index map.
+	struct Footprint
+	{
+		int width;
+		int height;
+	};
+
+	void buildIndexMap(int sourceWidth, int sourceHeight, int sourceStride);
+	void mapPixel(int led, int displayX, int displayY);
+	void writeHeader();
+	void average(const QRgb * pixels);
+	void averageHighDepth(const quint16 * highDepth);
+	/// @brief Copy the LED colors to the packet. Averaged colors are in strip order already, so CONTIGUOUS variants do not use index.
+	/// @param index Offset of the pixel of every LED in pixels. Not used if CONTIGUOUS is true.
+	template <bool CONTIGUOUS> void gather(const QRgb * pixels, const int * index);
+	template <bool CONTIGUOUS> void gatherCalibrated(const QRgb * pixels, const int * index);
+	template <bool CONTIGUOUS> void gatherDithered(const quint16 * highDepth, const int * index);
+	const QByteArray & compress();
+
+	int m_width;
+	int m_height;
+	bool m_flipHorizontal;
+	bool m_flipVertical;
+	ScanlineDirection m_direction;
+	bool m_stripOrder;
+	int m_firstLed;
+	int m_rangeCount;
+	ColorOrder m_colorOrder;
+	bool m_layoutChanged;
+
+	int m_sourceWidth;
+	int m_sourceHeight;
+	int m_sourceStride;
+	/// @brief Offset of the source pixel in the image for each LED, in strip order.
+	QVector<int> m_indexMap;
+	/// @brief Size of the area averaged for each LED, in strip order. Only used if m_averaging is true.
+	QVector<Footprint> m_footprints;
+	/// @brief True if any LED covers more than one source pixel.
+	bool m_averaging;
+	/// @brief Averaged colors and 16bit colors of the LEDs in strip order.
+	QVector<QRgb> m_averaged;
+	QVector<quint16> m_averagedHighDepth;
+	QByteArray m_packet;
+	QByteArray m_empty;
+	QVector<quint16> m_highDepthData;
+	ColorCalibration::SPtr m_calibration;
+	/// @brief Rounding error of the last frame for every LED and channel, in strip order.
+	QVector<short> m_ditherError;
+
+	bool m_compression;
+	int m_keyFrameInterval;
+	int m_framesSinceKeyFrame;
+	bool m_keyFrameForced;
+	QByteArray m_compressedPacket;
+	QByteArray m_previousFrame;
+};
@@ -1,8 +1,5 @@
 #include "DisplayImageConverter.h"
 
-#include "ImageOperations.h"
-#include <QPainter>
-
 
 DisplayImageConverter::DisplayImageConverter(QObject * parent)
 	: QObject(parent)
@@ -12,6 +9,12 @@ DisplayImageConverter::DisplayImageConverter(QObject * parent)
 	, displayContrast("displayContrast", 0, -50, 50)
 	, displayGamma("displayGamma", 220, 100, 400)
 	, crossFadeValue("crossFadeValue", 0, 0, 100)
+	, crossFadeCurve("crossFadeCurve", CrossFadeLinear, 0, CrossFadeCurveCount - 1)
+	, layoutFile("layoutFile", "")
+	, layoutFootprint("layoutFootprint", 0, 0, 32)
+	, temporalDithering("temporalDithering", false)
+	, tentFilter("tentFilter", false)
+	, m_previewSize(256, 256)
 {
 }
 
@@ -28,9 +31,14 @@ void DisplayImageConverter::toXML(QDomElement & parent) const
 	displayWidth.toXML(element);
 	displayHeight.toXML(element);
 	crossFadeValue.toXML(element);
+	crossFadeCurve.toXML(element);
 	displayBrightness.toXML(element);
 	displayContrast.toXML(element);
 	displayGamma.toXML(element);
+	layoutFile.toXML(element);
+	layoutFootprint.toXML(element);
+	temporalDithering.toXML(element);
+	tentFilter.toXML(element);
 }
 
 DisplayImageConverter& DisplayImageConverter::fromXML(const QDomElement & parent)
@@ -47,43 +55,152 @@ DisplayImageConverter& DisplayImageConverter::fromXML(const QDomElement & parent
 	displayBrightness.fromXML(element);
 	displayContrast.fromXML(element);
 	displayGamma.fromXML(element);
+	try
+	{
+		layoutFile.fromXML(element);
+		layoutFootprint.fromXML(element);
+	}
+	catch (std::runtime_error e)
+	{
+		//settings of older versions use the LED grid
+		layoutFile = "";
+		layoutFootprint = 0;
+	}
+	try
+	{
+		temporalDithering.fromXML(element);
+	}
+	catch (std::runtime_error e)
+	{
+		//settings of older versions round to 8bit directly
+		temporalDithering = false;
+	}
+	try
+	{
+		crossFadeCurve.fromXML(element);
+	}
+	catch (std::runtime_error e)
+	{
+		//settings of older versions crossfade linearly
+		crossFadeCurve = CrossFadeLinear;
+	}
+	try
+	{
+		tentFilter.fromXML(element);
+	}
+	catch (std::runtime_error e)
+	{
+		//settings of older versions use a box filter
+		tentFilter = false;
+	}
+	//load layout. this throws if the file is broken
+	QString fileName = layoutFile;
+	layoutFile = "";
+	loadLayout(fileName);
 	return *this;
 }
 
-void DisplayImageConverter::convertImages(const QImage & a, const QImage & b)
+void DisplayImageConverter::loadLayout(const QString & fileName)
 {
-	//allocate image if it isn't
-	if (m_previewImage.isNull() || m_previewImage.size() != a.size())
+	if (fileName.isEmpty())
+	{
+		m_layout.clear();
+	}
+	else
 	{
-		m_previewImage = QImage(a.size(), a.format());
+		m_layout.load(fileName);
 	}
-	//composite images
-	QPainter painter(&m_previewImage);
-	painter.setCompositionMode(QPainter::CompositionMode_Source);
-	painter.fillRect(m_previewImage.rect(), Qt::black);
-	qreal alphaB = crossFadeValue.normalizedValue();
-	qreal alphaA = 1.0 - alphaB;
-	if (alphaA <= alphaB)
+	layoutFile = fileName;
+}
+
+bool DisplayImageConverter::hasLayout() const
+{
+	return !m_layout.isEmpty();
+}
+
+QImage DisplayImageConverter::layoutPreview(const QImage & displayImage, const QSize & size) const
+{
+	return m_layout.drawPreview(displayImage, size);
+}
+
+const QVector<quint16> & DisplayImageConverter::highDepthData() const
+{
+	return m_highDepthData;
+}
+
+void DisplayImageConverter::setLayers(const QVector<DeckLayer> & layers)
+{
+	m_layers = layers;
+}
+
+MixSettings DisplayImageConverter::mixSettings() const
+{
+	MixSettings settings;
+	settings.layers = m_layers;
+	settings.crossFade = crossFadeValue.normalizedValue();
+	settings.crossFadeCurve = (CrossFadeCurve)qBound(0, (int)crossFadeCurve, CrossFadeCurveCount - 1);
+	//LED layouts are sampled at the LED positions by the mixer, so the display image holds the LEDs in strip order
+	settings.displaySize = m_layout.isEmpty() ? QSize(displayWidth, displayHeight) : QSize(m_layout.ledCount(), 1);
+	settings.ledPositions = m_layout.positions();
+	settings.ledFootprint = layoutFootprint;
+	settings.previewSize = m_previewSize;
+	settings.resolveFilter = tentFilter ? ResolveTent : ResolveBox;
+	//with temporal dithering the colors are corrected on the CPU to keep 16bit precision
+	settings.correct = !temporalDithering;
+	correctionValues(settings.brightness, settings.contrast, settings.gamma);
+	return settings;
+}
+
+void DisplayImageConverter::setPreviewSize(const QSize & size)
+{
+	m_previewSize = size;
+}
+
+void DisplayImageConverter::convertMixed(const QImage & display, const QImage & preview, bool corrected)
+{
+	if (display.isNull())
+	{
+		return;
+	}
+	m_displayImage = display;
+	m_previewImage = preview;
+	correctAndSend(!corrected);
+}
+
+void DisplayImageConverter::correctionValues(float & brightness, float & contrast, float & gamma) const
+{
+	brightness = displayBrightness / 50.0f;
+	contrast = (displayContrast + 50.0f) / 100.0f * 2.0f;
+	gamma = displayGamma / 220.0f;
+}
+
+void DisplayImageConverter::correctAndSend(bool correct)
+{
+	if (correct)
 	{
-		painter.drawImage(0, 0, a);
-		painter.setCompositionMode(QPainter::CompositionMode_SourceOver);
-		painter.setOpacity(alphaB);
-		painter.drawImage(0, 0, b);
+		//do image correction. the tables are only rebuilt when the settings have changed
+		float brightness, contrast, gamma;
+		correctionValues(brightness, contrast, gamma);
+		m_colorTable.set(brightness, contrast, gamma);
+		if (temporalDithering)
+		{
+			//keep the corrected colors with 16bit precision before they are rounded to 8bit for the preview
+			if (m_displayImage.format() != QImage::Format_ARGB32 && m_displayImage.format() != QImage::Format_ARGB32_Premultiplied && m_displayImage.format() != QImage::Format_RGB32)
+			{
+				m_displayImage = m_displayImage.convertToFormat(QImage::Format_RGB32);
+			}
+			m_colorTable.apply16(m_displayImage, m_highDepthData);
+		}
+		else
+		{
+			m_highDepthData.clear();
+		}
+		m_colorTable.apply(m_displayImage);
 	}
 	else
 	{
-		painter.drawImage(0, 0, b);
-		painter.setCompositionMode(QPainter::CompositionMode_SourceOver);
-		painter.setOpacity(alphaA);
-		painter.drawImage(0, 0, a);
+		m_highDepthData.clear();
 	}
-	//scale image down to real size
-	m_displayImage = m_previewImage.scaled(displayWidth, displayHeight, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
-	//do image correction
-	float brightness = displayBrightness / 50.0f;
-	float contrast = (displayContrast + 50.0f) / 100.0f * 2.0f;
-	float gamma = displayGamma / 220.0f;
-	m_displayImage = changeImage(m_displayImage, brightness, contrast, gamma);
 	//send results
 	displayImageChanged(m_displayImage);
 	previewImageChanged(m_previewImage);
@@ -1,6 +1,9 @@
 #pragma once
 
 #include "Parameters.h"
+#include "LEDLayout.h"
+#include "ImageOperations.h"
+#include "DisplayMixer.h"
 
 #include <QObject>
 #include <QImage>
@@ -24,17 +27,61 @@ public:
 	ParameterInt displayWidth;
 	ParameterInt displayHeight;
 	ParameterInt crossFadeValue; //[0,100]
+	/// @brief How the crossfader weights the first deck and all decks layered, see CrossFadeCurve.
+	ParameterInt crossFadeCurve;
 	ParameterInt displayGamma; //[150,350]
 	ParameterInt displayBrightness; //[-50,50]
 	ParameterInt displayContrast; //[-50,50]
+	/// @brief LED layout file. If set, the display image contains the LED colors in strip order instead of a grid.
+	ParameterQString layoutFile;
+	/// @brief Radius of the area averaged for every LED of the layout, in pixels of the deck images.
+	ParameterInt layoutFootprint;
+	/// @brief Keep display colors with 16bit precision after correction, so outputs can dither them to 8bit.
+	ParameterBool temporalDithering;
+	/// @brief Scale the decks down to the display size with a tent filter instead of a box filter, see ResolveFilter.
+	ParameterBool tentFilter;
 
-	void convertImages(const QImage & a, const QImage & b);
+	/// @brief Load an LED layout file and use it for the display image. Pass an empty file name to use the regular grid again.
+	/// @throw std::runtime_error if the file can not be loaded. The current layout is kept then.
+	void loadLayout(const QString & fileName);
+	/// @brief Check if an LED layout is used. The display image is then 1 pixel high and holds the LED colors in strip order.
+	bool hasLayout() const;
+	/// @brief Draw a display image created using the LED layout for previewing.
+	QImage layoutPreview(const QImage & displayImage, const QSize & size) const;
+
+	/// @brief Set how the decks are layered, starting with the bottom deck. Used by mixSettings().
+	void setLayers(const QVector<DeckLayer> & layers);
+
+	/// @brief Get the settings RenderThread needs to mix the decks for the display.
+	/// If an LED layout is used, the mixer samples the decks at the LED positions, so the display image holds the LEDs in strip order.
+	MixSettings mixSettings() const;
+	/// @brief Send display and preview images mixed on the GPU, see DisplayMixer.
+	/// @param display Display image. If an LED layout is used, it holds the LED colors in strip order.
+	/// @param preview Preview image.
+	/// @param corrected Pass true if color correction was already applied to the display image.
+	void convertMixed(const QImage & display, const QImage & preview, bool corrected);
+	/// @brief Set the size the preview image is fit into when mixing on the GPU.
+	void setPreviewSize(const QSize & size);
+
+	/// @brief Get the colors of the last display image with 16bit precision, see ColorTable::apply16().
+	/// Empty if temporalDithering is off.
+	const QVector<quint16> & highDepthData() const;
 
 signals:
 	void previewImageChanged(const QImage & image);
 	void displayImageChanged(const QImage & image);
 
 private:
+	/// @brief Get the current color correction values for ColorTable::set() and DisplayMixer::setCorrection().
+	void correctionValues(float & brightness, float & contrast, float & gamma) const;
+	/// @brief Apply color correction to the display image if needed and send both images.
+	void correctAndSend(bool correct);
+
+	QSize m_previewSize;
+	QVector<DeckLayer> m_layers;
 	QImage m_previewImage;
 	QImage m_displayImage;
+	LEDLayout m_layout;
+	ColorTable m_colorTable;
+	QVector<quint16> m_highDepthData;
 };
@@ -0,0 +1,469 @@
+#include "DisplayMixer.h"
+#include "LiveView.h"
+
+#include <QMatrix4x4>
+#include <QVector2D>
+#include <QDebug>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+#ifndef GL_BGRA
+#define GL_BGRA 0x80E1
+#endif
+
+
+//samples all decks on a grid of up to 16x16 bilinear taps per output pixel and layers them at every tap, as blending is not linear.
+//taps are 2 texels apart and fall on texel corners, so every tap averages 4 texels and the grid averages the whole footprint.
+//the tent filter covers twice the footprint and weights the taps by their distance from the center of the output pixel.
+//%1 is replaced by the deck samplers, %2 by the number of decks and %3 by the code layering decks 1 to N-1.
+//blend modes and the crossfade curve are uniforms, so switching them only changes uniform values. the crossfade weights are computed once per pixel
+const char * DisplayMixer::m_mixFragmentCode = "\
+%1\
+uniform float opacities[%2];\n\
+uniform int blendModes[%2];\n\
+uniform float crossFade;\n\
+uniform int crossFadeCurve;\n\
+uniform vec2 sampleStep;\n\
+uniform int samplesX;\n\
+uniform int samplesY;\n\
+uniform bool tent;\n\
+uniform bool correct;\n\
+uniform float brightness;\n\
+uniform float contrast;\n\
+uniform float gamma;\n\
+\n\
+varying vec2 texcoordVar;\n\
+\n\
+vec3 blend(vec3 a, vec3 b, int mode, float opacity) {\n\
+    if (mode == 1) return min(a + b * opacity, 1.0);\n\
+    if (mode == 2) b = a * b;\n\
+    else if (mode == 3) b = 1.0 - (1.0 - a) * (1.0 - b);\n\
+    else if (mode == 4) b = abs(a - b);\n\
+    else if (mode == 5) opacity *= smoothstep(0.1, 0.3, dot(b, vec3(0.299, 0.587, 0.114)));\n\
+    else if (mode == 6) b = clamp(a + 2.0 * b - 1.0, 0.0, 1.0);\n\
+    return mix(a, b, opacity);\n\
+}\n\
+\n\
+vec2 crossFadeWeights() {\n\
+    if (crossFadeCurve == 1) return vec2(cos(crossFade * 1.5707963), sin(crossFade * 1.5707963));\n\
+    if (crossFadeCurve == 2) return crossFade < 0.5 ? vec2(1.0, 0.0) : vec2(0.0, 1.0);\n\
+    return vec2(1.0 - crossFade, crossFade);\n\
+}\n\
+\n\
+float tentWeight(int i, int samples) {\n\
+    return 1.0 - abs((float(i) + 0.5) / float(samples) * 2.0 - 1.0);\n\
+}\n\
+\n\
+vec3 layers(vec2 uv, vec2 weights) {\n\
+    vec3 first = blend(vec3(0.0), texture2D(deck0, uv).rgb, blendModes[0], opacities[0]);\n\
+    vec3 color = first;\n\
+%3\
+    return first * weights.x + color * weights.y;\n\
+}\n\
+\n\
+void main() {\n\
+    vec3 sum = vec3(0.0);\n\
+    float weightSum = 0.0;\n\
+    vec2 weights = crossFadeWeights();\n\
+    vec2 start = texcoordVar + (0.5 - 0.5 * vec2(float(samplesX), float(samplesY))) * sampleStep;\n\
+    for (int y = 0; y < 16; ++y) {\n\
+        if (y >= samplesY) break;\n\
+        for (int x = 0; x < 16; ++x) {\n\
+            if (x >= samplesX) break;\n\
+            float weight = tent ? tentWeight(x, samplesX) * tentWeight(y, samplesY) : 1.0;\n\
+            sum += weight * layers(start + vec2(float(x), float(y)) * sampleStep, weights);\n\
+            weightSum += weight;\n\
+        }\n\
+    }\n\
+    vec3 color = sum / weightSum;\n\
+    if (correct) {\n\
+        color = ((color + brightness) - 0.5) * contrast + 0.5;\n\
+        color = pow(clamp(color, 0.0, 1.0), vec3(gamma));\n\
+    }\n\
+    gl_FragColor = vec4(color, 1.0);\n\
+}";
+
+const char * DisplayMixer::m_uniformNames[UniformCount] = {
+	"projectionMatrix", "opacities", "blendModes", "crossFade", "crossFadeCurve", "sampleStep",
+	"samplesX", "samplesY", "tent", "correct", "brightness", "contrast", "gamma"
+};
+
+
+DisplayMixer::DisplayMixer(int deckCount)
+	: m_shaderProgram(nullptr)
+	, m_positionLocation(-1)
+	, m_texcoord0Location(-1)
+	, m_deckCount(deckCount)
+	, m_sampleFootprint(0)
+	, m_samplesChanged(false)
+	, m_maxSize(0)
+	, m_crossFade(0.0f)
+	, m_crossFadeCurve(CrossFadeLinear)
+	, m_resolveFilter(ResolveBox)
+	, m_brightness(0.0f)
+	, m_contrast(1.0f)
+	, m_gamma(1.0f)
+	, m_pixelBuffersSupported(false)
+	, m_readFormat(GL_RGBA)
+{
+	for (int target = 0; target < TargetCount; ++target)
+	{
+		m_frameBuffers[target] = nullptr;
+		for (int i = 0; i < PixelBufferCount; ++i)
+		{
+			m_pixelBuffers[target][i] = QOpenGLBuffer(QOpenGLBuffer::PixelPackBuffer);
+		}
+		m_pixelBufferSize[target] = 0;
+		m_pixelBufferIndex[target] = 0;
+		m_pixelBuffersFilled[target] = 0;
+		m_corrected[target] = false;
+		m_latency[target] = 0;
+	}
+	m_functions.initializeOpenGLFunctions();
+	//every deck is bound to its own texture unit
+	GLint textureUnits = 0;
+	m_functions.glGetIntegerv(GL_MAX_TEXTURE_IMAGE_UNITS, &textureUnits);
+	if (m_deckCount < 1 || m_deckCount > qMin((int)textureUnits, (int)MaxDeckCount))
+	{
+		throw std::runtime_error(QString("Can not mix %1 decks on the GPU. %2 texture units are available.").arg(m_deckCount).arg(textureUnits).toStdString());
+	}
+	GLint maxSize = 0;
+	m_functions.glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+	m_maxSize = qMax(1, (int)maxSize);
+	//build mixing shader for the number of decks
+	QString samplers;
+	QString layers;
+	for (int i = 0; i < m_deckCount; ++i)
+	{
+		samplers += QString("uniform sampler2D deck%1;\n").arg(i);
+		if (i > 0)
+		{
+			layers += QString("    color = blend(color, texture2D(deck%1, uv).rgb, blendModes[%1], opacities[%1]);\n").arg(i);
+		}
+	}
+	const QString mixFragmentCode = QString(m_mixFragmentCode).arg(samplers).arg(m_deckCount).arg(layers);
+	//pixel pack buffers for asynchronous readback are available on desktop OpenGL and OpenGL ES 3
+	QOpenGLContext * context = QOpenGLContext::currentContext();
+	m_pixelBuffersSupported = !context->isOpenGLES() || context->format().majorVersion() >= 3;
+	//desktop OpenGL can read pixels in the byte order of QRgb, so rows can be copied as they are
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+	m_readFormat = context->isOpenGLES() ? GL_RGBA : GL_BGRA;
+#endif
+	//compile mixing shader
+	const QString vertexPrefix = context->isOpenGLES() ? LiveView::m_vertexPrefixGLES2 : LiveView::m_vertexPrefixGL2;
+	const QString fragmentPrefix = context->isOpenGLES() ? LiveView::m_fragmentPrefixGLES2 : LiveView::m_fragmentPrefixGL2;
+	m_shaderProgram = new QOpenGLShaderProgram();
+	if (!m_shaderProgram->addShaderFromSourceCode(QOpenGLShader::Vertex, vertexPrefix + LiveView::m_defaultVertexCode)
+		|| !m_shaderProgram->addShaderFromSourceCode(QOpenGLShader::Fragment, fragmentPrefix + mixFragmentCode)
+		|| !m_shaderProgram->link())
+	{
+		const QString errors = m_shaderProgram->log();
+		delete m_shaderProgram;
+		m_shaderProgram = nullptr;
+		throw std::runtime_error(QString("Failed to compile shader for mixing on the GPU: %1").arg(errors).toStdString());
+	}
+	//look up locations once, so rendering does not look up names every frame
+	for (int i = 0; i < UniformCount; ++i)
+	{
+		m_uniformLocations[i] = m_shaderProgram->uniformLocation(m_uniformNames[i]);
+	}
+	m_positionLocation = m_shaderProgram->attributeLocation("position");
+	m_texcoord0Location = m_shaderProgram->attributeLocation("texcoord0");
+	//every deck is always bound to the texture unit of its index
+	m_shaderProgram->bind();
+	for (int i = 0; i < m_deckCount; ++i)
+	{
+		m_shaderProgram->setUniformValue(QString("deck%1").arg(i).toLatin1().constData(), i);
+	}
+	m_shaderProgram->release();
+}
+
+DisplayMixer::~DisplayMixer()
+{
+	delete m_shaderProgram;
+	for (int target = 0; target < TargetCount; ++target)
+	{
+		delete m_frameBuffers[target];
+		for (int i = 0; i < PixelBufferCount; ++i)
+		{
+			m_pixelBuffers[target][i].destroy();
+		}
+	}
+}
+
+int DisplayMixer::deckCount() const
+{
+	return m_deckCount;
+}
+
+void DisplayMixer::setSources(const QVector<GLuint> & textures, const QSize & size)
+{
+	m_textures = textures;
+	m_sourceSize = size;
+}
+
+void DisplayMixer::setLayers(const QVector<DeckLayer> & layers)
+{
+	m_layers = layers;
+}
+
+void DisplayMixer::setCrossFade(float value, CrossFadeCurve curve)
+{
+	m_crossFade = value;
+	m_crossFadeCurve = curve;
+}
+
+void DisplayMixer::setResolveFilter(ResolveFilter filter)
+{
+	m_resolveFilter = filter;
+}
+
+void DisplayMixer::setSamplePositions(const QVector<QPointF> & positions, int footprint)
+{
+	m_sampleFootprint = footprint;
+	//the settings are copied every frame, but share their data until the layout changes
+	if (positions == m_samplePositions)
+	{
+		return;
+	}
+	m_samplePositions = positions;
+	m_samplesChanged = true;
+	const int count = positions.size();
+	m_sampleSize = count > 0 ? QSize(qMin(count, m_maxSize), (count + m_maxSize - 1) / m_maxSize) : QSize();
+	//every position covers one pixel. the texture coordinates are constant over it, so the fragment shader samples the position.
+	//rows are read back top-down, so the first row is the top row of the framebuffer
+	m_sampleVertices.resize(count * 6 * 5);
+	GLfloat * vertex = m_sampleVertices.data();
+	const float pixelWidth = 1.0f / m_sampleSize.width();
+	const float pixelHeight = 1.0f / m_sampleSize.height();
+	for (int i = 0; i < count; ++i)
+	{
+		const float left = -0.5f + (i % m_sampleSize.width()) * pixelWidth;
+		const float top = 0.5f - (i / m_sampleSize.width()) * pixelHeight;
+		const float corners[6][2] = { {left, top - pixelHeight}, {left, top}, {left + pixelWidth, top - pixelHeight},
+			{left + pixelWidth, top - pixelHeight}, {left, top}, {left + pixelWidth, top} };
+		for (int j = 0; j < 6; ++j, vertex += 5)
+		{
+			vertex[0] = corners[j][0];
+			vertex[1] = corners[j][1];
+			vertex[2] = 0.0f;
+			//textures are bottom-up, layout positions top-down
+			vertex[3] = (float)positions.at(i).x();
+			vertex[4] = 1.0f - (float)positions.at(i).y();
+		}
+	}
+}
+
+void DisplayMixer::setCorrection(float brightness, float contrast, float gamma)
+{
+	m_brightness = brightness;
+	m_contrast = contrast;
+	m_gamma = gamma;
+}
+
+QImage DisplayMixer::render(Target target, const QSize & targetSize, bool correct, bool filter)
+{
+	const bool sampling = target == Display && !m_samplePositions.isEmpty();
+	const QSize size = sampling ? m_sampleSize : targetSize;
+	if (m_textures.size() != m_deckCount || m_textures.contains(0) || m_sourceSize.isEmpty() || size.isEmpty())
+	{
+		return QImage();
+	}
+	//(re)allocate framebuffer of target
+	QOpenGLFramebufferObject *& frameBuffer = m_frameBuffers[target];
+	//frames read before a layout change hold other LEDs, even if the size is the same
+	const bool changed = !frameBuffer || frameBuffer->size() != size || m_corrected[target] != correct || (sampling && m_samplesChanged);
+	if (target == Display)
+	{
+		m_samplesChanged = false;
+	}
+	if (!frameBuffer || frameBuffer->size() != size)
+	{
+		delete frameBuffer;
+		frameBuffer = new QOpenGLFramebufferObject(size);
+	}
+	m_corrected[target] = correct;
+	frameBuffer->bind();
+	m_functions.glViewport(0, 0, size.width(), size.height());
+	//the deck textures use nearest filtering for the live views. taps need linear filtering to average 4 texels
+	for (int i = 0; i < m_deckCount; ++i)
+	{
+		m_functions.glActiveTexture(GL_TEXTURE0 + i);
+		m_functions.glBindTexture(GL_TEXTURE_2D, m_textures.at(i));
+		m_functions.glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		m_functions.glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	}
+	//number of taps per output pixel. every tap covers 2x2 texels of the footprint. sample positions average a square around them
+	const bool tent = !sampling && filter && m_resolveFilter == ResolveTent;
+	const float filterSize = tent ? 2.0f : 1.0f;
+	const float footprintX = sampling ? 2 * m_sampleFootprint + 1 : filterSize * m_sourceSize.width() / size.width();
+	const float footprintY = sampling ? 2 * m_sampleFootprint + 1 : filterSize * m_sourceSize.height() / size.height();
+	const int samplesX = qBound(1, (int)std::ceil(footprintX / 2.0f), 16);
+	const int samplesY = qBound(1, (int)std::ceil(footprintY / 2.0f), 16);
+	QMatrix4x4 projectionMatrix;
+	projectionMatrix.ortho(-0.5f, 0.5f, -0.5f, 0.5f, -1.0f, 1.0f);
+	//decks without a layer are composited normally
+	QVector<GLfloat> opacities(m_deckCount, 1.0f);
+	QVector<GLint> blendModes(m_deckCount, BlendNormal);
+	for (int i = 0; i < qMin(m_deckCount, m_layers.size()); ++i)
+	{
+		opacities[i] = m_layers.at(i).opacity;
+		blendModes[i] = m_layers.at(i).blendMode;
+	}
+	//set all uniforms values
+	m_shaderProgram->bind();
+	m_shaderProgram->setUniformValue(m_uniformLocations[UniformProjectionMatrix], projectionMatrix);
+	m_shaderProgram->setUniformValueArray(m_uniformLocations[UniformOpacities], opacities.constData(), m_deckCount, 1);
+	m_shaderProgram->setUniformValueArray(m_uniformLocations[UniformBlendModes], blendModes.constData(), m_deckCount);
+	m_shaderProgram->setUniformValue(m_uniformLocations[UniformCrossFade], m_crossFade);
+	m_shaderProgram->setUniformValue(m_uniformLocations[UniformCrossFadeCurve], (GLint)m_crossFadeCurve);
+	m_shaderProgram->setUniformValue(m_uniformLocations[UniformSampleStep], QVector2D(footprintX / samplesX / m_sourceSize.width(), footprintY / samplesY / m_sourceSize.height()));
+	m_shaderProgram->setUniformValue(m_uniformLocations[UniformSamplesX], samplesX);
+	m_shaderProgram->setUniformValue(m_uniformLocations[UniformSamplesY], samplesY);
+	m_shaderProgram->setUniformValue(m_uniformLocations[UniformTent], tent);
+	m_shaderProgram->setUniformValue(m_uniformLocations[UniformCorrect], correct);
+	m_shaderProgram->setUniformValue(m_uniformLocations[UniformBrightness], m_brightness);
+	m_shaderProgram->setUniformValue(m_uniformLocations[UniformContrast], m_contrast);
+	m_shaderProgram->setUniformValue(m_uniformLocations[UniformGamma], m_gamma);
+	//render screen-sized quad or one pixel per sample position
+	const int position = m_positionLocation;
+	const int texcoord0 = m_texcoord0Location;
+	const GLfloat * vertices = sampling ? m_sampleVertices.constData() : LiveView::m_quadData;
+	m_functions.glEnableVertexAttribArray(position);
+	m_functions.glEnableVertexAttribArray(texcoord0);
+	m_functions.glVertexAttribPointer(position, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), &vertices[0]);
+	m_functions.glVertexAttribPointer(texcoord0, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), &vertices[3]);
+	if (sampling)
+	{
+		//pixels after the last position in the last row stay unused
+		m_functions.glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+		m_functions.glClear(GL_COLOR_BUFFER_BIT);
+		m_functions.glDrawArrays(GL_TRIANGLES, 0, m_samplePositions.size() * 6);
+	}
+	else
+	{
+		m_functions.glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+	}
+	m_functions.glDisableVertexAttribArray(position);
+	m_functions.glDisableVertexAttribArray(texcoord0);
+	m_shaderProgram->release();
+	//restore nearest filtering for the live views
+	for (int i = m_deckCount - 1; i >= 0; --i)
+	{
+		m_functions.glActiveTexture(GL_TEXTURE0 + i);
+		m_functions.glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		m_functions.glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		m_functions.glBindTexture(GL_TEXTURE_2D, 0);
+	}
+	//read back only the small result
+	readFrameBuffer(target, size, changed);
+	frameBuffer->release();
+	if (sampling && size.height() > 1)
+	{
+		//the rows of the image are contiguous, so the LEDs are already in strip order
+		QImage strip(m_samplePositions.size(), 1, QImage::Format_ARGB32_Premultiplied);
+		memcpy(strip.bits(), m_images[target].constBits(), 4 * m_samplePositions.size());
+		return strip;
+	}
+	return m_images[target];
+}
+
+int DisplayMixer::latency(Target target) const
+{
+	return m_latency[target];
+}
+
+void DisplayMixer::readFrameBuffer(Target target, const QSize & size, bool changed)
+{
+	const int byteCount = size.width() * size.height() * 4;
+	//reuse the image if the caller released it. else allocate a new one instead of detaching, which would copy the old pixels
+	QImage & image = m_images[target];
+	if (image.size() != size || !image.isDetached())
+	{
+		image = QImage(size, QImage::Format_ARGB32_Premultiplied);
+	}
+	m_latency[target] = 0;
+	if (m_pixelBuffersSupported)
+	{
+		QOpenGLBuffer * buffers = m_pixelBuffers[target];
+		//(re)allocate pixel buffers. frames read before are discarded, as they have a different size or correction
+		if (changed || m_pixelBufferSize[target] != byteCount)
+		{
+			if (m_pixelBufferSize[target] != byteCount)
+			{
+				for (int i = 0; i < PixelBufferCount; ++i)
+				{
+					buffers[i].destroy();
+					buffers[i].create();
+					buffers[i].setUsagePattern(QOpenGLBuffer::StreamRead);
+					buffers[i].bind();
+					buffers[i].allocate(byteCount);
+					buffers[i].release();
+				}
+				m_pixelBufferSize[target] = byteCount;
+			}
+			m_pixelBufferIndex[target] = 0;
+			m_pixelBuffersFilled[target] = 0;
+		}
+		//start reading the current frame into the next buffer. this returns without waiting for the GPU
+		const int readIndex = m_pixelBufferIndex[target];
+		buffers[readIndex].bind();
+		m_functions.glReadPixels(0, 0, size.width(), size.height(), m_readFormat, GL_UNSIGNED_BYTE, nullptr);
+		buffers[readIndex].release();
+		m_pixelBufferIndex[target] = (readIndex + 1) % PixelBufferCount;
+		m_pixelBuffersFilled[target] = qMin(m_pixelBuffersFilled[target] + 1, PixelBufferCount);
+		//the next buffer holds the oldest frame, read PixelBufferCount - 1 frames ago. it has most likely arrived by now.
+		//right after a change there is no older frame, so the current one is mapped, which waits for the GPU once
+		const bool filled = m_pixelBuffersFilled[target] == PixelBufferCount;
+		QOpenGLBuffer & buffer = buffers[filled ? m_pixelBufferIndex[target] : readIndex];
+		buffer.bind();
+		const uchar * data = static_cast<const uchar *>(buffer.mapRange(0, byteCount, QOpenGLBuffer::RangeRead));
+		if (data == nullptr)
+		{
+			data = static_cast<const uchar *>(buffer.map(QOpenGLBuffer::ReadOnly));
+		}
+		if (data != nullptr)
+		{
+			copyFrameBuffer(target, data);
+			buffer.unmap();
+			buffer.release();
+			m_latency[target] = filled ? PixelBufferCount - 1 : 0;
+			return;
+		}
+		//mapping is not supported. read back synchronously from now on
+		qDebug() << "Failed to map pixel buffer. Reading back the mixed image synchronously.";
+		buffer.release();
+		m_pixelBuffersSupported = false;
+	}
+	if (m_readBuffer.size() < byteCount)
+	{
+		m_readBuffer.resize(byteCount);
+	}
+	m_functions.glReadPixels(0, 0, size.width(), size.height(), m_readFormat, GL_UNSIGNED_BYTE, m_readBuffer.data());
+	copyFrameBuffer(target, reinterpret_cast<const uchar *>(m_readBuffer.constData()));
+}
+
+void DisplayMixer::copyFrameBuffer(Target target, const uchar * data)
+{
+	QImage & image = m_images[target];
+	const int width = image.width();
+	const int height = image.height();
+	//OpenGL rows are bottom-up
+	for (int y = 0; y < height; ++y, data += 4 * width)
+	{
+		QRgb * line = reinterpret_cast<QRgb *>(image.scanLine(height - 1 - y));
+		if (m_readFormat == GL_BGRA)
+		{
+			memcpy(line, data, 4 * width);
+		}
+		else
+		{
+			for (int x = 0; x < width; ++x)
+			{
+				const uchar * pixel = data + 4 * x;
+				line[x] = qRgba(pixel[0], pixel[1], pixel[2], pixel[3]);
+			}
+		}
+	}
+}
@@ -0,0 +1,229 @@
+#pragma once
+
+#include <QSize>
+#include <QPointF>
+#include <QImage>
+#include <QVector>
+#include <QOpenGLFunctions>
+#include <QOpenGLShaderProgram>
+#include <QOpenGLFramebufferObject>
+#include <QOpenGLBuffer>
+#include <QByteArray>
+
+
+/// @brief How a deck is composited over the decks below it. Add, multiply, screen and difference use the formulas of the
+/// QPainter composition modes.
+enum BlendMode
+{
+	BlendNormal,		///< Deck replaces what is below it.
+	BlendAdd,			///< Deck is added to what is below it.
+	BlendMultiply,		///< Deck is multiplied with what is below it.
+	BlendScreen,		///< Inverted deck is multiplied with what is below it, inverted.
+	BlendDifference,	///< Absolute difference of deck and what is below it.
+	BlendLumaKey,		///< Deck replaces what is below it where it is bright. Dark parts of the deck are keyed out.
+	BlendLinearLight,	///< Deck darkens what is below it where it is darker than 50% gray and brightens it where it is lighter.
+	BlendModeCount
+};
+
+/// @brief How the crossfader fades from the first deck to all decks layered.
+enum CrossFadeCurve
+{
+	CrossFadeLinear,		///< Both sides are weighted linearly. The middle is darker when the sides differ.
+	CrossFadeConstantPower,	///< Both sides are weighted by a quarter sine / cosine, so the brightness stays constant.
+	CrossFadeCut,			///< Hard cut at the middle of the crossfader.
+	CrossFadeCurveCount
+};
+
+/// @brief Filter used to scale the mixed decks down to the target size.
+enum ResolveFilter
+{
+	ResolveBox,		///< Averages the pixels covered by a target pixel.
+	ResolveTent,	///< Weights pixels by distance over twice the area covered by a target pixel. Softer, with less aliasing.
+	ResolveFilterCount
+};
+
+/// @brief Factors the decks can be rendered larger than the display with. The mixer averages 2x2 texels per tap,
+/// so only these factors are resolved with evenly weighted texels.
+enum SupersamplingFactor
+{
+	Supersampling1x = 1,
+	Supersampling2x = 2,
+	Supersampling4x = 4
+};
+
+/// @brief Describes how a deck is composited over the decks below it.
+struct DeckLayer
+{
+	DeckLayer() : opacity(1.0f), blendMode(BlendNormal) {}
+
+	/// @brief Opacity in [0,1]. 0 leaves what is below the deck unchanged.
+	float opacity;
+	BlendMode blendMode;
+};
+
+/// @brief Describes how RenderThread mixes the decks of a frame.
+struct MixSettings
+{
+	/// @brief How the decks are layered, starting with the bottom deck. The first deck is composited over black.
+	QVector<DeckLayer> layers;
+	/// @brief Crossfade value in [0,1]. 0 shows the first deck only, 1 all decks layered.
+	float crossFade;
+	CrossFadeCurve crossFadeCurve;
+	/// @brief Size of the display image. If empty, the decks are mixed in the size they are rendered in.
+	QSize displaySize;
+	/// @brief Normalized positions of the LEDs of an LED layout in strip order. If set, the display image holds the LED colors
+	/// sampled at these positions instead of a grid, see DisplayMixer::setSamplePositions().
+	QVector<QPointF> ledPositions;
+	/// @brief Radius of the area averaged around every LED position, in pixels of the deck textures.
+	int ledFootprint;
+	/// @brief Size the preview image is fit into.
+	QSize previewSize;
+	/// @brief Filter the display image is scaled down with. The preview and LED layouts always use a box filter.
+	ResolveFilter resolveFilter;
+	/// @brief Apply color correction to the display image on the GPU.
+	bool correct;
+	/// @brief Color correction values, see ColorTable::set().
+	float brightness;
+	float contrast;
+	float gamma;
+};
+
+/// @brief Mixes the deck framebuffers on the GPU. All deck textures are sampled in a single pass that layers them,
+/// scales them down to the target size using a box or tent filter and optionally applies brightness, contrast and gamma,
+/// so only the small result has to be read back instead of one full framebuffer per deck. Blend modes, opacities and the
+/// crossfade curve are uniforms, so changing them does not recompile the shader.
+/// Results are read back asynchronously through two pixel buffer objects per target on desktop OpenGL and OpenGL ES 3,
+/// so rendering does not wait for the GPU, but the image returned is one frame behind, see latency().
+/// Does not own an OpenGL context. It is created, used and destroyed by RenderThread with its context current.
+class DisplayMixer
+{
+public:
+	/// @brief Maximum number of decks that can be mixed. Every deck needs a texture unit and OpenGL ES 2 guarantees 8.
+	static const int MaxDeckCount = 8;
+
+	/// @brief Targets rendered to. Every target has its own framebuffer.
+	enum Target
+	{
+		Display,	///< Display image, e.g. the LED grid.
+		Preview,	///< Downscaled mixed image shown in the GUI.
+		TargetCount
+	};
+
+	/// @brief Compile shader for a number of decks using the current context.
+	/// @throw std::runtime_error if there are more decks than texture units or the shader fails to compile.
+	DisplayMixer(int deckCount);
+	~DisplayMixer();
+
+	/// @brief Get the number of decks the shader mixes.
+	int deckCount() const;
+
+	/// @brief Set the deck textures to mix, starting with the bottom deck.
+	/// @param textures Textures of the decks. Must hold deckCount() textures.
+	/// @param size Size of all textures.
+	void setSources(const QVector<GLuint> & textures, const QSize & size);
+	/// @brief Set how the decks are layered, starting with the bottom deck. Decks without a layer are composited normally.
+	void setLayers(const QVector<DeckLayer> & layers);
+	/// @brief Set crossfade value in [0,1]. 0 shows the first deck only, 1 all decks layered.
+	/// @param curve How the first deck and all decks layered are weighted in between.
+	void setCrossFade(float value, CrossFadeCurve curve = CrossFadeLinear);
+	/// @brief Set the filter used to scale the decks down.
+	void setResolveFilter(ResolveFilter filter);
+	/// @brief Set positions the display target samples the decks at instead of scaling them down, e.g. for an LED layout.
+	/// The display image then holds one pixel per position in strip order and is positions.size() x 1 pixels.
+	/// LEDs wrap to further rows of the framebuffer if there are more than fit into one, so only these pixels are read back.
+	/// @param positions Normalized positions with (0,0) being the top-left corner. Pass an empty vector to scale the decks again.
+	/// @param footprint Radius of the square area averaged around every position, in pixels of the deck textures. 0 samples a single point.
+	void setSamplePositions(const QVector<QPointF> & positions, int footprint);
+	/// @brief Set color correction. Uses the same formula as ColorTable::set().
+	void setCorrection(float brightness, float contrast, float gamma);
+
+	/// @brief Mix the sources and read back the result.
+	/// @param target Framebuffer to render to.
+	/// @param targetSize Size of the result. Not used for the display target if sample positions are set.
+	/// @param correct Pass true to apply color correction.
+	/// @param filter Pass true to use the filter set with setResolveFilter(), false to use a box filter.
+	/// @return Image in Format_ARGB32_Premultiplied. It may be from an earlier call with the same size and correction, see latency().
+	/// @note The image is reused for the next call if the caller released it, so do not keep it longer than needed.
+	QImage render(Target target, const QSize & targetSize, bool correct, bool filter = true);
+
+	/// @brief Get the number of calls the image returned by the last render() call for a target is behind.
+	/// This is PixelBufferCount - 1 when reading back using pixel buffer objects and 0 otherwise, or if the size or correction changed.
+	int latency(Target target) const;
+
+private:
+	/// @brief Read back the bound framebuffer of a target into m_images.
+	/// Uses pixel buffer objects if available, so reading does not wait for the GPU, but returns an earlier frame.
+	/// @param changed Pass true if the size or correction changed, so frames read before must not be returned.
+	void readFrameBuffer(Target target, const QSize & size, bool changed);
+	/// @brief Copy bottom-up pixels read in m_readFormat to the image of a target.
+	void copyFrameBuffer(Target target, const uchar * data);
+
+	/// @brief Number of pixel buffers per target frames are read back into in turn.
+	static const int PixelBufferCount = 2;
+
+	/// @brief Uniforms of the mixing shader. Their locations are looked up once after linking.
+	enum Uniform
+	{
+		UniformProjectionMatrix,
+		UniformOpacities,
+		UniformBlendModes,
+		UniformCrossFade,
+		UniformCrossFadeCurve,
+		UniformSampleStep,
+		UniformSamplesX,
+		UniformSamplesY,
+		UniformTent,
+		UniformCorrect,
+		UniformBrightness,
+		UniformContrast,
+		UniformGamma,
+		UniformCount
+	};
+
+	static const char * m_mixFragmentCode;
+	static const char * m_uniformNames[UniformCount];
+
+	QOpenGLFunctions m_functions;
+	QOpenGLShaderProgram * m_shaderProgram;
+	int m_uniformLocations[UniformCount];
+	int m_positionLocation;
+	int m_texcoord0Location;
+	QOpenGLFramebufferObject * m_frameBuffers[TargetCount];
+	int m_deckCount;
+	QVector<GLuint> m_textures;
+	QVector<DeckLayer> m_layers;
+	QSize m_sourceSize;
+	QVector<QPointF> m_samplePositions;
+	int m_sampleFootprint;
+	/// @brief Size of the framebuffer the sample positions are rendered to.
+	QSize m_sampleSize;
+	/// @brief True if the sample positions changed since the display target was rendered.
+	bool m_samplesChanged;
+	/// @brief One quad of two triangles per sample position, covering its pixel, in the layout of LiveView::m_quadData.
+	QVector<GLfloat> m_sampleVertices;
+	/// @brief Maximum width of a framebuffer.
+	int m_maxSize;
+	float m_crossFade;
+	CrossFadeCurve m_crossFadeCurve;
+	ResolveFilter m_resolveFilter;
+	float m_brightness;
+	float m_contrast;
+	float m_gamma;
+
+	bool m_pixelBuffersSupported;
+	/// @brief Pixel format passed to glReadPixels. GL_BGRA matches the memory layout of QRgb on little-endian desktop OpenGL.
+	GLenum m_readFormat;
+	QOpenGLBuffer m_pixelBuffers[TargetCount][PixelBufferCount];
+	/// @brief Size of the pixel buffers in bytes.
+	int m_pixelBufferSize[TargetCount];
+	/// @brief Index of the pixel buffer the next frame is read into.
+	int m_pixelBufferIndex[TargetCount];
+	/// @brief Number of pixel buffers holding a frame.
+	int m_pixelBuffersFilled[TargetCount];
+	/// @brief Correction of the frames in the pixel buffers.
+	bool m_corrected[TargetCount];
+	int m_latency[TargetCount];
+	QImage m_images[TargetCount];
+	/// @brief Buffer for reading back synchronously if pixel buffers are not supported.
+	QByteArray m_readBuffer;
+};
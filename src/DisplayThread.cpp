@@ -1,14 +1,12 @@
 #include "DisplayThread.h"
+#include "NetworkOutput.h"
 
 #include <QtSerialPort/QSerialPort>
 #include <QtSerialPort/QSerialPortInfo>
-#include <QTime>
 
 
 DisplayThread::DisplayThread(QObject *parent)
-	: QThread(parent)
-	, m_waitTimeout(100)
-	, m_quit(false)
+	: QObject(parent)
 	, portName("portName", "")
 	, baudrate("baudrate", QSerialPort::Baud115200, QSerialPort::Baud1200, 500000)
 	, sending("sendData", false)
@@ -18,19 +16,40 @@ DisplayThread::DisplayThread(QObject *parent)
 	, flipHorizontal("flipHorizontal", false)
 	, flipVertical("flipVertical", false)
 	, scanlineDirection("scanlineDirection", ConstantLeftToRight)
+	, compressedProtocol("compressedProtocol", false)
+	, keyFrameInterval("keyFrameInterval", 50, 1, 1000)
+	, adaptivePacing("adaptivePacing", false)
+	, m_latency(std::make_shared<LatencyStatistics>())
+	, m_frameNumber(0)
+	, m_outputsReady(0)
+	, m_layoutId(0)
+	, m_layoutSettings()
 {
-	connect(portName.GetSharedParameter().get(), SIGNAL(valueChanged(const QString &)), this, SLOT(setPortName(const QString &)));
-	connect(baudrate.GetSharedParameter().get(), SIGNAL(valueChanged(int)), this, SLOT(setBaudrate(int)));
+	//the first segment is always there and uses our port settings
+	SerialOutput::SPtr output = std::make_shared<SerialOutput>();
+	addOutput(output);
+	output->portName.connect(portName);
+	output->baudrate.connect(baudrate);
+	connect(output.get(), SIGNAL(portOpened(bool)), this, SIGNAL(portOpened(bool)));
 	connect(sending.GetSharedParameter().get(), SIGNAL(valueChanged(bool)), this, SLOT(setSendData(bool)));
 }
 
 DisplayThread::~DisplayThread()
 {
-    //m_mutex.lock();
-    m_quit = true;
-    m_condition.wakeAll();
-    //m_mutex.unlock();
-    wait();
+	//outputs stop their threads when destroyed
+	m_outputs.clear();
+}
+
+void DisplayThread::addOutput(LEDOutput::SPtr output)
+{
+	connect(output.get(), SIGNAL(response(const QString &)), this, SIGNAL(response(const QString &)));
+	connect(output.get(), SIGNAL(error(const QString &)), this, SIGNAL(error(const QString &)));
+	connect(output.get(), SIGNAL(timeout(const QString &)), this, SIGNAL(timeout(const QString &)));
+	connect(output.get(), SIGNAL(statisticsChanged(float, float, int, int, quint32)), this, SLOT(outputStatisticsChanged(float, float, int, int, quint32)));
+	connect(output.get(), SIGNAL(frameTaken(quint32)), this, SLOT(outputFrameTaken(quint32)));
+	output->setSending(sending);
+	output->setLatencyStatistics(m_latency);
+	m_outputs.push_back(output);
 }
 
 void DisplayThread::toXML(QDomElement & parent) const
@@ -51,7 +70,26 @@ void DisplayThread::toXML(QDomElement & parent) const
 	flipHorizontal.toXML(element);
 	flipVertical.toXML(element);
 	scanlineDirection.toXML(element);
+	compressedProtocol.toXML(element);
+	keyFrameInterval.toXML(element);
+	adaptivePacing.toXML(element);
 	sending.toXML(element);
+	//store rows and calibration of first segment and settings of all further segments
+	m_outputs.front()->rows.toXML(element);
+	m_outputs.front()->calibrationToXML(element);
+	QDomElement segment = element.firstChildElement("Segment");
+	while (!segment.isNull())
+	{
+		element.removeChild(segment);
+		segment = element.firstChildElement("Segment");
+	}
+	for (size_t i = 1; i < m_outputs.size(); ++i)
+	{
+		segment = element.ownerDocument().createElement("Segment");
+		segment.setAttribute("type", m_outputs[i]->typeName());
+		element.appendChild(segment);
+		m_outputs[i]->toXML(segment);
+	}
 }
 
 DisplayThread & DisplayThread::fromXML(const QDomElement & parent)
@@ -71,6 +109,52 @@ DisplayThread & DisplayThread::fromXML(const QDomElement & parent)
 	flipVertical.fromXML(element);
 	scanlineDirection.fromXML(element);
 	sending.fromXML(element);
+	try
+	{
+		compressedProtocol.fromXML(element);
+		keyFrameInterval.fromXML(element);
+	}
+	catch (std::runtime_error e)
+	{
+		//settings of older versions send uncompressed frames
+		compressedProtocol = false;
+		keyFrameInterval = 50;
+	}
+	try
+	{
+		adaptivePacing.fromXML(element);
+	}
+	catch (std::runtime_error e)
+	{
+		//settings of older versions send at the fixed display interval
+		adaptivePacing = false;
+	}
+	//read further segments. each one is driven by its own controller
+	m_outputs.resize(1);
+	for (QDomElement segment = element.firstChildElement("Segment"); !segment.isNull(); segment = segment.nextSiblingElement("Segment"))
+	{
+		LEDOutput::SPtr output;
+		if (segment.attribute("type", "serial") == "network")
+		{
+			output = std::make_shared<NetworkOutput>();
+		}
+		else
+		{
+			output = std::make_shared<SerialOutput>();
+		}
+		output->fromXML(segment);
+		addOutput(output);
+	}
+	try
+	{
+		m_outputs.front()->rows.fromXML(element);
+	}
+	catch (std::runtime_error e)
+	{
+		//settings of older versions have only one segment, which gets all rows
+		m_outputs.front()->rows = 0;
+	}
+	m_outputs.front()->calibrationFromXML(element);
 	return *this;
 }
 
@@ -86,212 +170,180 @@ QStringList DisplayThread::getAvailablePortNames() const
 
 void DisplayThread::setSendData(bool sendData)
 {
-	QMutexLocker locker(&m_mutex);
-	sending = sendData;
-	if (!isRunning())
+	for (auto output : m_outputs)
+	{
+		output->setSending(sendData);
+	}
+}
+
+int DisplayThread::segmentCount() const
+{
+	return m_outputs.size();
+}
+
+void DisplayThread::sendImage(const QImage & image, bool stripOrder, const QVector<quint16> & highDepthData, FrameTiming timing, int waitTimeout)
+{
+	//record the stages before the hand-off once here. the outputs record the rest
+	timing.mark(FrameTiming::Queued);
+	m_latency->record(LatencyStatistics::Render, timing, FrameTiming::Tick, FrameTiming::Rendered);
+	m_latency->record(LatencyStatistics::Convert, timing, FrameTiming::Rendered, FrameTiming::Converted);
+	m_latency->record(LatencyStatistics::HandOff, timing, FrameTiming::Converted, FrameTiming::Queued);
+	++m_frameNumber;
+	m_outputsReady = 0;
+	OutputSettings settings;
+	settings.stripOrder = stripOrder;
+	settings.displayWidth = stripOrder ? image.width() : (int)displayWidth;
+	settings.displayHeight = stripOrder ? 1 : (int)displayHeight;
+	settings.flipHorizontal = flipHorizontal;
+	settings.flipVertical = flipVertical;
+	settings.scanlineDirection = scanlineDirection;
+	settings.compressedProtocol = compressedProtocol;
+	settings.keyFrameInterval = keyFrameInterval;
+	settings.displayInterval = displayInterval;
+	//only hash the layout when it changed, as formatting the string for every frame is not free
+	if (settings.stripOrder != m_layoutSettings.stripOrder || settings.displayWidth != m_layoutSettings.displayWidth || settings.displayHeight != m_layoutSettings.displayHeight
+		|| settings.flipHorizontal != m_layoutSettings.flipHorizontal || settings.flipVertical != m_layoutSettings.flipVertical || settings.scanlineDirection != m_layoutSettings.scanlineDirection)
+	{
+		m_layoutSettings = settings;
+		m_layoutId = qHash(QString("%1 %2 %3 %4 %5 %6").arg((int)stripOrder).arg(settings.displayWidth).arg(settings.displayHeight).arg((int)settings.flipHorizontal).arg((int)settings.flipVertical).arg((int)settings.scanlineDirection));
+	}
+	//record all LEDs in strip order. outputs apply their calibration on playback again, so it is not recorded
+	if (m_recorder.isOpen())
+	{
+		if (stripOrder)
+		{
+			m_recordEncoder.setStripLayout(settings.displayWidth);
+		}
+		else
+		{
+			m_recordEncoder.setLayout(settings.displayWidth, settings.displayHeight, settings.flipHorizontal, settings.flipVertical, settings.scanlineDirection);
+		}
+		m_recordEncoder.setHighDepthData(highDepthData);
+		if (m_recordEncoder.encode(image).size() > 0)
+		{
+			try
+			{
+				//with adaptive pacing frames are sent as fast as the outputs allow. the recorder stores the measured rate when closed
+				const int period = adaptivePacing ? framePeriod() : (int)displayInterval;
+				m_recorder.writeFrame(m_recordEncoder.ledData(), m_recordEncoder.ledCount(), 1000 / qMax(1, period), m_layoutId);
+			}
+			catch (const std::runtime_error & e)
+			{
+				emit error(QString::fromStdString(e.what()));
+			}
+		}
+	}
+	//split rows in strip order (or LEDs for images in strip order) between segments.
+	//segments with a row count of 0 share the unassigned rows equally. the first segment gets what is left over
+	const int rowSize = stripOrder ? 1 : settings.displayWidth;
+	const int rowCount = stripOrder ? settings.displayWidth : settings.displayHeight;
+	const int segments = m_outputs.size();
+	int assignedRows = 0;
+	int sharingSegments = 1;
+	for (int i = 1; i < segments; ++i)
+	{
+		assignedRows += m_outputs[i]->rows;
+		sharingSegments += m_outputs[i]->rows == 0 ? 1 : 0;
+	}
+	const int sharedRows = qMax(0, rowCount - assignedRows) / sharingSegments;
+	int rowsLeft = rowCount;
+	for (int i = segments - 1; i >= 0; --i)
+	{
+		const int segmentRows = i == 0 ? rowsLeft : qMin(rowsLeft, m_outputs[i]->rows > 0 ? (int)m_outputs[i]->rows : sharedRows);
+		rowsLeft -= segmentRows;
+		settings.firstLed = rowsLeft * rowSize;
+		settings.ledCount = segmentRows * rowSize;
+		m_outputs[i]->sendFrame(image, highDepthData, m_frameNumber, timing, settings, waitTimeout);
+	}
+}
+
+void DisplayThread::startRecording(const QString & fileName)
+{
+	m_recorder.open(fileName);
+	m_recordEncoder.setRange(0, -1);
+	m_recordEncoder.setColorOrder(DisplayEncoder::OrderRGB);
+	m_recordEncoder.setCompression(false, 1);
+}
+
+void DisplayThread::stopRecording()
+{
+	m_recorder.close();
+}
+
+bool DisplayThread::isRecording() const
+{
+	return m_recorder.isOpen();
+}
+
+quint32 DisplayThread::layoutId() const
+{
+	return m_layoutId;
+}
+
+LatencyStatistics::SPtr DisplayThread::latencyStatistics() const
+{
+	return m_latency;
+}
+
+int DisplayThread::framePeriod() const
+{
+	//the slowest output determines the frame rate, as all outputs send parts of the same frame
+	int frameTime = 0;
+	for (auto output : m_outputs)
 	{
-		start();
-		setPriority(QThread::HighPriority);
+		frameTime = qMax(frameTime, output->frameTime());
 	}
-	else
-		m_condition.wakeOne();
+	return frameTime > 0 ? (frameTime + 999) / 1000 : (int)displayInterval;
 }
 
-void DisplayThread::setPortName(const QString &name)
+void DisplayThread::outputFrameTaken(quint32 frameNumber)
 {
-	QMutexLocker locker(&m_mutex);
-	portName = name;
-	if (!isRunning())
+	//only count outputs taking the latest frame. older frames were superseded already
+	if (frameNumber == m_frameNumber && ++m_outputsReady == (int)m_outputs.size())
 	{
-		start();
-		setPriority(QThread::HighPriority);
+		emit readyForFrame();
 	}
-	else
-		m_condition.wakeOne();
 }
 
-void DisplayThread::setBaudrate(int rate)
+int DisplayThread::sentFrames() const
 {
-	QMutexLocker locker(&m_mutex);
-	baudrate = rate;
-	if (!isRunning())
+	int result = 0;
+	for (auto output : m_outputs)
 	{
-		start();
-		setPriority(QThread::HighPriority);
+		result += output->sentFrames();
 	}
-	else
-		m_condition.wakeOne();
+	return result;
 }
 
-void DisplayThread::sendImage(const QImage & image, int waitTimeout)
+int DisplayThread::droppedFrames() const
 {
-    QMutexLocker locker(&m_mutex);
-    m_waitTimeout = waitTimeout;
-    m_displayImage = image;
-    if (!isRunning())
+	int result = 0;
+	for (auto output : m_outputs)
 	{
-		start();
-		setPriority(QThread::HighPriority);
+		result += output->droppedFrames();
 	}
-    else
-        m_condition.wakeOne();
+	return result;
 }
 
-void DisplayThread::run()
+int DisplayThread::lateFrames() const
 {
-	QString currentPortName = portName;
-    bool currentPortNameChanged = true;
-	int currentBaudrate = baudrate;
-	bool currentBaudrateChanged = false;
-	bool sendData = sending;
-    QSerialPort serial;
-    QByteArray data;
+	int result = 0;
+	for (auto output : m_outputs)
+	{
+		result += output->lateFrames();
+	}
+	return result;
+}
 
-    while (!m_quit)
+void DisplayThread::outputStatisticsChanged(float bytesPerFrame, float framesPerSecond, int droppedFrames, int lateFrames, quint32 frameNumber)
+{
+	LEDOutput * output = qobject_cast<LEDOutput*>(sender());
+	for (size_t i = 0; i < m_outputs.size(); ++i)
 	{
-        m_mutex.lock();
-        if (currentPortName != portName) {
-			currentPortName = portName;
-            currentPortNameChanged = true;
-        }
-		if (currentBaudrate != baudrate) {
-			currentBaudrate = baudrate;
-			currentBaudrateChanged = true;
-		}
-		if (sendData != sending) {
-			sendData = sending;
-		}
-		//get settings
-		int waitTimeout = m_waitTimeout;
-		const int width = displayWidth;
-		const int height = displayHeight;
-		const bool horizontal = flipHorizontal;
-		const bool vertical = flipVertical;
-		const ScanlineDirection direction = scanlineDirection;
-		//convert image to format
-		QImage dataImage;
-		if (m_displayImage.format() != QImage::Format_ARGB32
-			&& m_displayImage.format() != QImage::Format_ARGB32_Premultiplied
-			&& m_displayImage.format() != QImage::Format_RGB32)
+		if (m_outputs[i].get() == output)
 		{
-			dataImage = m_displayImage.convertToFormat(QImage::Format_ARGB32);
-		}
-		else {
-			dataImage = m_displayImage;//.rgbSwapped();
-		}
-		m_mutex.unlock();
-		//check if we have data and display setup is ok
-		if (!dataImage.isNull() && width > 0 && height > 0)
-		{
-			//convert image to proper size
-			if (dataImage.width() != width || dataImage.height() != height)
-			{
-				dataImage = dataImage.scaled(width, height, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
-			}
-			//flip image according to settings
-			if (horizontal || vertical)
-			{
-				dataImage = dataImage.mirrored(horizontal, vertical);
-			}
-			//set up display parameters
-			const unsigned int count = width * height;
-			const unsigned char hi = (count >> 8) & 0xFF;
-			const unsigned char lo = count & 0xFF;
-			const unsigned char checksum = hi ^ lo ^ 0x55;
-			//store display parameters in data
-			data.clear();
-			data.append(QString("Ada").toLatin1());
-			data.append(hi);
-			data.append(lo);
-			data.append(checksum);
-			//convert image for diplay. get initial scan line direction
-			int stepDirection = ((direction == ConstantRightToLeft) || (direction == AlternatingStartRight)) ? 4 : -4;
-			for (int y = 0; y < dataImage.height(); ++y)
-			{
-				const unsigned char * scanLine = dataImage.constScanLine(y);
-				//loop through pixels left-right
-				if (stepDirection > 0)
-				{
-					for (int x = 0; x < dataImage.width() * 4; x += 4)
-					{
-						data.append(scanLine[x + 1]);
-						data.append(scanLine[x + 2]);
-						data.append(scanLine[x]);
-					}
-				}
-				else
-				{
-					for (int x = (dataImage.width() - 1) * 4; x >= 0; x -= 4)
-					{
-						data.append(scanLine[x + 1]);
-						data.append(scanLine[x + 2]);
-						data.append(scanLine[x]);
-					}
-				}
-				//if we have alternating lines, flip direction after every line
-				if ((direction == AlternatingStartLeft) || (direction == AlternatingStartRight))
-				{
-					stepDirection = -stepDirection;
-				}
-			}
-		}
-		//open new serial port device
-		if (currentPortNameChanged)
-		{
-			//close old port down
-			serial.close();
-			sending = false;
-			portName = currentPortName;
-			currentPortNameChanged = false;
-			//check if a proper port name was passed
-			if (!currentPortName.isEmpty())
-			{
-				serial.setPortName(currentPortName);
-				//try opening
-				if (!serial.open(QIODevice::ReadWrite))
-				{
-					emit error(tr("Can't open %1, error code %2").arg(currentPortName).arg(serial.error()));
-					emit portOpened(false);
-				}
-				else
-				{
-					//set up serial port
-					serial.setBaudRate(currentBaudrate);
-					serial.setDataBits(QSerialPort::Data8);
-					serial.setParity(QSerialPort::NoParity);
-					serial.setStopBits(QSerialPort::OneStop);
-					serial.setFlowControl(QSerialPort::NoFlowControl);
-					serial.setBreakEnabled(false);
-					emit portOpened(true);
-				}
-			}
-		}
-		if (currentBaudrateChanged)
-		{
-			serial.setBaudRate(currentBaudrate);
-			currentBaudrateChanged = false;
-			baudrate = currentBaudrate;
-		}
-		if (sendData && serial.isOpen() && serial.isWritable() && data.size() > 0)
-		{
-			//read some data from the device so serial port is not overrun
-			serial.readAll();
-			//now write request
-			serial.write(data);
-			if (serial.waitForBytesWritten(waitTimeout)) {
-				emit response("Sent");
-			}
-			else {
-				emit timeout(tr("Wait write request timeout %1").arg(QTime::currentTime().toString()));
-			}
-		}
-        m_mutex.lock();
-        m_condition.wait(&m_mutex);
-		if (m_quit)
-		{
-			m_mutex.unlock();
+			emit statisticsChanged(i, output->targetName(), bytesPerFrame, framesPerSecond, droppedFrames, lateFrames, m_frameNumber - frameNumber);
 			break;
 		}
-		m_mutex.unlock();
-    }
+	}
 }
@@ -2,16 +2,24 @@
 
 #include "Parameters.h"
 #include "ParameterScanlineDirection.h"
+#include "LEDOutput.h"
+#include "SerialOutput.h"
+#include "DisplayEncoder.h"
+#include "ShowRecorder.h"
 
-#include <QThread>
-#include <QMutex>
-#include <QWaitCondition>
+#include <QObject>
 #include <QImage>
 #include <QDomDocument>
 #include <QStringList>
+#include <vector>
 
 
-class DisplayThread : public QThread
+/// @brief Sends display images to the LED controllers.
+/// The display can be split into segments of LED strip rows. Each segment is sent to its own controller
+/// by its own LEDOutput thread, so the throughput scales with the number of controllers.
+/// The first segment is a serial port using portName and baudrate. Further segments are read from "Segment" elements
+/// in the settings. Their "type" attribute selects a SerialOutput ("serial", the default) or a NetworkOutput ("network").
+class DisplayThread : public QObject
 {
     Q_OBJECT
 
@@ -36,28 +44,86 @@ public:
 	ParameterBool flipHorizontal;
 	ParameterBool flipVertical;
 	ParameterScanlineDirection scanlineDirection;
+	ParameterBool compressedProtocol;
+	ParameterInt keyFrameInterval;
+	/// @brief Render frames as fast as the outputs can send them instead of using displayInterval.
+	ParameterBool adaptivePacing;
 	ParameterBool sending;
 
-    void sendImage(const QImage &displayImage, int m_waitTimeout = 100);
+	/// @brief Send an image to all segments. Every segment only keeps the latest image. If the previous image
+	/// has not been sent yet when a new one arrives, it is dropped.
+	/// @param displayImage Image to send.
+	/// @param stripOrder Pass true if the image is one row holding the LED colors in strip order, e.g. sampled from an LED layout.
+	/// The display size, flipping and scanline direction are ignored then and segments are split by LEDs instead of rows.
+	/// @param highDepthData Optional colors of displayImage with 16bit precision, see ColorTable::apply16().
+	/// They are temporally dithered to 8bit by every output, which gives smoother dark gradients at the same data rate.
+	/// @param timing Times the image passed the stages before, recorded in latencyStatistics().
+	/// @param waitTimeout Time to wait for the data to be written in addition to its transmission time.
+    void sendImage(const QImage &displayImage, bool stripOrder = false, const QVector<quint16> & highDepthData = QVector<quint16>(), FrameTiming timing = FrameTiming(), int m_waitTimeout = 100);
+
+	/// @brief Start recording the LED colors of all frames sent to a show file, which can be played back using ShowPlayer.
+	/// @throw std::runtime_error if the file can not be created.
+	void startRecording(const QString & fileName);
+	/// @brief Stop recording frames.
+	void stopRecording();
+	/// @brief Check if frames are being recorded.
+	bool isRecording() const;
+
+	/// @brief Get an id for the display layout of the last image sent, which is the same for layouts with the same LED order.
+	quint32 layoutId() const;
+
+	/// @brief Get the histograms of the time frames spend in every stage from the render tick to the wire.
+	LatencyStatistics::SPtr latencyStatistics() const;
+
+	/// @brief Get the number of display segments, each sent to its own controller.
+	int segmentCount() const;
+
+	/// @brief Get the shortest frame period in milliseconds all outputs can sustain, computed from the packet size,
+	/// the link bitrate and the measured write times. Returns displayInterval if no frames were sent yet.
+	int framePeriod() const;
+
+	/// @brief Number of frames completely written, summed up for all segments.
+	int sentFrames() const;
+	/// @brief Number of frames replaced by a newer one before they could be sent, summed up for all segments.
+	int droppedFrames() const;
+	/// @brief Number of frames that took longer than displayInterval from sendImage() until they were written, summed up for all segments.
+	int lateFrames() const;
 
 signals:
 	void portOpened(bool portOpen);
     void response(const QString &s);
     void error(const QString &s);
     void timeout(const QString &s);
-
-protected:
-	void run();
+	/// @brief Emitted about once per second for every segment.
+	/// @param segment Index of the segment.
+	/// @param portName Serial port or network host of the segment.
+	/// @param bytesPerFrame Average number of bytes sent per frame.
+	/// @param framesPerSecond Number of frames actually sent per second.
+	/// @param droppedFrames Number of frames dropped since the last report.
+	/// @param lateFrames Number of late frames since the last report.
+	/// @param frameLag Number of frames the segment is behind the latest frame passed to sendImage().
+	void statisticsChanged(int segment, const QString & portName, float bytesPerFrame, float framesPerSecond, int droppedFrames, int lateFrames, int frameLag);
+	/// @brief Emitted when all outputs have taken the last image passed to sendImage() for sending.
+	/// Rendering the next image now keeps the links busy without rendering images that would be dropped.
+	void readyForFrame();
 
 private slots:
 	void setSendData(bool sendData);
-	void setPortName(const QString &name);
-	void setBaudrate(int baudrate = 115200);
+	void outputStatisticsChanged(float bytesPerFrame, float framesPerSecond, int droppedFrames, int lateFrames, quint32 frameNumber);
+	void outputFrameTaken(quint32 frameNumber);
 
 private:
-    QImage m_displayImage;
-    int m_waitTimeout;
-    QMutex m_mutex;
-    QWaitCondition m_condition;
-    bool m_quit;
+	/// @brief Add a new segment output and connect its signals.
+	void addOutput(LEDOutput::SPtr output);
+
+	std::vector<LEDOutput::SPtr> m_outputs;
+	LatencyStatistics::SPtr m_latency;
+	quint32 m_frameNumber;
+	int m_outputsReady;
+	quint32 m_layoutId;
+	/// @brief Settings of the last frame sent. m_layoutId is only rebuilt when the layout in them changes.
+	OutputSettings m_layoutSettings;
+	ShowRecorder m_recorder;
+	/// @brief Encoder converting images to LED colors in strip order for recording.
+	DisplayEncoder m_recordEncoder;
 };
@@ -0,0 +1,313 @@
+#include "HeadlessRunner.h"
+#include "ScriptLibrary.h"
+
+#include <QFile>
+#include <QDomDocument>
+#include <QDebug>
+#include <csignal>
+#include <stdexcept>
+
+
+//set by the SIGINT handler and polled by a timer, because Qt must not be called from a signal handler
+static volatile std::sig_atomic_t s_interrupted = 0;
+
+static void interruptHandler(int)
+{
+	s_interrupted = 1;
+}
+
+HeadlessRunner::HeadlessRunner(QObject * parent)
+	: QObject(parent)
+	, frameBufferWidth("frameBufferWidth", 128, 32, 1024)
+	, frameBufferHeight("frameBufferHeight", 72, 32, 1024)
+	, matchDisplaySize("matchDisplaySize", false)
+	, supersampling("supersampling", 2, 1, 4)
+	, deckCount("deckCount", 2, 1, DisplayMixer::MaxDeckCount)
+	, m_renderClock(&m_renderThread)
+	, m_runTime(0)
+	, m_frames(0)
+	, m_renderTime(0)
+	, m_convertTime(0)
+	, m_maxJitter(0)
+	, m_averageJitterSum(0)
+	, m_jitterReports(0)
+	, m_missedTicks(0)
+{
+	m_durationTimer.setSingleShot(true);
+	connect(&m_interruptTimer, SIGNAL(timeout()), this, SLOT(checkInterrupted()));
+	connect(&m_durationTimer, SIGNAL(timeout()), this, SLOT(stop()));
+	connect(&m_renderThread, SIGNAL(frameRendered()), this, SLOT(frameRendered()));
+	connect(&m_renderThread, SIGNAL(scriptErrors(int, const QString &)), this, SLOT(scriptErrors(int, const QString &)));
+	connect(&m_renderClock, SIGNAL(statisticsChanged(float, float, float, int)), this, SLOT(renderClockStatisticsChanged(float, float, float, int)));
+	connect(&displayThread, SIGNAL(readyForFrame()), this, SLOT(outputsReadyForFrame()));
+	connect(&displayImageConverter, SIGNAL(displayImageChanged(const QImage &)), this, SLOT(sendDisplayImage(const QImage &)));
+}
+
+HeadlessRunner::~HeadlessRunner()
+{
+	m_renderClock.setTicking(false);
+}
+
+void HeadlessRunner::loadSettings(const QString & fileName)
+{
+	QDomDocument doc("NerDisco");
+	QFile file(fileName);
+	if (!file.open(QIODevice::ReadOnly))
+	{
+		throw std::runtime_error(QString("Failed to open settings file \"%1\"!").arg(fileName).toStdString());
+	}
+	QString errorMessage;
+	if (!doc.setContent(&file, &errorMessage))
+	{
+		throw std::runtime_error(QString("Error reading \"%1\": %2").arg(fileName).arg(errorMessage).toStdString());
+	}
+	QDomElement root = doc.documentElement();
+	//read render size from the general settings
+	QDomElement general = root.firstChildElement("General");
+	if (general.isNull())
+	{
+		throw std::runtime_error("No general settings found!");
+	}
+	frameBufferWidth.fromXML(general);
+	frameBufferHeight.fromXML(general);
+	try
+	{
+		deckCount.fromXML(general);
+	}
+	catch (std::runtime_error e)
+	{
+		//settings of older versions have two decks
+	}
+	try
+	{
+		matchDisplaySize.fromXML(general);
+		supersampling.fromXML(general);
+	}
+	catch (std::runtime_error e)
+	{
+		//settings of older versions render in the frame buffer size
+		matchDisplaySize = false;
+	}
+	//other factors do not resolve evenly in the mixer, see MainWindow::fromXML()
+	if (supersampling != Supersampling1x && supersampling != Supersampling2x && supersampling != Supersampling4x)
+	{
+		supersampling = Supersampling2x;
+	}
+	//converter and display read their own settings, including crossfade value, layout and outputs
+	displayImageConverter.fromXML(root);
+	displayThread.fromXML(root);
+	//render in the display size like MainWindow::updateRenderSize() if set
+	m_renderSize = matchDisplaySize ? QSize(displayImageConverter.displayWidth, displayImageConverter.displayHeight) * (int)supersampling : QSize(frameBufferWidth, frameBufferHeight);
+	//pass scripts of the decks to the render thread, which compiles them
+	m_renderThread.setRenderSize(m_renderSize);
+	m_renderThread.setDeckCount(deckCount);
+	QVector<DeckLayer> layers;
+	for (int i = 0; i < deckCount; ++i)
+	{
+		//decks are named like MainWindow names them
+		layers.append(loadDeck(root, "Deck" + QString(QChar('A' + i)), i));
+	}
+	displayImageConverter.setLayers(layers);
+}
+
+DeckLayer HeadlessRunner::loadDeck(const QDomElement & root, const QString & name, int deckIndex)
+{
+	//try to find element of deck in document
+	QDomNodeList decks = root.elementsByTagName("Deck");
+	for (int j = 0; j < decks.size(); ++j)
+	{
+		QDomElement child = decks.at(j).toElement();
+		if (!child.isNull() && child.attribute("name") == name)
+		{
+			//found. read values
+			ParameterInt valueA("valueA", 0, 0, 100);
+			ParameterInt valueB("valueB", 0, 0, 100);
+			ParameterInt valueC("valueC", 0, 0, 100);
+			ParameterInt valueD("valueD", 0, 0, 100);
+			ParameterBool triggerA("triggerA", false);
+			ParameterBool triggerB("triggerB", false);
+			valueA.fromXML(child);
+			valueB.fromXML(child);
+			valueC.fromXML(child);
+			valueD.fromXML(child);
+			triggerA.fromXML(child);
+			triggerB.fromXML(child);
+			QMap<QString, float> values;
+			values[valueA.name()] = valueA.normalizedValue();
+			values[valueB.name()] = valueB.normalizedValue();
+			values[valueC.name()] = valueC.normalizedValue();
+			values[valueD.name()] = valueD.normalizedValue();
+			values[triggerA.name()] = triggerA ? 1.0f : 0.0f;
+			values[triggerB.name()] = triggerB ? 1.0f : 0.0f;
+			//read script after settings, so values defined in scripts will be set
+			const QString path = child.attribute("currentScriptPath");
+			QFile file(path);
+			if (!file.open(QFile::ReadOnly))
+			{
+				throw std::runtime_error(QString("Failed to read script \"%1\"!").arg(path).toStdString());
+			}
+			QByteArray data = file.readAll();
+			QString script = data;
+			//find any variables in comments
+			for (auto parameter : ScriptLibrary::parseParameters(data))
+			{
+				if (values.contains(parameter.first))
+				{
+					bool ok = false;
+					const float value = parameter.second.toFloat(&ok);
+					if (ok)
+					{
+						values[parameter.first] = value;
+					}
+				}
+			}
+			//if the script has been modified, the text in the settings is used like in the editor
+			if (child.attribute("scriptModified", "0").toUInt())
+			{
+				script = child.attribute("currentText");
+			}
+			//store values by uniform handle, so they need not be looked up by name for every frame.
+			//they do not change while running, time is passed by the render clock
+			QVector<float> deckValues;
+			for (auto iter = values.cbegin(); iter != values.cend(); ++iter)
+			{
+				const int handle = m_renderThread.uniformHandle(iter.key());
+				if (handle >= deckValues.size())
+				{
+					deckValues.resize(handle + 1);
+				}
+				deckValues[handle] = iter.value();
+			}
+			m_renderThread.setScriptValues(deckIndex, deckValues);
+			m_renderThread.setScript(deckIndex, script);
+			//settings of older versions have no layer. the decks are layered normally then
+			ParameterInt opacity("opacity", 100, 0, 100);
+			ParameterInt blendMode("blendMode", BlendNormal, 0, BlendModeCount - 1);
+			DeckLayer layer;
+			try
+			{
+				opacity.fromXML(child);
+				blendMode.fromXML(child);
+				layer.opacity = opacity.normalizedValue();
+				layer.blendMode = (BlendMode)qBound(0, (int)blendMode, BlendModeCount - 1);
+			}
+			catch (std::runtime_error e)
+			{
+			}
+			return layer;
+		}
+	}
+	throw std::runtime_error(QString("No settings found for deck \"%1\"!").arg(name).toStdString());
+}
+
+void HeadlessRunner::start(int seconds)
+{
+	s_interrupted = 0;
+	std::signal(SIGINT, interruptHandler);
+	m_frames = 0;
+	m_renderTime = 0;
+	m_convertTime = 0;
+	m_runTime = 0;
+	m_maxJitter = 0;
+	m_averageJitterSum = 0;
+	m_jitterReports = 0;
+	m_missedTicks = 0;
+	displayThread.latencyStatistics()->reset();
+	m_clock.start();
+	m_renderThread.setMixSettings(displayImageConverter.mixSettings());
+	m_renderClock.setInterval(displayThread.displayInterval);
+	m_renderClock.setTicking(true);
+	m_interruptTimer.start(100);
+	if (seconds > 0)
+	{
+		m_durationTimer.start(seconds * 1000);
+	}
+}
+
+void HeadlessRunner::stop()
+{
+	if (m_clock.isValid())
+	{
+		m_renderClock.setTicking(false);
+		m_interruptTimer.stop();
+		m_durationTimer.stop();
+		m_runTime = m_clock.nsecsElapsed() / 1000;
+		m_clock.invalidate();
+		std::signal(SIGINT, SIG_DFL);
+		emit finished();
+	}
+}
+
+void HeadlessRunner::outputsReadyForFrame()
+{
+	if (m_clock.isValid() && displayThread.adaptivePacing)
+	{
+		//render the next frame now, so it is ready when the links are free again.
+		//the clock schedules the following ticks from now, so it does not trigger an extra frame in between
+		m_renderClock.tickNow(qMax((int)displayThread.displayInterval, 2 * displayThread.framePeriod()));
+	}
+}
+
+void HeadlessRunner::checkInterrupted()
+{
+	if (s_interrupted)
+	{
+		stop();
+	}
+}
+
+void HeadlessRunner::frameRendered()
+{
+	RenderedFrame frame = m_renderThread.takeFrame();
+	if (!m_clock.isValid())
+	{
+		return;
+	}
+	//mix and convert. this calls sendDisplayImage()
+	m_frameTiming = frame.timing;
+	displayImageConverter.convertMixed(frame.displayImage, frame.previewImage, frame.corrected);
+	m_renderTime += m_frameTiming.time[FrameTiming::Rendered] - m_frameTiming.time[FrameTiming::Tick];
+	if (m_frameTiming.time[FrameTiming::Converted] != 0)
+	{
+		m_convertTime += m_frameTiming.time[FrameTiming::Converted] - m_frameTiming.time[FrameTiming::Rendered];
+	}
+	++m_frames;
+}
+
+void HeadlessRunner::scriptErrors(int deck, const QString & errors)
+{
+	qWarning() << "Failed to compile script for deck" << deck << ":" << errors;
+	stop();
+}
+
+void HeadlessRunner::sendDisplayImage(const QImage & image)
+{
+	m_frameTiming.mark(FrameTiming::Converted);
+	displayThread.sendImage(image, displayImageConverter.hasLayout(), displayImageConverter.highDepthData(), m_frameTiming);
+}
+
+void HeadlessRunner::renderClockStatisticsChanged(float /*ticksPerSecond*/, float averageJitter, float maxJitter, int missedTicks)
+{
+	if (m_clock.isValid())
+	{
+		m_averageJitterSum += averageJitter;
+		++m_jitterReports;
+		m_maxJitter = qMax(m_maxJitter, maxJitter);
+		m_missedTicks += missedTicks;
+	}
+}
+
+QString HeadlessRunner::summary() const
+{
+	const qint64 runTime = m_clock.isValid() ? m_clock.nsecsElapsed() / 1000 : m_runTime;
+	const double seconds = runTime / 1000000.0;
+	const double frames = qMax(m_frames, 1);
+	QString result;
+	result += QString("Rendered %1 frames of %2 decks with %3x%4 pixels in %5 s, %6 frames/s\n").arg(m_frames).arg((int)deckCount).arg(m_renderSize.width()).arg(m_renderSize.height())
+		.arg(seconds, 0, 'f', 1).arg(seconds > 0.0 ? m_frames / seconds : 0.0, 0, 'f', 1);
+	result += QString("Average time per frame: render %1 ms, convert %2 ms\n").arg(m_renderTime / frames / 1000.0, 0, 'f', 2).arg(m_convertTime / frames / 1000.0, 0, 'f', 2);
+	result += QString("Render clock jitter: %1 ms average, %2 ms max, %3 ticks missed\n").arg(m_jitterReports > 0 ? m_averageJitterSum / m_jitterReports : 0.0f, 0, 'f', 3).arg(m_maxJitter, 0, 'f', 3).arg(m_missedTicks);
+	result += QString("Display: %1 frames sent, %2 dropped, %3 late\n").arg(displayThread.sentFrames()).arg(displayThread.droppedFrames()).arg(displayThread.lateFrames());
+	result += displayThread.latencyStatistics()->summary();
+	return result;
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include "Parameters.h"
+#include "RenderThread.h"
+#include "RenderClock.h"
+#include "DisplayImageConverter.h"
+#include "DisplayThread.h"
+#include "LatencyStatistics.h"
+
+#include <QObject>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QDomElement>
+
+
+/// @brief Runs the render and output pipeline without a GUI. All decks are rendered offscreen and layered by RenderThread,
+/// converted by DisplayImageConverter and sent by DisplayThread, using the settings of the GUI.
+/// Used for benchmarking and for running on machines without a display, see "--headless" in NerDisco.cpp.
+class HeadlessRunner : public QObject
+{
+	Q_OBJECT
+
+public:
+	HeadlessRunner(QObject * parent = NULL);
+	~HeadlessRunner();
+
+	/// @brief Read settings from a settings file written by the GUI and pass the deck scripts to the render thread.
+	/// Scripts are compiled in the render thread. If one fails to compile, a warning is printed and stop() is called.
+	/// @throw std::runtime_error if the file can not be read, settings are missing or a script can not be read.
+	void loadSettings(const QString & fileName);
+
+	/// @brief Start rendering and sending frames.
+	/// @param seconds Time to run for. Pass 0 to run until stop() is called or SIGINT is received.
+	void start(int seconds = 0);
+
+	/// @brief Get the number of frames rendered, the frame rate, stage times and the latency statistics as text.
+	QString summary() const;
+
+	ParameterInt frameBufferWidth;
+	ParameterInt frameBufferHeight;
+	ParameterBool matchDisplaySize;
+	ParameterInt supersampling;
+	ParameterInt deckCount;
+
+	DisplayImageConverter displayImageConverter;
+	DisplayThread displayThread;
+
+public slots:
+	/// @brief Stop rendering and emit finished().
+	void stop();
+
+signals:
+	/// @brief Emitted when rendering has stopped.
+	void finished();
+
+private slots:
+	void checkInterrupted();
+	void frameRendered();
+	void scriptErrors(int deck, const QString & errors);
+	void outputsReadyForFrame();
+	void sendDisplayImage(const QImage & image);
+	void renderClockStatisticsChanged(float ticksPerSecond, float averageJitter, float maxJitter, int missedTicks);
+
+private:
+	/// @brief Read the script and values of a deck like Deck::fromXML() and pass the script to the render thread.
+	/// @return Opacity and blend mode of the deck.
+	/// @throw std::runtime_error if the deck settings are missing or the script can not be read.
+	DeckLayer loadDeck(const QDomElement & root, const QString & name, int deckIndex);
+
+	RenderThread m_renderThread;
+	/// @brief Size the decks are rendered in. Either the frame buffer size or the display size times supersampling.
+	QSize m_renderSize;
+	/// @brief Ticks the render thread. Must be destroyed before the render thread.
+	RenderClock m_renderClock;
+	QTimer m_interruptTimer;
+	QTimer m_durationTimer;
+	QElapsedTimer m_clock;
+	qint64 m_runTime;
+	FrameTiming m_frameTiming;
+	int m_frames;
+	/// @brief Sums of the time spent rendering and converting frames in microseconds.
+	qint64 m_renderTime;
+	qint64 m_convertTime;
+	/// @brief Jitter statistics of the render clock. Jitter in ms.
+	float m_maxJitter;
+	float m_averageJitterSum;
+	int m_jitterReports;
+	int m_missedTicks;
+};
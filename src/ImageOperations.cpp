@@ -1,7 +1,174 @@
 #include "ImageOperations.h"
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	#include <immintrin.h>
+	#define IMAGEOPERATIONS_AVX2
+#endif
 
-QImage & changeImage(QImage & image, float brightness, float contrast, float gamma)
+
+//apply byte position tables to 32bit pixels. the byte at position 3 is alpha and is kept
+static void applyTable32(quint32 * pixels, int count, const quint32 (&table)[3][256])
+{
+	for (int i = 0; i < count; ++i)
+	{
+		const quint32 pixel = pixels[i];
+		pixels[i] = (pixel & 0xFF000000) | table[0][pixel & 0xFF] | table[1][(pixel >> 8) & 0xFF] | table[2][(pixel >> 16) & 0xFF];
+	}
+}
+
+//set to false to use the scalar loop even if the CPU supports AVX2, see ColorTable::setVectorized()
+static bool s_vectorized = true;
+
+#ifdef IMAGEOPERATIONS_AVX2
+__attribute__((target("avx2")))
+static void applyTable32AVX2(quint32 * pixels, int count, const quint32 (&table)[3][256])
+{
+	const __m256i byteMask = _mm256_set1_epi32(0xFF);
+	const __m256i alphaMask = _mm256_set1_epi32(0xFF000000);
+	int i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		const __m256i pixel = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(pixels + i));
+		//split pixels into byte indices and look up all three in parallel
+		const __m256i index0 = _mm256_and_si256(pixel, byteMask);
+		const __m256i index1 = _mm256_and_si256(_mm256_srli_epi32(pixel, 8), byteMask);
+		const __m256i index2 = _mm256_and_si256(_mm256_srli_epi32(pixel, 16), byteMask);
+		__m256i result = _mm256_and_si256(pixel, alphaMask);
+		result = _mm256_or_si256(result, _mm256_i32gather_epi32(reinterpret_cast<const int *>(table[0]), index0, 4));
+		result = _mm256_or_si256(result, _mm256_i32gather_epi32(reinterpret_cast<const int *>(table[1]), index1, 4));
+		result = _mm256_or_si256(result, _mm256_i32gather_epi32(reinterpret_cast<const int *>(table[2]), index2, 4));
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(pixels + i), result);
+	}
+	//do the rest of the pixels
+	applyTable32(pixels + i, count - i, table);
+}
+
+static bool hasAVX2()
+{
+	static const bool supported = __builtin_cpu_supports("avx2");
+	return supported;
+}
+#endif
+
+static void applyTable32Line(quint32 * pixels, int count, const quint32 (&table)[3][256])
+{
+#ifdef IMAGEOPERATIONS_AVX2
+	if (s_vectorized && hasAVX2())
+	{
+		applyTable32AVX2(pixels, count, table);
+		return;
+	}
+#endif
+	applyTable32(pixels, count, table);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+ColorTable::ColorTable()
+	: m_brightness(0.0f)
+	, m_contrast(1.0f)
+	, m_gamma(1.0f)
+{
+	build();
+}
+
+bool ColorTable::set(float brightness, float contrast, float gamma)
+{
+	if (brightness == m_brightness && contrast == m_contrast && gamma == m_gamma)
+	{
+		return false;
+	}
+	m_brightness = brightness;
+	m_contrast = contrast;
+	m_gamma = gamma;
+	build();
+	return true;
+}
+
+void ColorTable::build()
+{
+	for (int i = 0; i < 256; ++i)
+	{
+		//same as change() from ColorOperations.h, but without passing negative values to pow()
+		float v = i / 255.0f;
+		v = v + m_brightness;
+		v = ((v - 0.5f) * m_contrast) + 0.5f;
+		v = std::pow(kClamp(v, 0.0f, 1.0f), m_gamma);
+		const quint16 value16 = (quint16)kClamp(v * 65535.0f + 0.5f, 0.0f, 65535.0f);
+		const unsigned char value = (value16 + 128) / 257;
+		m_table16[Red][i] = value16;
+		m_table16[Green][i] = value16;
+		m_table16[Blue][i] = value16;
+		m_table[Red][i] = value;
+		m_table[Green][i] = value;
+		m_table[Blue][i] = value;
+	}
+	for (int i = 0; i < 256; ++i)
+	{
+		//QRgb is 0xAARRGGBB
+		m_argbTable[0][i] = m_table[Blue][i];
+		m_argbTable[1][i] = (quint32)m_table[Green][i] << 8;
+		m_argbTable[2][i] = (quint32)m_table[Red][i] << 16;
+		//RGBA8888 is stored as bytes R, G, B, A, which is 0xAABBGGRR on little-endian machines
+		m_rgbaTable[0][i] = m_table[Red][i];
+		m_rgbaTable[1][i] = (quint32)m_table[Green][i] << 8;
+		m_rgbaTable[2][i] = (quint32)m_table[Blue][i] << 16;
+	}
+}
+
+void ColorTable::setVectorized(bool enabled)
+{
+	s_vectorized = enabled;
+}
+
+bool ColorTable::isVectorized()
+{
+#ifdef IMAGEOPERATIONS_AVX2
+	return s_vectorized && hasAVX2();
+#else
+	return false;
+#endif
+}
+
+unsigned char ColorTable::value(Channel channel, unsigned char value) const
+{
+	return m_table[channel][value];
+}
+
+quint16 ColorTable::value16(Channel channel, unsigned char value) const
+{
+	return m_table16[channel][value];
+}
+
+void ColorTable::apply16(const QImage & image, QVector<quint16> & data) const
+{
+	if (image.format() != QImage::Format_ARGB32
+		&& image.format() != QImage::Format_ARGB32_Premultiplied
+		&& image.format() != QImage::Format_RGB32)
+	{
+		apply16(image.convertToFormat(QImage::Format_ARGB32), data);
+		return;
+	}
+	const int stride = image.bytesPerLine() / 4;
+	if (data.size() != 3 * stride * image.height())
+	{
+		data.resize(3 * stride * image.height());
+	}
+	quint16 * out = data.data();
+	for (int y = 0; y < image.height(); ++y)
+	{
+		const QRgb * scanLine = reinterpret_cast<const QRgb *>(image.constScanLine(y));
+		quint16 * line = out + 3 * stride * y;
+		for (int x = 0; x < image.width(); ++x, line += 3)
+		{
+			line[0] = m_table16[Red][qRed(scanLine[x])];
+			line[1] = m_table16[Green][qGreen(scanLine[x])];
+			line[2] = m_table16[Blue][qBlue(scanLine[x])];
+		}
+	}
+}
+
+QImage & ColorTable::apply(QImage & image) const
 {
 	switch (image.format())
 	{
@@ -10,22 +177,18 @@ QImage & changeImage(QImage & image, float brightness, float contrast, float gam
 		case QImage::Format_ARGB32_Premultiplied:
 			for (int y = 0; y < image.height(); ++y)
 			{
-				unsigned char * scanLine = image.scanLine(y);
-				for (int x = 0; x < image.width() * 4; x += 4)
-				{
-					scanLine[x + 1] = change(scanLine[x + 1], brightness, contrast, gamma);
-					scanLine[x + 2] = change(scanLine[x + 2], brightness, contrast, gamma);
-					scanLine[x + 3] = change(scanLine[x + 3], brightness, contrast, gamma);
-				}
+				applyTable32Line(reinterpret_cast<quint32 *>(image.scanLine(y)), image.width(), m_argbTable);
 			}
 			break;
 		case QImage::Format_RGB888:
 			for (int y = 0; y < image.height(); ++y)
 			{
 				unsigned char * scanLine = image.scanLine(y);
-				for (int x = 0; x < image.width() * 3; ++x)
+				for (int x = 0; x < image.width() * 3; x += 3)
 				{
-					scanLine[x] = change(scanLine[x], brightness, contrast, gamma);
+					scanLine[x] = m_table[Red][scanLine[x]];
+					scanLine[x + 1] = m_table[Green][scanLine[x + 1]];
+					scanLine[x + 2] = m_table[Blue][scanLine[x + 2]];
 				}
 			}
 			break;
@@ -34,15 +197,30 @@ QImage & changeImage(QImage & image, float brightness, float contrast, float gam
 		case QImage::Format_RGBA8888_Premultiplied:
 			for (int y = 0; y < image.height(); ++y)
 			{
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+				applyTable32Line(reinterpret_cast<quint32 *>(image.scanLine(y)), image.width(), m_rgbaTable);
+#else
 				unsigned char * scanLine = image.scanLine(y);
 				for (int x = 0; x < image.width() * 4; x += 4)
 				{
-					scanLine[x] = change(scanLine[x], brightness, contrast, gamma);
-					scanLine[x + 1] = change(scanLine[x + 1], brightness, contrast, gamma);
-					scanLine[x + 2] = change(scanLine[x + 2], brightness, contrast, gamma);
+					scanLine[x] = m_table[Red][scanLine[x]];
+					scanLine[x + 1] = m_table[Green][scanLine[x + 1]];
+					scanLine[x + 2] = m_table[Blue][scanLine[x + 2]];
 				}
+#endif
 			}
 			break;
+		default:
+			break;
 	}
 	return image;
-}
\ No newline at end of file
+}
+
+//-------------------------------------------------------------------------------------------------
+
+QImage & changeImage(QImage & image, float brightness, float contrast, float gamma)
+{
+	ColorTable table;
+	table.set(brightness, contrast, gamma);
+	return table.apply(image);
+}
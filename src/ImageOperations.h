@@ -2,9 +2,71 @@
 
 #include "ColorOperations.h"
 #include <QImage>
+#include <QVector>
 
 
+/// @brief Lookup tables for changing image brightness, contrast and gamma.
+/// The correction is computed once per channel value when the parameters change, so applying it to an image
+/// is a single table lookup per channel. 32bit images are processed 8 pixels at a time using AVX2 gathers
+/// if the CPU supports it, else using a scalar loop.
+class ColorTable
+{
+public:
+	enum Channel { Red = 0, Green = 1, Blue = 2 };
+
+	/// @brief Construct identity tables.
+	ColorTable();
+
+	/// @brief Set brightness, contrast and gamma for all channels. The tables are only rebuilt if the values changed.
+	/// @param brightness Brightness offset to add to image.
+	/// @param contrast Factor to multiply image by.
+	/// @param gamma Gamma factor to apply to image.
+	/// @return Returns true if the tables were rebuilt.
+	bool set(float brightness, float contrast, float gamma);
+
+	/// @brief Enable or disable the AVX2 code path for all tables, e.g. to compare it to the scalar loop.
+	/// It is enabled by default and only used if the CPU supports AVX2. Not thread-safe, set it before applying tables.
+	static void setVectorized(bool enabled);
+
+	/// @brief Returns true if 32bit images are processed using AVX2.
+	static bool isVectorized();
+
+	/// @brief Get the corrected value of a channel.
+	unsigned char value(Channel channel, unsigned char value) const;
+
+	/// @brief Get the corrected value of a channel with 16bit precision, 0-65535.
+	quint16 value16(Channel channel, unsigned char value) const;
+
+	/// @brief Apply the tables to an image.
+	/// @param image Image to change. Format_RGB32, Format_ARGB32(_Premultiplied), Format_RGB888 and Format_RGBX/RGBA8888(_Premultiplied) are supported.
+	/// Alpha values are left unchanged.
+	/// @return Updated image.
+	QImage & apply(QImage & image) const;
+
+	/// @brief Apply the tables to an image, keeping the result with 16bit precision.
+	/// Dark gradients do not collapse to a few levels then and can be reproduced by dithering the result.
+	/// @param image Image in Format_RGB32, Format_ARGB32 or Format_ARGB32_Premultiplied. Other formats are converted.
+	/// @param data Receives 3 values (red, green, blue) per pixel. Lines are (bytesPerLine() / 4) pixels long like in the 32bit image.
+	/// Reused if it already has the right size.
+	void apply16(const QImage & image, QVector<quint16> & data) const;
+
+private:
+	void build();
+
+	float m_brightness;
+	float m_contrast;
+	float m_gamma;
+	//corrected values per channel, indexed by Channel
+	unsigned char m_table[3][256];
+	quint16 m_table16[3][256];
+	//corrected values per byte position in a 32bit pixel, already shifted to that position.
+	//one set for the QRgb layout of Format_(A)RGB32 and one for the byte layout of Format_RGBA8888
+	quint32 m_argbTable[3][256];
+	quint32 m_rgbaTable[3][256];
+};
+
 /// @brief Change image brightness, contrast and gamma value.
+/// This builds a ColorTable every call. Keep a ColorTable around when processing multiple images.
 /// @param image Image to change.
 /// @param brightness Brightness offset to add to image.
 /// @param contrast Factor to multiply image by.
@@ -0,0 +1,132 @@
+#include "LEDLayout.h"
+
+#include <QFile>
+#include <QTextStream>
+#include <QStringList>
+#include <QRegExp>
+#include <QPainter>
+#include <QMap>
+#include <stdexcept>
+
+
+LEDLayout::LEDLayout()
+{
+}
+
+void LEDLayout::load(const QString & fileName)
+{
+	QFile file(fileName);
+	if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+	{
+		throw std::runtime_error(QString("Failed to open LED layout file \"%1\"!").arg(fileName).toStdString());
+	}
+	//read positions and the lines they are in, sorted by strip index
+	QMap<int, QPointF> positions;
+	QMap<int, int> lineNumbers;
+	//number of values per line. all lines must use the same format, else indices of lines without one are ambiguous
+	int valueCount = 0;
+	QTextStream stream(&file);
+	const QRegExp separators("[\\s,;]+");
+	int lineNumber = 0;
+	while (!stream.atEnd())
+	{
+		const QString line = stream.readLine().trimmed();
+		++lineNumber;
+		if (line.isEmpty() || line.startsWith('#'))
+		{
+			continue;
+		}
+		const QStringList values = line.split(separators, QString::SkipEmptyParts);
+		if (valueCount == 0)
+		{
+			valueCount = values.size();
+		}
+		else if (values.size() != valueCount && (values.size() == 2 || values.size() == 3))
+		{
+			throw std::runtime_error(QString("LED in line %1 of layout file \"%2\" has %3 values, but the LEDs before have %4!").arg(lineNumber).arg(fileName).arg(values.size()).arg(valueCount).toStdString());
+		}
+		bool okIndex = true;
+		bool okX = false;
+		bool okY = false;
+		int index = positions.size();
+		float x = 0.0f;
+		float y = 0.0f;
+		if (values.size() == 2)
+		{
+			x = values.at(0).toFloat(&okX);
+			y = values.at(1).toFloat(&okY);
+		}
+		else if (values.size() == 3)
+		{
+			index = values.at(0).toInt(&okIndex);
+			x = values.at(1).toFloat(&okX);
+			y = values.at(2).toFloat(&okY);
+		}
+		if (!okIndex || !okX || !okY || index < 0 || x < 0.0f || x > 1.0f || y < 0.0f || y > 1.0f)
+		{
+			throw std::runtime_error(QString("Invalid LED in line %1 of layout file \"%2\"!").arg(lineNumber).arg(fileName).toStdString());
+		}
+		if (positions.contains(index))
+		{
+			throw std::runtime_error(QString("Duplicate LED index %1 in line %2 of layout file \"%3\"!").arg(index).arg(lineNumber).arg(fileName).toStdString());
+		}
+		positions.insert(index, QPointF(x, y));
+		lineNumbers.insert(index, lineNumber);
+	}
+	if (positions.isEmpty())
+	{
+		throw std::runtime_error(QString("No LEDs found in layout file \"%1\"!").arg(fileName).toStdString());
+	}
+	//LEDs are sent in index order, so a gap would shift all following LEDs to the wrong positions
+	int expectedIndex = 0;
+	for (auto iter = lineNumbers.cbegin(); iter != lineNumbers.cend(); ++iter, ++expectedIndex)
+	{
+		if (iter.key() != expectedIndex)
+		{
+			throw std::runtime_error(QString("LED index %1 is missing before LED %2 in line %3 of layout file \"%4\"!").arg(expectedIndex).arg(iter.key()).arg(iter.value()).arg(fileName).toStdString());
+		}
+	}
+	m_positions = positions.values().toVector();
+}
+
+void LEDLayout::clear()
+{
+	m_positions.clear();
+}
+
+bool LEDLayout::isEmpty() const
+{
+	return m_positions.isEmpty();
+}
+
+int LEDLayout::ledCount() const
+{
+	return m_positions.size();
+}
+
+const QVector<QPointF> & LEDLayout::positions() const
+{
+	return m_positions;
+}
+
+QImage LEDLayout::drawPreview(const QImage & strip, const QSize & size) const
+{
+	QImage preview(size, QImage::Format_RGB32);
+	preview.fill(Qt::black);
+	if (strip.isNull() || size.isEmpty())
+	{
+		return preview;
+	}
+	//draw every LED as a dot at its position
+	QPainter painter(&preview);
+	painter.setRenderHint(QPainter::Antialiasing);
+	painter.setPen(Qt::NoPen);
+	const qreal radius = qMax(1.5, qMin(size.width(), size.height()) / 60.0);
+	const int count = qMin(strip.width(), m_positions.size());
+	for (int i = 0; i < count; ++i)
+	{
+		painter.setBrush(QColor(strip.pixel(i, 0)));
+		painter.drawEllipse(QPointF(m_positions.at(i).x() * size.width(), m_positions.at(i).y() * size.height()), radius, radius);
+	}
+	return preview;
+}
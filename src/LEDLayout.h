@@ -0,0 +1,45 @@
+#pragma once
+
+#include <QImage>
+#include <QPointF>
+#include <QSize>
+#include <QString>
+#include <QVector>
+
+
+/// @brief Positions of LEDs that are not arranged in a rectangular grid, e.g. strips laid out in curves or rings.
+/// A layout file is a text file with one LED per line, either as "x y" with the LEDs in strip order
+/// or as "index x y" with index being the position of the LED in the strip starting at 0. All lines must use the same format
+/// and the indices must cover 0 to the number of LEDs - 1 without gaps or duplicates.
+/// x and y are normalized positions in [0,1] with (0,0) being the top-left corner of the image.
+/// Values can be separated by spaces, tabs, commas or semicolons. Lines starting with '#' are comments.
+class LEDLayout
+{
+public:
+	LEDLayout();
+
+	/// @brief Load LED positions from a layout file.
+	/// @param fileName Path to layout file.
+	/// @throw std::runtime_error naming the line if the file can not be read or is invalid. The current layout is kept then.
+	void load(const QString & fileName);
+
+	/// @brief Remove all LEDs.
+	void clear();
+
+	/// @brief Check if the layout contains any LEDs.
+	bool isEmpty() const;
+
+	/// @brief Get the number of LEDs in the layout.
+	int ledCount() const;
+
+	/// @brief Get the normalized LED positions in strip order. The mixed decks are sampled at them, see DisplayMixer::setSamplePositions().
+	const QVector<QPointF> & positions() const;
+
+	/// @brief Draw the LEDs at their positions for previewing.
+	/// @param strip Image with LED colors in strip order, as sampled at positions().
+	/// @param size Size of the preview image.
+	QImage drawPreview(const QImage & strip, const QSize & size) const;
+
+private:
+	QVector<QPointF> m_positions;
+};
@@ -0,0 +1,296 @@
+#include "LEDOutput.h"
+#include "DisplayEncoder.h"
+
+#include <cstring>
+
+
+LEDOutput::LEDOutput(QObject *parent)
+	: QThread(parent)
+	, rows("rows", 0, 0, 65535)
+	, colorMatrix("colorMatrix", "")
+	, colorGain("colorGain", "")
+	, calibrationFile("calibrationFile", "")
+	, m_frameNumber(0)
+	, m_waitTimeout(100)
+	, m_sending(false)
+	, m_quit(false)
+	, m_framePending(false)
+	, m_frameTime(0)
+	, m_settingsChanged(true)
+{
+	memset(&m_settings, 0, sizeof(m_settings));
+	m_clock.start();
+	connect(colorMatrix.GetSharedParameter().get(), SIGNAL(valueChanged(const QString &)), this, SLOT(updateCalibration()));
+	connect(colorGain.GetSharedParameter().get(), SIGNAL(valueChanged(const QString &)), this, SLOT(updateCalibration()));
+	connect(calibrationFile.GetSharedParameter().get(), SIGNAL(valueChanged(const QString &)), this, SLOT(updateCalibration()));
+}
+
+LEDOutput::~LEDOutput()
+{
+	stop();
+}
+
+void LEDOutput::stop()
+{
+	m_mutex.lock();
+	m_quit = true;
+	m_condition.wakeAll();
+	m_mutex.unlock();
+	wait();
+}
+
+void LEDOutput::toXML(QDomElement & element) const
+{
+	rows.toXML(element);
+	calibrationToXML(element);
+}
+
+LEDOutput & LEDOutput::fromXML(QDomElement & element)
+{
+	rows.fromXML(element);
+	calibrationFromXML(element);
+	return *this;
+}
+
+void LEDOutput::calibrationToXML(QDomElement & element) const
+{
+	colorMatrix.toXML(element);
+	colorGain.toXML(element);
+	calibrationFile.toXML(element);
+}
+
+void LEDOutput::calibrationFromXML(QDomElement & element)
+{
+	try
+	{
+		colorMatrix.fromXML(element);
+		colorGain.fromXML(element);
+		calibrationFile.fromXML(element);
+	}
+	catch (std::runtime_error e)
+	{
+		//settings of older versions have no calibration
+		colorMatrix = "";
+		colorGain = "";
+		calibrationFile = "";
+	}
+}
+
+void LEDOutput::updateCalibration()
+{
+	ColorCalibration::SPtr calibration = std::make_shared<ColorCalibration>();
+	try
+	{
+		calibration->setMatrix(colorMatrix);
+		calibration->setGain(colorGain);
+		calibration->loadLedFile(calibrationFile);
+	}
+	catch (const std::runtime_error & e)
+	{
+		emit error(QString::fromStdString(e.what()));
+		return;
+	}
+	//the output thread picks up the new calibration with the next frame. the old one is kept alive while it is in use
+	QMutexLocker locker(&m_mutex);
+	m_calibration = calibration;
+}
+
+void LEDOutput::wakeUp()
+{
+	if (m_quit)
+	{
+		return;
+	}
+	if (!isRunning())
+	{
+		start();
+		setPriority(QThread::HighPriority);
+	}
+	else
+		m_condition.wakeOne();
+}
+
+void LEDOutput::settingsChanged()
+{
+	m_settingsChanged = true;
+	wakeUp();
+}
+
+void LEDOutput::setSending(bool sending)
+{
+	QMutexLocker locker(&m_mutex);
+	m_sending = sending;
+	settingsChanged();
+}
+
+void LEDOutput::setLatencyStatistics(LatencyStatistics::SPtr statistics)
+{
+	QMutexLocker locker(&m_mutex);
+	m_latency = statistics;
+}
+
+void LEDOutput::sendFrame(const QImage & image, const QVector<quint16> & highDepthData, quint32 frameNumber, const FrameTiming & timing, const OutputSettings & settings, int waitTimeout)
+{
+	QMutexLocker locker(&m_mutex);
+	m_waitTimeout = waitTimeout;
+	//only the latest frame is sent. if the previous one hasn't been picked up yet, it is dropped
+	if (m_framePending)
+	{
+		m_droppedFrames.ref();
+	}
+	m_image = image;
+	m_highDepthData = highDepthData;
+	m_frameNumber = frameNumber;
+	m_timing = timing;
+	m_settings = settings;
+	m_frameTime = m_clock.elapsed();
+	m_framePending = true;
+	wakeUp();
+}
+
+int LEDOutput::sentFrames() const
+{
+	return m_sentFrames.load();
+}
+
+int LEDOutput::droppedFrames() const
+{
+	return m_droppedFrames.load();
+}
+
+int LEDOutput::lateFrames() const
+{
+	return m_lateFrames.load();
+}
+
+int LEDOutput::frameTime() const
+{
+	return qMax(m_writeTime.load(), m_transmissionTime.load());
+}
+
+int LEDOutput::transmissionTime(int /*bytes*/) const
+{
+	return 0;
+}
+
+void LEDOutput::run()
+{
+	DisplayEncoder encoder;
+	quint32 lastFrameNumber = 0;
+	QElapsedTimer statisticsTimer;
+	int statisticsFrames = 0;
+	qint64 statisticsBytes = 0;
+	int statisticsDropped = m_droppedFrames.load();
+	int statisticsLate = m_lateFrames.load();
+	statisticsTimer.start();
+
+	//m_quit is only read with m_mutex locked, the loop ends below
+	while (true)
+	{
+		m_mutex.lock();
+		//wait until there is a new frame to send or the settings changed.
+		//we only get here when the last frame has been completely written, so a pending frame is sent right away
+		while (!m_quit && !m_framePending && !m_settingsChanged)
+		{
+			m_condition.wait(&m_mutex, 1000);
+			//wake up regularly to report statistics
+			if (statisticsTimer.elapsed() >= 1000)
+			{
+				break;
+			}
+		}
+		if (m_quit)
+		{
+			m_mutex.unlock();
+			break;
+		}
+		if (m_settingsChanged)
+		{
+			takeSettings();
+			m_settingsChanged = false;
+		}
+		const bool sendData = m_sending;
+		const int waitTimeout = m_waitTimeout;
+		//take the latest frame and its settings
+		QImage dataImage;
+		QVector<quint16> highDepthData;
+		quint32 frameNumber = 0;
+		FrameTiming timing;
+		qint64 frameTime = 0;
+		OutputSettings settings = m_settings;
+		ColorCalibration::SPtr calibration = m_calibration;
+		LatencyStatistics::SPtr latency = m_latency;
+		if (m_framePending)
+		{
+			dataImage = m_image;
+			highDepthData = m_highDepthData;
+			frameNumber = m_frameNumber;
+			timing = m_timing;
+			timing.mark(FrameTiming::Taken);
+			frameTime = m_frameTime;
+			m_framePending = false;
+		}
+		m_mutex.unlock();
+		if (!dataImage.isNull())
+		{
+			emit frameTaken(frameNumber);
+		}
+		if (settings.stripOrder)
+		{
+			encoder.setStripLayout(settings.displayWidth);
+		}
+		else
+		{
+			encoder.setLayout(settings.displayWidth, settings.displayHeight, settings.flipHorizontal, settings.flipVertical, settings.scanlineDirection);
+		}
+		encoder.setRange(settings.firstLed, settings.ledCount);
+		encoder.setCompression(settings.compressedProtocol, settings.keyFrameInterval);
+		encoder.setHighDepthData(highDepthData);
+		encoder.setCalibration(calibration);
+		//open or reconfigure connection
+		prepare(encoder);
+		if (sendData && isReady() && !dataImage.isNull())
+		{
+			QElapsedTimer writeTimer;
+			writeTimer.start();
+			const int bytesSent = writeFrame(dataImage, encoder, waitTimeout);
+			if (bytesSent > 0)
+			{
+				//average write time over the last frames and store what the link should be able to do
+				const int writeTime = writeTimer.nsecsElapsed() / 1000;
+				const int averageWriteTime = m_writeTime.load();
+				m_writeTime.store(averageWriteTime > 0 ? (7 * averageWriteTime + writeTime) / 8 : writeTime);
+				m_transmissionTime.store(transmissionTime(bytesSent));
+				if (latency)
+				{
+					timing.mark(FrameTiming::Written);
+					latency->record(LatencyStatistics::Queue, timing, FrameTiming::Queued, FrameTiming::Taken);
+					latency->record(LatencyStatistics::Write, timing, FrameTiming::Taken, FrameTiming::Written);
+					latency->record(LatencyStatistics::Total, timing, FrameTiming::Tick, FrameTiming::Written);
+				}
+				m_sentFrames.ref();
+				//frames that took longer than a display interval from hand-off to the wire are late
+				if (m_clock.elapsed() - frameTime > settings.displayInterval)
+				{
+					m_lateFrames.ref();
+				}
+				lastFrameNumber = frameNumber;
+				++statisticsFrames;
+				statisticsBytes += bytesSent;
+			}
+		}
+		//report what the link actually transmits
+		if (statisticsTimer.elapsed() >= 1000)
+		{
+			const float seconds = statisticsTimer.restart() / 1000.0f;
+			const int dropped = m_droppedFrames.load();
+			const int late = m_lateFrames.load();
+			emit statisticsChanged(statisticsFrames > 0 ? (float)statisticsBytes / statisticsFrames : 0.0f, statisticsFrames / seconds, dropped - statisticsDropped, late - statisticsLate, lastFrameNumber);
+			statisticsFrames = 0;
+			statisticsBytes = 0;
+			statisticsDropped = dropped;
+			statisticsLate = late;
+		}
+	}
+	finish();
+}
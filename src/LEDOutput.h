@@ -0,0 +1,180 @@
+#pragma once
+
+#include "Parameters.h"
+#include "ParameterScanlineDirection.h"
+#include "ColorCalibration.h"
+#include "LatencyStatistics.h"
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QImage>
+#include <QVector>
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QDomDocument>
+#include <memory>
+
+class DisplayEncoder;
+
+
+/// @brief Describes which part of a display image an output sends and how.
+struct OutputSettings
+{
+	/// @brief If true the display image is one row holding the LED colors in strip order and displayWidth is the number of LEDs.
+	bool stripOrder;
+	int displayWidth;
+	int displayHeight;
+	bool flipHorizontal;
+	bool flipVertical;
+	ScanlineDirection scanlineDirection;
+	/// @brief Index of first LED sent in strip order.
+	int firstLed;
+	/// @brief Number of LEDs sent.
+	int ledCount;
+	bool compressedProtocol;
+	int keyFrameInterval;
+	/// @brief Frames taking longer than this from sendFrame() to the wire are counted as late.
+	int displayInterval;
+};
+
+/// @brief Base class for outputs sending display frames to LED controllers.
+/// Runs its own thread with exactly one frame in flight. Only the latest frame is kept, older frames are dropped.
+/// Derived classes implement the connection handling and how a frame is written.
+class LEDOutput : public QThread
+{
+	Q_OBJECT
+
+public:
+	/// brief Shared pointer of LEDOutput object.
+	typedef std::shared_ptr<LEDOutput> SPtr;
+
+	LEDOutput(QObject *parent = 0);
+	/// @brief Destructor. Derived classes must call stop() in their destructor, so the thread does not access their members anymore.
+	virtual ~LEDOutput();
+
+	/// @brief Get the type name of the output, which is stored in the settings.
+	virtual QString typeName() const = 0;
+	/// @brief Get a short description of where the output sends to, e.g. the serial port name.
+	virtual QString targetName() const = 0;
+
+	/// @brief Save the current settings to an XML element.
+	/// @param element The element to write the settings to.
+	virtual void toXML(QDomElement & element) const;
+	/// @brief Read current settings from an XML element.
+	/// @param element The element to load the settings from.
+	virtual LEDOutput & fromXML(QDomElement & element);
+
+	/// @brief Number of display rows in strip order driven by this output, or number of LEDs when an LED layout is used.
+	/// 0 means an equal share of the unassigned rows or LEDs.
+	ParameterInt rows;
+	/// @brief 3x3 color matrix applied to all LEDs of the segment, 9 values in row-major order. Empty for the identity matrix.
+	ParameterQString colorMatrix;
+	/// @brief Gain for red, green and blue applied to all LEDs of the segment after the matrix, 3 values. Empty for no change.
+	ParameterQString colorGain;
+	/// @brief File with color calibration of single LEDs, see ColorCalibration. Empty for none.
+	ParameterQString calibrationFile;
+
+	/// @brief Save the color calibration settings to an XML element.
+	void calibrationToXML(QDomElement & element) const;
+	/// @brief Read the color calibration settings from an XML element. Missing settings clear the calibration.
+	void calibrationFromXML(QDomElement & element);
+
+	/// @brief Enable or disable sending data.
+	void setSending(bool sending);
+
+	/// @brief Queue an image for sending. Only the latest image is kept. If the previous image
+	/// has not been sent yet when a new one arrives, it is dropped.
+	/// @param image Display image.
+	/// @param highDepthData Optional LED colors with 16bit precision, dithered to 8bit when sending. See DisplayEncoder::setHighDepthData().
+	/// @param frameNumber Number of the frame, shared by all outputs sending parts of the same image.
+	/// @param timing Stage times of the frame so far. The output adds the times it takes and writes the frame.
+	/// @param settings Layout and protocol settings for this frame.
+	/// @param waitTimeout Time to wait for the data to be written in addition to its transmission time.
+	void sendFrame(const QImage & image, const QVector<quint16> & highDepthData, quint32 frameNumber, const FrameTiming & timing, const OutputSettings & settings, int waitTimeout = 100);
+
+	/// @brief Set the histograms the output records the queue, write and total latency of frames sent into.
+	/// Call before the first frame is sent.
+	void setLatencyStatistics(LatencyStatistics::SPtr statistics);
+
+	/// @brief Number of frames completely written.
+	int sentFrames() const;
+	/// @brief Number of frames replaced by a newer one before they could be sent.
+	int droppedFrames() const;
+	/// @brief Number of frames that took longer than the display interval from sendFrame() until they were written.
+	int lateFrames() const;
+	/// @brief Shortest time in microseconds the output needs for a frame. This is the maximum of the measured
+	/// write time (averaged over the last frames) and the transmission time the link bitrate allows for the last frame sent.
+	/// Returns 0 if no frame was sent yet.
+	int frameTime() const;
+
+signals:
+	void portOpened(bool portOpen);
+	void response(const QString &s);
+	void error(const QString &s);
+	void timeout(const QString &s);
+	/// @brief Emitted about once per second.
+	/// @param bytesPerFrame Average number of bytes sent per frame.
+	/// @param framesPerSecond Number of frames actually sent per second.
+	/// @param droppedFrames Number of frames dropped since the last report.
+	/// @param lateFrames Number of late frames since the last report.
+	/// @param frameNumber Number of the last frame sent.
+	void statisticsChanged(float bytesPerFrame, float framesPerSecond, int droppedFrames, int lateFrames, quint32 frameNumber);
+	/// @brief Emitted when the output thread took a frame for sending, so the next frame can be prepared.
+	/// @param frameNumber Number of the frame taken.
+	void frameTaken(quint32 frameNumber);
+
+protected slots:
+	/// @brief Rebuild the color calibration from colorMatrix, colorGain and calibrationFile.
+	/// Emits error() and keeps the current calibration if the settings are invalid.
+	void updateCalibration();
+
+protected:
+	void run();
+
+	/// @brief Copy the connection settings for use in the output thread. Called from the output thread with m_mutex locked.
+	virtual void takeSettings() = 0;
+	/// @brief Open or reconfigure the connection if the settings changed and set up the encoder. Called from the output thread.
+	virtual void prepare(DisplayEncoder & encoder) = 0;
+	/// @brief Check if the connection is ready for sending. Called from the output thread.
+	virtual bool isReady() const = 0;
+	/// @brief Encode an image and write it, waiting until it has been sent. Called from the output thread.
+	/// @return The number of bytes sent or -1 if sending failed.
+	virtual int writeFrame(const QImage & image, DisplayEncoder & encoder, int waitTimeout) = 0;
+	/// @brief Close the connection, because the output thread is about to end. Called from the output thread.
+	virtual void finish() = 0;
+	/// @brief Get the time in microseconds the link needs to transmit a number of bytes. Returns 0 if unknown.
+	virtual int transmissionTime(int bytes) const;
+
+	/// @brief Signal the output thread that settings changed. Call with m_mutex locked.
+	void settingsChanged();
+	/// @brief Stop the output thread and wait for it to finish.
+	void stop();
+
+	QMutex m_mutex;
+
+private:
+	/// @brief Start thread or wake it up if it is already running.
+	void wakeUp();
+
+	QImage m_image;
+	QVector<quint16> m_highDepthData;
+	quint32 m_frameNumber;
+	FrameTiming m_timing;
+	OutputSettings m_settings;
+	int m_waitTimeout;
+	bool m_sending;
+	QWaitCondition m_condition;
+	bool m_quit;
+	bool m_framePending;
+	qint64 m_frameTime;
+	bool m_settingsChanged;
+	QElapsedTimer m_clock;
+	QAtomicInt m_sentFrames;
+	QAtomicInt m_droppedFrames;
+	QAtomicInt m_lateFrames;
+	ColorCalibration::SPtr m_calibration;
+	LatencyStatistics::SPtr m_latency;
+	QAtomicInt m_writeTime;
+	QAtomicInt m_transmissionTime;
+};
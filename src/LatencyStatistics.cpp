@@ -0,0 +1,171 @@
+#include "LatencyStatistics.h"
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QTextStream>
+#include <stdexcept>
+
+
+FrameTiming::FrameTiming()
+{
+	for (int i = 0; i < StageCount; ++i)
+	{
+		time[i] = 0;
+	}
+}
+
+void FrameTiming::mark(Stage stage)
+{
+	time[stage] = now();
+}
+
+qint64 FrameTiming::now()
+{
+	//QElapsedTimer uses a monotonic clock if the system has one. start it once, so all threads share the reference
+	static QElapsedTimer clock;
+	static bool started = (clock.start(), true);
+	Q_UNUSED(started);
+	return clock.nsecsElapsed() / 1000 + 1;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+LatencyStatistics::LatencyStatistics()
+{
+	reset();
+}
+
+int LatencyStatistics::bucketIndex(qint64 value)
+{
+	if (value < 8)
+	{
+		return value > 0 ? (int)value : 0;
+	}
+	//find highest bit set. the 3 bits below it select the bucket in that power of 2
+	int exponent = 3;
+	while (exponent < 62 && (value >> (exponent + 1)) != 0)
+	{
+		++exponent;
+	}
+	const int index = 8 * (exponent - 2) + (int)((value >> (exponent - 3)) & 7);
+	return index < BucketCount ? index : BucketCount - 1;
+}
+
+qint64 LatencyStatistics::bucketValue(int index)
+{
+	if (index < 8)
+	{
+		return index;
+	}
+	//return the middle of the bucket
+	const int exponent = index / 8 + 2;
+	const qint64 lower = (qint64)(8 + index % 8) << (exponent - 3);
+	return lower + ((qint64)1 << (exponent - 3)) / 2;
+}
+
+void LatencyStatistics::record(Interval interval, const FrameTiming & timing, FrameTiming::Stage from, FrameTiming::Stage to)
+{
+	if (timing.time[from] > 0 && timing.time[to] >= timing.time[from])
+	{
+		m_buckets[interval][bucketIndex(timing.time[to] - timing.time[from])].ref();
+	}
+}
+
+int LatencyStatistics::count(Interval interval) const
+{
+	int result = 0;
+	for (int i = 0; i < BucketCount; ++i)
+	{
+		result += m_buckets[interval][i].load();
+	}
+	return result;
+}
+
+qint64 LatencyStatistics::percentile(Interval interval, float percent) const
+{
+	const int total = count(interval);
+	if (total <= 0)
+	{
+		return 0;
+	}
+	//find bucket the percentile falls into
+	const qint64 rank = qMax((qint64)1, (qint64)((percent / 100.0f) * total + 0.5f));
+	qint64 sum = 0;
+	for (int i = 0; i < BucketCount; ++i)
+	{
+		sum += m_buckets[interval][i].load();
+		if (sum >= rank)
+		{
+			return bucketValue(i);
+		}
+	}
+	return bucketValue(BucketCount - 1);
+}
+
+void LatencyStatistics::reset()
+{
+	for (int interval = 0; interval < IntervalCount; ++interval)
+	{
+		for (int i = 0; i < BucketCount; ++i)
+		{
+			m_buckets[interval][i].store(0);
+		}
+	}
+}
+
+QString LatencyStatistics::intervalName(Interval interval)
+{
+	switch (interval)
+	{
+		case Render: return "Render";
+		case Convert: return "Convert";
+		case HandOff: return "Hand-off";
+		case Queue: return "Queue";
+		case Write: return "Write";
+		case Total: return "Total";
+		default: return "";
+	}
+}
+
+QString LatencyStatistics::summary() const
+{
+	QString result = QString("%1\t%2\t%3\t%4\t%5\n").arg("Stage", -10).arg("Frames", 8).arg("p50 [ms]", 10).arg("p95 [ms]", 10).arg("p99 [ms]", 10);
+	for (int i = 0; i < IntervalCount; ++i)
+	{
+		const Interval interval = (Interval)i;
+		result += QString("%1\t%2\t%3\t%4\t%5\n").arg(intervalName(interval), -10).arg(count(interval), 8)
+			.arg(percentile(interval, 50.0f) / 1000.0, 10, 'f', 2)
+			.arg(percentile(interval, 95.0f) / 1000.0, 10, 'f', 2)
+			.arg(percentile(interval, 99.0f) / 1000.0, 10, 'f', 2);
+	}
+	return result;
+}
+
+void LatencyStatistics::dump(const QString & fileName) const
+{
+	QFile file(fileName);
+	if (!file.open(QIODevice::WriteOnly | QIODevice::Text | QIODevice::Truncate))
+	{
+		throw std::runtime_error(QString("Failed to open \"%1\" for writing!").arg(fileName).toStdString());
+	}
+	QTextStream stream(&file);
+	stream << summary() << "\n";
+	//write histograms as "stage bucket value [us] count"
+	stream << "Stage\tBucket [us]\tFrames\n";
+	for (int interval = 0; interval < IntervalCount; ++interval)
+	{
+		for (int i = 0; i < BucketCount; ++i)
+		{
+			const int frames = m_buckets[interval][i].load();
+			if (frames > 0)
+			{
+				stream << intervalName((Interval)interval) << "\t" << bucketValue(i) << "\t" << frames << "\n";
+			}
+		}
+	}
+	stream.flush();
+	if (file.error() != QFile::NoError)
+	{
+		throw std::runtime_error(QString("Failed to write \"%1\"!").arg(fileName).toStdString());
+	}
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <QAtomicInt>
+#include <QString>
+#include <memory>
+
+
+/// @brief Times at which a display frame passed the stages of the pipeline, from the render tick to the bytes leaving the machine.
+/// All times are in microseconds of a monotonic clock shared by all threads. 0 means the stage has not been reached yet.
+struct FrameTiming
+{
+	enum Stage
+	{
+		Tick,		///< MainWindow started rendering the decks.
+		Rendered,	///< Both decks were rendered and read back.
+		Converted,	///< The deck images were mixed, scaled and corrected.
+		Queued,		///< The display image was handed to the outputs.
+		Taken,		///< An output thread took the frame for sending.
+		Written,	///< The output has written the frame to the wire.
+		StageCount
+	};
+
+	FrameTiming();
+
+	/// @brief Record the current time for a stage.
+	void mark(Stage stage);
+
+	/// @brief Get the current time of the monotonic clock used for all stages, in microseconds. Never returns 0.
+	static qint64 now();
+
+	qint64 time[StageCount];
+};
+
+
+/// @brief Histograms of the time frames spend between pipeline stages.
+/// Values are sorted into buckets on a logarithmic scale with 8 buckets per power of 2, so percentiles are
+/// accurate to about 6%. Buckets are atomic counters, so the GUI and output threads can record concurrently without locking.
+class LatencyStatistics
+{
+public:
+	/// brief Shared pointer of LatencyStatistics object.
+	typedef std::shared_ptr<LatencyStatistics> SPtr;
+
+	enum Interval
+	{
+		Render,		///< Tick -> Rendered. Rendering and framebuffer readback of both decks.
+		Convert,	///< Rendered -> Converted. Mixing, scaling and color correction.
+		HandOff,	///< Converted -> Queued. Passing the image to the outputs.
+		Queue,		///< Queued -> Taken. Waiting for the output thread to finish the previous frame.
+		Write,		///< Taken -> Written. Encoding and writing the frame.
+		Total,		///< Tick -> Written.
+		IntervalCount
+	};
+
+	LatencyStatistics();
+
+	/// @brief Record the time between two stages of a frame, if both were reached.
+	void record(Interval interval, const FrameTiming & timing, FrameTiming::Stage from, FrameTiming::Stage to);
+
+	/// @brief Get the number of values recorded for an interval.
+	int count(Interval interval) const;
+
+	/// @brief Get a percentile of the values recorded for an interval.
+	/// @param interval Interval to evaluate.
+	/// @param percent Percentile in [0,100].
+	/// @return Value in microseconds. Returns 0 if nothing was recorded.
+	qint64 percentile(Interval interval, float percent) const;
+
+	/// @brief Remove all recorded values.
+	void reset();
+
+	/// @brief Get the name of an interval.
+	static QString intervalName(Interval interval);
+
+	/// @brief Get a table with count, p50, p95 and p99 of every interval.
+	QString summary() const;
+
+	/// @brief Write the summary and all non-empty buckets to a text file.
+	/// @throw std::runtime_error if the file can not be written.
+	void dump(const QString & fileName) const;
+
+private:
+	static const int BucketCount = 8 * 23;
+
+	static int bucketIndex(qint64 value);
+	static qint64 bucketValue(int index);
+
+	QAtomicInt m_buckets[IntervalCount][BucketCount];
+};
@@ -9,8 +9,11 @@
 #include <QDir>
 #include <QFileInfo>
 #include <QMessageBox>
+#include <QFileDialog>
+#include <QFontDatabase>
 #include <QGuiApplication>
 #include <QScreen>
+#include <QStyle>
 
 
 MainWindow::MainWindow(QWidget *parent)
@@ -21,6 +24,8 @@ MainWindow::MainWindow(QWidget *parent)
 	, previewInterval("previewInterval", 33, 20, 100)
 	, frameBufferWidth("frameBufferWidth", 128, 32, 1024)
 	, frameBufferHeight("frameBufferHeight", 72, 32, 1024)
+	, matchDisplaySize("matchDisplaySize", false)
+	, supersampling("supersampling", 2, 1, 4)
 	, displayInterval("displayInterval", 50, 20, 100)
 	, displayWidth("displayWidth", 32, 16, 64)
 	, displayHeight("displayHeight", 16, 8, 32)
@@ -28,18 +33,19 @@ MainWindow::MainWindow(QWidget *parent)
 	, displayContrast("displayContrast", 0, -50, 50)
 	, displayGamma("displayGamma", 220, 100, 400)
 	, crossFadeValue("crossFadeValue", 0, 0, 100)
+	, deckCount("deckCount", 2, 1, DisplayMixer::MaxDeckCount)
+	, m_renderClock(&m_renderThread)
+	, m_supersamplingMenu(nullptr)
 {
 	//make all QOpenGLWidgets in the application share resources
 	QCoreApplication::setAttribute(Qt::AA_ShareOpenGLContexts);
 	//create GUI
 	ui->setupUi(this);
-	ui->widgetDeckA->setDeckName("DeckA");
-	ui->widgetDeckB->setDeckName("DeckB");
-	ui->widgetDeckA->setScriptPath("effects");
-	ui->widgetDeckB->setScriptPath("effects");
 	//connect preview gamma/brightness/contrast/crossfade slider to parameter and register for MIDI interaction
 	connectParameter(crossFadeValue, ui->horizontalSliderCrossfade);
 	m_midiInterface->getParameterMapping()->registerMIDIParameter(crossFadeValue.GetSharedParameter());
+	connectParameter(m_displayImageConverter.crossFadeCurve, ui->comboBoxCrossfadeCurve);
+	m_midiInterface->getParameterMapping()->registerMIDIParameter(m_displayImageConverter.crossFadeCurve.GetSharedParameter());
 	connectParameter(displayBrightness, ui->horizontalSliderBrightness);
 	connectParameter(displayContrast, ui->horizontalSliderContrast);
 	connectParameter(displayGamma, ui->horizontalSliderGamma);
@@ -65,21 +71,20 @@ MainWindow::MainWindow(QWidget *parent)
 	connect(ui->actionStoreLearnedConnection, SIGNAL(triggered()), this, SLOT(midiStoreLearnedConnection()));
 	connect(m_midiInterface->getParameterMapping(), SIGNAL(learnedConnectionStateChanged(bool)), this, SLOT(midiLearnedConnectionStateChanged(bool)));
 	//connect menu actions
-	connect(ui->actionSaveDeckA, SIGNAL(triggered()), this, SLOT(saveDeckA()));
-	connect(ui->actionSaveAsDeckA, SIGNAL(triggered()), this, SLOT(saveAsDeckA()));
-	connect(ui->actionSaveDeckB, SIGNAL(triggered()), this, SLOT(saveDeckB()));
-	connect(ui->actionSaveAsDeckB, SIGNAL(triggered()), this, SLOT(saveAsDeckB()));
+	QtSpinBoxAction * deckCountAction = new QtSpinBoxAction("Decks");
+	deckCountAction->setObjectName("deckCount");
+	ui->menuFile->insertAction(ui->actionExit, deckCountAction);
+	connectParameter(deckCount, deckCountAction->control());
+	connect(deckCount.GetSharedParameter().get(), SIGNAL(valueChanged(int)), this, SLOT(deckCountChanged(int)));
+	ui->menuFile->insertSeparator(ui->actionExit);
 	connect(ui->actionExit, SIGNAL(triggered()), this, SLOT(exitApplication()));
-	//update the menu showing the effect files
-	updateEffectMenu();
-	//connect the parameters in the decks to parameters here
-	ui->widgetDeckA->updateInterval.connect(previewInterval);
-	ui->widgetDeckA->frameBufferWidth.connect(frameBufferWidth);
-	ui->widgetDeckA->frameBufferHeight.connect(frameBufferHeight);
-	ui->widgetDeckA->updateInterval.connect(previewInterval);
-	ui->widgetDeckB->frameBufferWidth.connect(frameBufferWidth);
-	ui->widgetDeckB->frameBufferHeight.connect(frameBufferHeight);
-	updateDeckMenu();
+	//index the effect files, update the menu showing them and compile all effects in the background
+	m_scriptLibrary.setPath("effects");
+	connect(&m_scriptLibrary, SIGNAL(scriptsChanged(const QStringList &)), this, SLOT(scriptLibraryChanged()));
+	connect(&m_scriptLibrary, SIGNAL(compileStatusChanged(const QString &)), this, SLOT(scriptCompileStatusChanged(const QString &)));
+	connect(&m_renderThread, SIGNAL(scriptPrecompiled(const QString &, const QString &, float)), &m_scriptLibrary, SLOT(setCompileResult(const QString &, const QString &, float)));
+	connect(&m_renderThread, SIGNAL(precompilationFinished(int, int)), this, SLOT(precompilationFinished(int, int)));
+	scriptLibraryChanged();
 	//connect parameters for preview resolution here
 	connect(displayWidth.GetSharedParameter().get(), SIGNAL(valueChanged(int)), this, SLOT(setDisplayWidth(int)));
 	connect(displayHeight.GetSharedParameter().get(), SIGNAL(valueChanged(int)), this, SLOT(setDisplayHeight(int)));
@@ -109,26 +114,63 @@ MainWindow::MainWindow(QWidget *parent)
 	connect(m_displayThread.portName.GetSharedParameter().get(), SIGNAL(valueChanged(const QString &)), this, SLOT(displaySerialPortChanged(const QString &)));
 	connect(m_displayThread.baudrate.GetSharedParameter().get(), SIGNAL(valueChanged(int)), this, SLOT(displayBaudrateChanged(int)));
 	connect(m_displayThread.scanlineDirection.GetSharedParameter().get(), SIGNAL(valueChanged(ScanlineDirection)), this, SLOT(displayScanlineDirectionChanged(ScanlineDirection)));
-	m_displayThread.start();
+	m_displayStatisticsLabel = new QLabel(this);
+	ui->statusbar->addPermanentWidget(m_displayStatisticsLabel);
+	connect(&m_displayThread, SIGNAL(statisticsChanged(int, const QString &, float, float, int, int, int)), this, SLOT(displayStatisticsChanged(int, const QString &, float, float, int, int, int)));
+	m_renderStatisticsLabel = new QLabel(this);
+	ui->statusbar->addPermanentWidget(m_renderStatisticsLabel);
+	connect(&m_renderClock, SIGNAL(statisticsChanged(float, float, float, int)), this, SLOT(renderClockStatisticsChanged(float, float, float, int)));
+	ui->menuDisplay->addSeparator();
+	m_recordShowAction = ui->menuDisplay->addAction(tr("Record show..."));
+	m_recordShowAction->setCheckable(true);
+	connect(m_recordShowAction, SIGNAL(triggered(bool)), this, SLOT(displayRecordShow(bool)));
+	m_playShowAction = ui->menuDisplay->addAction(tr("Play show..."));
+	m_playShowAction->setCheckable(true);
+	connect(m_playShowAction, SIGNAL(triggered(bool)), this, SLOT(displayPlayShow(bool)));
+	connect(ui->menuDisplay, SIGNAL(aboutToShow()), this, SLOT(displayMenuAboutToShow()));
+	connect(&m_showPlayer, SIGNAL(frameChanged(const QImage &)), this, SLOT(showFrameChanged(const QImage &)));
+	ui->menuDisplay->addSeparator();
+	QAction * showLatencyAction = ui->menuDisplay->addAction(tr("Latency statistics..."));
+	connect(showLatencyAction, SIGNAL(triggered()), this, SLOT(displayShowLatency()));
+	QAction * saveLatencyAction = ui->menuDisplay->addAction(tr("Save latency statistics..."));
+	connect(saveLatencyAction, SIGNAL(triggered()), this, SLOT(displaySaveLatency()));
+	QAction * resetLatencyAction = ui->menuDisplay->addAction(tr("Reset latency statistics"));
+	connect(resetLatencyAction, SIGNAL(triggered()), this, SLOT(displayResetLatency()));
 	//set up output screens
 	//updateScreenMenu();
-	//retrieve settings from XML for all components
+	//retrieve settings from XML for all components. this creates the decks
 	loadSettings(m_settingsFileName);
-	//set up signal joiner that waits for both render windows being finished with rendering to grab their framebuffers
-	m_signalJoiner.addObjectToJoin(ui->widgetDeckA);
-	m_signalJoiner.addObjectToJoin(ui->widgetDeckB);
-	connect(ui->widgetDeckA, SIGNAL(renderingFinished()), &m_signalJoiner, SLOT(notify()));
-	connect(ui->widgetDeckB, SIGNAL(renderingFinished()), &m_signalJoiner, SLOT(notify()));
-	connect(&m_signalJoiner, SIGNAL(joined()), this, SLOT(grabDeckImages()));
-	//set up timer for grabbing the composite image
-	connect(&m_displayTimer, SIGNAL(timeout()), this, SLOT(updateDeckImages()));
-	m_displayTimer.start(displayInterval);
+	//render all decks in the render thread and convert the frames it publishes
+	m_renderThread.setDeckCount(m_decks.size());
+	for (int i = 0; i < m_decks.size(); ++i)
+	{
+		m_decks.at(i)->setRenderThread(&m_renderThread, i);
+	}
+	updateDeckLayers();
+	updateRenderSize();
+	connect(frameBufferWidth.GetSharedParameter().get(), SIGNAL(valueChanged(int)), this, SLOT(updateRenderSize()));
+	connect(frameBufferHeight.GetSharedParameter().get(), SIGNAL(valueChanged(int)), this, SLOT(updateRenderSize()));
+	connect(matchDisplaySize.GetSharedParameter().get(), SIGNAL(valueChanged(bool)), this, SLOT(updateRenderSize()));
+	connect(supersampling.GetSharedParameter().get(), SIGNAL(valueChanged(int)), this, SLOT(updateRenderSize()));
+	connect(supersampling.GetSharedParameter().get(), SIGNAL(valueChanged(int)), this, SLOT(displaySupersamplingChanged(int)));
+	connect(displayWidth.GetSharedParameter().get(), SIGNAL(valueChanged(int)), this, SLOT(updateRenderSize()));
+	connect(displayHeight.GetSharedParameter().get(), SIGNAL(valueChanged(int)), this, SLOT(updateRenderSize()));
+	connect(&m_renderThread, SIGNAL(frameRendered()), this, SLOT(deckFrameRendered()));
+	connect(&m_renderThread, SIGNAL(error(const QString &)), this, SLOT(renderThreadError(const QString &)));
+	m_renderThread.setMixSettings(m_displayImageConverter.mixSettings());
+	//set up the clock ticking the render thread. it runs in its own thread, so ticks do not jitter with the GUI.
+	//with adaptive pacing the next frame is rendered as soon as all outputs have started sending the last one.
+	//the clock then only keeps the preview running when not sending or when a frame was skipped
+	connect(&m_displayThread, SIGNAL(readyForFrame()), this, SLOT(displayReadyForFrame()));
+	connect(displayInterval.GetSharedParameter().get(), SIGNAL(valueChanged(int)), this, SLOT(displayIntervalChanged(int)));
+	m_renderClock.setInterval(displayInterval);
+	m_renderClock.setTicking(true);
 }
 
 MainWindow::~MainWindow()
 {
 	//stop display refresh and audio capturing
-	m_displayTimer.stop();
+	m_renderClock.setTicking(false);
 //	m_audioInterface.capturing = false;
 	//save settings to XML
 	saveSettings(m_settingsFileName);
@@ -147,6 +189,8 @@ void MainWindow::toXML(QDomElement & parent) const
 	}
 	frameBufferWidth.toXML(element);
 	frameBufferHeight.toXML(element);
+	matchDisplaySize.toXML(element);
+	supersampling.toXML(element);
 	displayInterval.toXML(element);
 	displayWidth.toXML(element);
 	displayHeight.toXML(element);
@@ -154,6 +198,7 @@ void MainWindow::toXML(QDomElement & parent) const
 	displayContrast.toXML(element);
 	displayGamma.toXML(element);
 	crossFadeValue.toXML(element);
+	deckCount.toXML(element);
 }
 
 MainWindow & MainWindow::fromXML(const QDomElement & parent)
@@ -174,6 +219,21 @@ MainWindow & MainWindow::fromXML(const QDomElement & parent)
 	displayContrast.fromXML(element);
 	displayGamma.fromXML(element);
 	crossFadeValue.fromXML(element);
+	try
+	{
+		matchDisplaySize.fromXML(element);
+		supersampling.fromXML(element);
+	}
+	catch (std::runtime_error e)
+	{
+		//settings of older versions render in the preview size
+		matchDisplaySize = false;
+	}
+	//other factors do not resolve evenly in the mixer
+	if (supersampling != Supersampling1x && supersampling != Supersampling2x && supersampling != Supersampling4x)
+	{
+		supersampling = Supersampling2x;
+	}
 	return *this;
 }
 
@@ -187,17 +247,20 @@ void MainWindow::loadSettings(const QString & fileName)
 		if (doc.setContent(&file, &errorMessage))
 		{
 			QDomElement root = doc.documentElement();
+			//decks must exist before their settings and MIDI connections to their parameters are read
 			try
 			{
-				m_displayImageConverter.fromXML(root);
+				QDomElement general = root.firstChildElement("General");
+				deckCount.fromXML(general);
 			}
 			catch (std::runtime_error e)
 			{
-				QMessageBox::information(this, tr("Failed to read settings"), tr("Error while reading settings from \"%1\". %2").arg(fileName).arg(e.what()));
+				//settings of older versions have two decks
 			}
+			createDecks();
 			try
 			{
-				m_displayThread.fromXML(root);
+				m_displayImageConverter.fromXML(root);
 			}
 			catch (std::runtime_error e)
 			{
@@ -205,7 +268,7 @@ void MainWindow::loadSettings(const QString & fileName)
 			}
 			try
 			{
-//				m_audioInterface.fromXML(root);
+				m_displayThread.fromXML(root);
 			}
 			catch (std::runtime_error e)
 			{
@@ -213,7 +276,7 @@ void MainWindow::loadSettings(const QString & fileName)
 			}
 			try
 			{
-				m_midiInterface->getDeviceInterface()->fromXML(root);
+//				m_audioInterface.fromXML(root);
 			}
 			catch (std::runtime_error e)
 			{
@@ -221,7 +284,7 @@ void MainWindow::loadSettings(const QString & fileName)
 			}
 			try
 			{
-				m_midiInterface->getParameterMapping()->fromXML(root);
+				m_midiInterface->getDeviceInterface()->fromXML(root);
 			}
 			catch (std::runtime_error e)
 			{
@@ -229,19 +292,22 @@ void MainWindow::loadSettings(const QString & fileName)
 			}
 			try
 			{
-				ui->widgetDeckA->fromXML(root);
+				m_midiInterface->getParameterMapping()->fromXML(root);
 			}
 			catch (std::runtime_error e)
 			{
 				QMessageBox::information(this, tr("Failed to read settings"), tr("Error while reading settings from \"%1\". %2").arg(fileName).arg(e.what()));
 			}
-			try
-			{
-				ui->widgetDeckB->fromXML(root);
-			}
-			catch (std::runtime_error e)
+			for (auto deck : m_decks)
 			{
-				QMessageBox::information(this, tr("Failed to read settings"), tr("Error while reading settings from \"%1\". %2").arg(fileName).arg(e.what()));
+				try
+				{
+					deck->fromXML(root);
+				}
+				catch (std::runtime_error e)
+				{
+					QMessageBox::information(this, tr("Failed to read settings"), tr("Error while reading settings from \"%1\". %2").arg(fileName).arg(e.what()));
+				}
 			}
 			try
 			{
@@ -262,6 +328,8 @@ void MainWindow::loadSettings(const QString & fileName)
 	{
 		QMessageBox::information(this, tr("Failed to read settings"), tr("Failed to open \"%1\". Using default settings.").arg(fileName));
 	}
+	//create default decks if the settings could not be read
+	createDecks();
 }
 
 void MainWindow::saveSettings(const QString & fileName)
@@ -290,8 +358,10 @@ void MainWindow::saveSettings(const QString & fileName)
 //			m_audioInterface.toXML(root);
 			m_midiInterface->getDeviceInterface()->toXML(root);
 			m_midiInterface->getParameterMapping()->toXML(root);
-			ui->widgetDeckA->toXML(root);
-			ui->widgetDeckB->toXML(root);
+			for (auto deck : m_decks)
+			{
+				deck->toXML(root);
+			}
 			toXML(root);
 			file.resize(0);
 			file.reset();
@@ -347,6 +417,7 @@ void MainWindow::resizeDisplayLabels()
 	const QSize previewSize(previewWidth, previewWidth / aspect);
 	ui->labelFinalImage->setFixedSize(previewSize);
 	ui->labelRealImage->setFixedSize(previewSize);
+	m_displayImageConverter.setPreviewSize(previewSize);
 }
 
 //-------------------------------------------------------------------------------------------------
@@ -710,6 +781,80 @@ void MainWindow::updateDisplaySettingsMenu()
 	heightAction->setObjectName("displayHeight");
 	ui->menuDisplaySettings->insertAction(ui->actionDisplayStart, heightAction);
 	connectParameter(displayHeight, heightAction->control());
+	//add render size settings
+	ui->menuDisplaySettings->insertSeparator(ui->actionDisplayStart);
+	QAction * matchSizeAction = new QAction(tr("Render in display size"), this);
+	matchSizeAction->setCheckable(true);
+	ui->menuDisplaySettings->insertAction(ui->actionDisplayStart, matchSizeAction);
+	connectParameter(matchDisplaySize, matchSizeAction);
+	//only factors resolving evenly in the mixer can be selected
+	m_supersamplingMenu = new QMenu(tr("Supersampling"), this);
+	m_supersamplingMenu->setObjectName("menuSupersampling");
+	const int factors[3] = { Supersampling1x, Supersampling2x, Supersampling4x };
+	for (int i = 0; i < 3; ++i)
+	{
+		QAction * action = m_supersamplingMenu->addAction(QString("%1x").arg(factors[i]));
+		action->setCheckable(true);
+		action->setData(factors[i]);
+		action->setChecked(factors[i] == supersampling);
+		connect(action, SIGNAL(triggered()), this, SLOT(displaySupersamplingSelected()));
+	}
+	ui->menuDisplaySettings->insertMenu(ui->actionDisplayStart, m_supersamplingMenu);
+	QAction * tentFilterAction = new QAction(tr("Tent filter"), this);
+	tentFilterAction->setCheckable(true);
+	ui->menuDisplaySettings->insertAction(ui->actionDisplayStart, tentFilterAction);
+	connectParameter(m_displayImageConverter.tentFilter, tentFilterAction);
+	//add compressed protocol settings
+	ui->menuDisplaySettings->insertSeparator(ui->actionDisplayStart);
+	QAction * compressedAction = new QAction(tr("Compressed protocol"), this);
+	compressedAction->setCheckable(true);
+	ui->menuDisplaySettings->insertAction(ui->actionDisplayStart, compressedAction);
+	connectParameter(m_displayThread.compressedProtocol, compressedAction);
+	QtSpinBoxAction * keyFrameAction = new QtSpinBoxAction("Key frame interval", "frames");
+	keyFrameAction->setObjectName("keyFrameInterval");
+	ui->menuDisplaySettings->insertAction(ui->actionDisplayStart, keyFrameAction);
+	connectParameter(m_displayThread.keyFrameInterval, keyFrameAction->control());
+	QAction * adaptiveAction = new QAction(tr("Adaptive frame rate"), this);
+	adaptiveAction->setCheckable(true);
+	ui->menuDisplaySettings->insertAction(ui->actionDisplayStart, adaptiveAction);
+	connectParameter(m_displayThread.adaptivePacing, adaptiveAction);
+	QAction * ditheringAction = new QAction(tr("Temporal dithering"), this);
+	ditheringAction->setCheckable(true);
+	ui->menuDisplaySettings->insertAction(ui->actionDisplayStart, ditheringAction);
+	connectParameter(m_displayImageConverter.temporalDithering, ditheringAction);
+	//add LED layout settings
+	ui->menuDisplaySettings->insertSeparator(ui->actionDisplayStart);
+	QAction * loadLayoutAction = new QAction(tr("Load LED layout..."), this);
+	ui->menuDisplaySettings->insertAction(ui->actionDisplayStart, loadLayoutAction);
+	connect(loadLayoutAction, SIGNAL(triggered()), this, SLOT(displayLoadLayout()));
+	QAction * clearLayoutAction = new QAction(tr("Use LED grid"), this);
+	ui->menuDisplaySettings->insertAction(ui->actionDisplayStart, clearLayoutAction);
+	connect(clearLayoutAction, SIGNAL(triggered()), this, SLOT(displayClearLayout()));
+	QtSpinBoxAction * footprintAction = new QtSpinBoxAction("LED footprint", "pixels");
+	footprintAction->setObjectName("layoutFootprint");
+	ui->menuDisplaySettings->insertAction(ui->actionDisplayStart, footprintAction);
+	connectParameter(m_displayImageConverter.layoutFootprint, footprintAction->control());
+}
+
+void MainWindow::displayLoadLayout()
+{
+	const QString fileName = QFileDialog::getOpenFileName(this, tr("Load LED layout"), m_displayImageConverter.layoutFile, tr("LED layout files (*.txt *.csv);;All files (*)"));
+	if (!fileName.isEmpty())
+	{
+		try
+		{
+			m_displayImageConverter.loadLayout(fileName);
+		}
+		catch (std::runtime_error e)
+		{
+			QMessageBox::information(this, tr("Failed to load LED layout"), e.what());
+		}
+	}
+}
+
+void MainWindow::displayClearLayout()
+{
+	m_displayImageConverter.loadLayout("");
 }
 
 void MainWindow::displaySerialPortChanged(const QString & name)
@@ -741,6 +886,18 @@ void MainWindow::displayBaudrateChanged(int rate)
 	}
 }
 
+void MainWindow::displaySupersamplingChanged(int factor)
+{
+	//check which action to select
+	if (m_supersamplingMenu)
+	{
+		for (auto action : m_supersamplingMenu->actions())
+		{
+			action->setChecked(action->data().toInt() == factor);
+		}
+	}
+}
+
 void MainWindow::displayScanlineDirectionChanged(ScanlineDirection direction)
 {
 	//check which action to select
@@ -789,6 +946,15 @@ void MainWindow::displayScanlineDirectionSelected()
 	}
 }
 
+void MainWindow::displaySupersamplingSelected()
+{
+	QAction * action = qobject_cast<QAction*>(sender());
+	if (action)
+	{
+		supersampling = action->data().toInt();
+	}
+}
+
 void MainWindow::displayStartSending(bool checked)
 {
 	m_displayThread.sending = checked;
@@ -817,6 +983,149 @@ void MainWindow::displayFlipChanged(bool horizontal, bool vertical)
 	ui->actionDisplayFlipVertical->setChecked(vertical);
 }
 
+void MainWindow::displayStatisticsChanged(int segment, const QString & portName, float bytesPerFrame, float framesPerSecond, int droppedFrames, int lateFrames, int frameLag)
+{
+	//keep one entry per segment, so a slow link is easy to spot
+	while (m_displayStatistics.size() > m_displayThread.segmentCount())
+	{
+		m_displayStatistics.removeLast();
+	}
+	while (m_displayStatistics.size() < m_displayThread.segmentCount())
+	{
+		m_displayStatistics.append(QString());
+	}
+	if (segment < m_displayStatistics.size())
+	{
+		m_displayStatistics[segment] = tr("%1: %2 bytes/frame, %3 fps, %4 dropped, %5 late, %6 behind").arg(portName.isEmpty() ? tr("None") : portName).arg(bytesPerFrame, 0, 'f', 0).arg(framesPerSecond, 0, 'f', 1).arg(droppedFrames).arg(lateFrames).arg(frameLag);
+	}
+	const double latency = m_displayThread.latencyStatistics()->percentile(LatencyStatistics::Total, 95.0f) / 1000.0;
+	m_displayStatisticsLabel->setText(tr("LED display (%1 ms/frame, p95 latency %2 ms): ").arg(m_displayThread.framePeriod()).arg(latency, 0, 'f', 1) + m_displayStatistics.join(" | "));
+}
+
+void MainWindow::renderClockStatisticsChanged(float ticksPerSecond, float averageJitter, float maxJitter, int missedTicks)
+{
+	m_renderStatisticsLabel->setText(tr("Render clock: %1 ticks/s, jitter %2 ms avg, %3 ms max, %4 missed").arg(ticksPerSecond, 0, 'f', 1).arg(averageJitter, 0, 'f', 2).arg(maxJitter, 0, 'f', 2).arg(missedTicks));
+}
+
+void MainWindow::displayShowLatency()
+{
+	QMessageBox box(QMessageBox::Information, tr("Latency statistics"), m_displayThread.latencyStatistics()->summary(), QMessageBox::Ok, this);
+	box.setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+	box.exec();
+}
+
+void MainWindow::displaySaveLatency()
+{
+	const QString fileName = QFileDialog::getSaveFileName(this, tr("Save latency statistics"), "latency.txt", tr("Text files (*.txt);;All files (*)"));
+	if (!fileName.isEmpty())
+	{
+		try
+		{
+			m_displayThread.latencyStatistics()->dump(fileName);
+		}
+		catch (std::runtime_error e)
+		{
+			QMessageBox::information(this, tr("Failed to save latency statistics"), e.what());
+		}
+	}
+}
+
+void MainWindow::displayResetLatency()
+{
+	m_displayThread.latencyStatistics()->reset();
+}
+
+void MainWindow::displayRecordShow(bool checked)
+{
+	if (checked)
+	{
+		const QString fileName = QFileDialog::getSaveFileName(this, tr("Record show"), "show.ndshow", tr("Show files (*.ndshow);;All files (*)"));
+		if (!fileName.isEmpty())
+		{
+			try
+			{
+				m_displayThread.startRecording(fileName);
+			}
+			catch (std::runtime_error e)
+			{
+				QMessageBox::information(this, tr("Failed to record show"), e.what());
+			}
+		}
+	}
+	else
+	{
+		m_displayThread.stopRecording();
+	}
+	m_recordShowAction->setChecked(m_displayThread.isRecording());
+}
+
+void MainWindow::displayPlayShow(bool checked)
+{
+	if (checked)
+	{
+		const QString fileName = QFileDialog::getOpenFileName(this, tr("Play show"), "", tr("Show files (*.ndshow);;All files (*)"));
+		if (!fileName.isEmpty())
+		{
+			try
+			{
+				m_showPlayer.open(fileName);
+				if (m_displayThread.layoutId() != 0 && m_displayThread.layoutId() != m_showPlayer.layoutId())
+				{
+					QMessageBox::information(this, tr("Different display layout"), tr("The show was recorded for a different display layout. LEDs may not be where they were when recording."));
+				}
+				//the show replaces rendering completely
+				m_renderClock.setTicking(false);
+				m_showPlayer.play(true);
+			}
+			catch (std::runtime_error e)
+			{
+				QMessageBox::information(this, tr("Failed to play show"), e.what());
+			}
+		}
+	}
+	else if (m_showPlayer.isPlaying())
+	{
+		m_showPlayer.stop();
+		m_renderClock.setTicking(true);
+	}
+	m_playShowAction->setChecked(m_showPlayer.isPlaying());
+}
+
+void MainWindow::displayMenuAboutToShow()
+{
+	//recording may have stopped because of an error
+	m_recordShowAction->setChecked(m_displayThread.isRecording());
+	m_playShowAction->setChecked(m_showPlayer.isPlaying());
+}
+
+void MainWindow::showFrameChanged(const QImage & image)
+{
+	m_displayThread.sendImage(image, true);
+	if (m_displayImageConverter.hasLayout())
+	{
+		ui->labelRealImage->setPixmap(QPixmap::fromImage(m_displayImageConverter.layoutPreview(image, ui->labelFinalImage->size())));
+	}
+}
+
+void MainWindow::displayReadyForFrame()
+{
+	if (m_showPlayer.isPlaying())
+	{
+		return;
+	}
+	if (m_displayThread.adaptivePacing)
+	{
+		//render the next frame now, so it is ready when the links are free again.
+		//the clock schedules the following ticks from now, so it does not trigger an extra frame in between
+		m_renderClock.tickNow(qMax((int)displayInterval, 2 * m_displayThread.framePeriod()));
+	}
+}
+
+void MainWindow::displayIntervalChanged(int interval)
+{
+	m_renderClock.setInterval(interval);
+}
+
 //-------------------------------------------------------------------------------------------------
 
 void MainWindow::updateScreenMenu()
@@ -833,181 +1142,269 @@ void MainWindow::updateScreenMenu()
 
 //-------------------------------------------------------------------------------------------------
 
-void MainWindow::updateDeckImages()
+void MainWindow::deckFrameRendered()
 {
-	//check if we're still waiting for one or both views to finish rendering
-	if (!m_signalJoiner.isJoining())
+	RenderedFrame frame = m_renderThread.takeFrame();
+	//settings changed in the GUI are used from the next frame on
+	m_renderThread.setMixSettings(m_displayImageConverter.mixSettings());
+	//show deck textures in live views
+	for (int i = 0; i < qMin(frame.deckTextures.size(), m_decks.size()); ++i)
 	{
-		ui->widgetDeckA->grabFramebufferAfterSwap();
-		ui->widgetDeckB->grabFramebufferAfterSwap();
-		m_signalJoiner.start();
-		ui->widgetDeckA->render();
-		ui->widgetDeckB->render();
+		m_decks.at(i)->showFrame(frame.deckTextures.at(i), frame.renderSize);
 	}
+	m_frameTiming = frame.timing;
+	m_displayImageConverter.convertMixed(frame.displayImage, frame.previewImage, frame.corrected);
 }
 
-void MainWindow::grabDeckImages()
+void MainWindow::updateRenderSize()
 {
-	m_signalJoiner.stop();
-	//grab images from the decks and convert for display
-	m_displayImageConverter.convertImages(ui->widgetDeckA->getGrabbedFramebuffer(), ui->widgetDeckB->getGrabbedFramebuffer());
+	if (matchDisplaySize)
+	{
+		//render only as many pixels as the mixer needs to resolve the LEDs
+		m_renderThread.setRenderSize(QSize(displayWidth, displayHeight) * (int)supersampling);
+	}
+	else
+	{
+		m_renderThread.setRenderSize(QSize(frameBufferWidth, frameBufferHeight));
+	}
+}
+
+void MainWindow::renderThreadError(const QString & message)
+{
+	ui->statusbar->showMessage("Rendering error: " + message);
 }
 
 void MainWindow::updatePreview(const QImage & image)
 {
-	ui->labelFinalImage->setPixmap(QPixmap::fromImage(image));
+	//the preview is smaller than the label if the decks are rendered in display size
+	ui->labelFinalImage->setPixmap(QPixmap::fromImage(image.size() == ui->labelFinalImage->size() ? image : image.scaled(ui->labelFinalImage->size())));
 }
 
 void MainWindow::updateDisplay(const QImage & image)
 {
-	m_displayThread.sendImage(image);
-	ui->labelRealImage->setPixmap(QPixmap::fromImage(image.scaled(ui->labelFinalImage->size())));
+	m_frameTiming.mark(FrameTiming::Converted);
+	if (m_displayImageConverter.hasLayout())
+	{
+		//image holds LEDs in strip order. draw them at their positions
+		m_displayThread.sendImage(image, true, m_displayImageConverter.highDepthData(), m_frameTiming);
+		ui->labelRealImage->setPixmap(QPixmap::fromImage(m_displayImageConverter.layoutPreview(image, ui->labelFinalImage->size())));
+	}
+	else
+	{
+		m_displayThread.sendImage(image, false, m_displayImageConverter.highDepthData(), m_frameTiming);
+		ui->labelRealImage->setPixmap(QPixmap::fromImage(image.scaled(ui->labelFinalImage->size())));
+	}
 }
 
 void MainWindow::updateEffectMenu()
 {
-	//clear entries from deck a and b
-	if (ui->actionLoadDeckA->menu())
+	//build new menus for all decks. the old ones are deleted later, as this may be called from one of their actions
+	m_scriptActions.clear();
+	const QStringList list = m_scriptLibrary.scripts();
+	for (int i = 0; i < m_decks.size(); ++i)
 	{
-		ui->actionLoadDeckA->menu()->clear();
+		QAction * loadAction = m_loadDeckActions.at(i);
+		if (loadAction->menu())
+		{
+			loadAction->menu()->deleteLater();
+			loadAction->setMenu(nullptr);
+		}
+		if (list.isEmpty())
+		{
+			continue;
+		}
+		//add file actions to menu. the files are sorted already
+		QMenu * menu = new QMenu;
+		foreach (const QString & entry, list)
+		{
+			QFileInfo info(entry);
+			QAction * action = menu->addAction(info.baseName());
+			action->setData(entry);
+			action->setProperty("deck", i);
+			connect(action, SIGNAL(triggered()), this, SLOT(loadDeck()));
+			m_scriptActions[entry] << action;
+		}
+		menu->setToolTipsVisible(true);
+		//add refresh action. the library is updated automatically, but network shares may not report changes
+		QAction * refresh = menu->addAction(QIcon(":/view-refresh.png"), tr("Refresh"));
+		connect(refresh, SIGNAL(triggered()), &m_scriptLibrary, SLOT(update()));
+		//add script cycling actions to menu
+		menu->addSeparator();
+		QAction * cycleAction = menu->addAction(QIcon(":/autocycle_effects.png"), tr("Auto-cycle scripts"));
+		cycleAction->setCheckable(true);
+		connectParameter(m_decks.at(i)->autoCycleScripts, cycleAction);
+		QtSpinBoxAction * intervalAction = new QtSpinBoxAction("Cycle interval", "s");
+		intervalAction->setObjectName("autoCycleInterval" + QString(QChar('A' + i)));
+		menu->addAction(intervalAction);
+		connectParameter(m_decks.at(i)->autoCycleInterval, intervalAction->control());
+		loadAction->setMenu(menu);
 	}
-	if (ui->actionLoadDeckA->menu())
+	//show compile status of scripts
+	foreach (const QString & entry, list)
 	{
-		ui->actionLoadDeckB->menu()->clear();
+		scriptCompileStatusChanged(entry);
 	}
-	//find all fs files in the effects folder
-	QStringList list = Deck::buildScriptList("./effects");
-	if (list.size() > 0)
+}
+
+void MainWindow::scriptLibraryChanged()
+{
+	updateEffectMenu();
+	//compile scripts added or changed in the background, so decks can switch to them right away.
+	//this includes scripts still waiting from the last time, as passing scripts aborts compiling the previous ones
+	QMap<QString, QString> scripts;
+	foreach (const QString & path, m_scriptLibrary.scripts())
 	{
-		//sort list first
-		list.sort();
-		//build new menus
-		QMenu * menuA = new QMenu;
-		QMenu * menuB = new QMenu;
-		//add file actions to menu
-		foreach (const QString & entry, list)
+		const ScriptInfo script = m_scriptLibrary.script(path);
+		if (script.compileStatus == ScriptInfo::NotCompiled)
 		{
-			//remove base directory from string
-			QString cleanName = entry;
-			cleanName = cleanName.remove("./effects");
-			QFileInfo info(cleanName);
-			//check if this is a fs file
-			if (info.suffix().toLower() == "fs")
-			{
-				//build menu actions
-				QAction * actionA = menuA->addAction(info.baseName());
-				actionA->setData(entry);
-				connect(actionA, SIGNAL(triggered()), this, SLOT(loadDeckA()));
-				QAction * actionB = menuB->addAction(info.baseName());
-				actionB->setData(entry);
-				connect(actionB, SIGNAL(triggered()), this, SLOT(loadDeckB()));
-			}
+			scripts[path] = script.text;
 		}
-		//add refresh actions
-		QAction * refreshA = menuA->addAction(QIcon(":/view-refresh.png"), tr("Refresh"));
-		connect(refreshA, SIGNAL(triggered()), this, SLOT(updateEffectMenu()));
-		QAction * refreshB = menuB->addAction(QIcon(":/view-refresh.png"), tr("Refresh"));
-		connect(refreshB, SIGNAL(triggered()), this, SLOT(updateEffectMenu()));
-		//add script cycling actions to menu
-		menuA->addSeparator();
-		QAction * cycleActionA = menuA->addAction(QIcon(":/autocycle_effects.png"), tr("Auto-cycle scripts"));
-		cycleActionA->setCheckable(true);
-		connectParameter(ui->widgetDeckA->autoCycleScripts, cycleActionA);
-		QtSpinBoxAction * intervalActionA = new QtSpinBoxAction("Cycle interval", "s");
-		intervalActionA->setObjectName("autoCycleIntervalA");
-		menuA->addAction(intervalActionA);
-		connectParameter(ui->widgetDeckA->autoCycleInterval, intervalActionA->control());
-		menuB->addSeparator();
-		QAction * cycleActionB = menuB->addAction(QIcon(":/autocycle_effects.png"), tr("Auto-cycle scripts"));
-		cycleActionB->setCheckable(true);
-		connectParameter(ui->widgetDeckB->autoCycleScripts, cycleActionB);
-		QtSpinBoxAction * intervalActionB = new QtSpinBoxAction("Cycle interval", "s");
-		intervalActionB->setObjectName("autoCycleIntervalB");
-		menuB->addAction(intervalActionB);
-		connectParameter(ui->widgetDeckB->autoCycleInterval, intervalActionB->control());
-		//add new menus
-		ui->actionLoadDeckA->setMenu(menuA);
-		ui->actionLoadDeckB->setMenu(menuB);
-	}
-}
-
-void MainWindow::updateDeckMenu()
+	}
+	if (!scripts.isEmpty())
+	{
+		m_renderThread.precompileScripts(scripts);
+	}
+}
+
+void MainWindow::scriptCompileStatusChanged(const QString & path)
 {
-	//add spinbox actions to menu
-	QtSpinBoxAction * intervalActionA = new QtSpinBoxAction("Update interval", "ms");
-	intervalActionA->setObjectName("updateInterval");
-	ui->menuSettingsDeckA->addAction(intervalActionA);
-	connectParameter(previewInterval, intervalActionA->control());
-	QtSpinBoxAction * widthActionA = new QtSpinBoxAction("Preview width");
-	widthActionA->setObjectName("frameBufferWidth");
-	ui->menuSettingsDeckA->addAction(widthActionA);
-	connectParameter(frameBufferWidth, widthActionA->control());
-	QtSpinBoxAction * heightActionA = new QtSpinBoxAction("Preview height");
-	heightActionA->setObjectName("frameBufferHeight");
-	ui->menuSettingsDeckA->addAction(heightActionA);
-	connectParameter(frameBufferHeight, heightActionA->control());
-	//deck B
-	QtSpinBoxAction * intervalActionB = new QtSpinBoxAction("Update interval", "ms");
-	intervalActionB->setObjectName("updateInterval");
-	ui->menuSettingsDeckB->addAction(intervalActionB);
-	connectParameter(previewInterval, intervalActionB->control());
-	QtSpinBoxAction * widthActionB = new QtSpinBoxAction("Preview width");
-	widthActionB->setObjectName("frameBufferWidth");
-	ui->menuSettingsDeckB->addAction(widthActionB);
-	connectParameter(frameBufferWidth, widthActionB->control());
-	QtSpinBoxAction * heightActionB = new QtSpinBoxAction("Preview height");
-	heightActionB->setObjectName("frameBufferHeight");
-	ui->menuSettingsDeckB->addAction(heightActionB);
-	connectParameter(frameBufferHeight, heightActionB->control());
-}
-
-void MainWindow::loadDeckA(bool /*checked*/)
+	const ScriptInfo script = m_scriptLibrary.script(path);
+	//mark scripts that failed to compile in the effect menus
+	for (auto action : m_scriptActions.value(path))
+	{
+		if (script.compileStatus == ScriptInfo::Failed)
+		{
+			action->setIcon(style()->standardIcon(QStyle::SP_MessageBoxWarning));
+			action->setToolTip(tr("Failed to compile:\n") + script.errors.trimmed());
+		}
+		else if (script.compileStatus == ScriptInfo::Compiled)
+		{
+			action->setIcon(QIcon());
+			action->setToolTip(tr("Compiled in %1 ms").arg(script.compileTime, 0, 'f', 1));
+		}
+		else
+		{
+			action->setIcon(QIcon());
+			action->setToolTip(tr("Not compiled yet"));
+		}
+	}
+}
+
+void MainWindow::precompilationFinished(int scriptCount, int failedCount)
 {
-	QAction * action = qobject_cast<QAction*>(sender());
-	if (action)
+	if (failedCount > 0)
+	{
+		ui->statusbar->showMessage(tr("Compiled %1 effects, %2 failed to compile. They are marked in the effect menus.").arg(scriptCount).arg(failedCount), 10000);
+	}
+	else
 	{
-		ui->widgetDeckA->loadScript(action->data().toString());
+		ui->statusbar->showMessage(tr("Compiled %1 effects.").arg(scriptCount), 5000);
 	}
 }
 
-void MainWindow::saveDeckA(bool /*checked*/)
+void MainWindow::createDecks()
 {
-	if (ui->widgetDeckA->saveScript())
+	bool decksAdded = false;
+	while (m_decks.size() < deckCount)
+	{
+		//decks are named like the two decks of earlier versions, so their settings and MIDI connections are kept
+		const int index = m_decks.size();
+		const QString name = "Deck" + QString(QChar('A' + index));
+		Deck * deck = new Deck(this);
+		deck->setDeckName(name);
+		deck->setScriptLibrary(&m_scriptLibrary);
+		//connect the parameters in the deck to parameters here
+		deck->updateInterval.connect(previewInterval);
+		deck->frameBufferWidth.connect(frameBufferWidth);
+		deck->frameBufferHeight.connect(frameBufferHeight);
+		deck->updateInterval = previewInterval;
+		deck->frameBufferWidth = frameBufferWidth;
+		deck->frameBufferHeight = frameBufferHeight;
+		connect(deck, SIGNAL(layerChanged()), this, SLOT(updateDeckLayers()));
+		ui->horizontalLayout_2->addWidget(deck);
+		m_decks.append(deck);
+		//add menu of deck
+		QMenu * menu = new QMenu(name, this);
+		ui->menubar->insertMenu(ui->menuAudio->menuAction(), menu);
+		m_loadDeckActions.append(menu->addAction(QIcon(":/document-open.png"), tr("Load into deck")));
+		QAction * saveAction = menu->addAction(QIcon(":/document-save.png"), tr("Save"));
+		saveAction->setData(index);
+		connect(saveAction, SIGNAL(triggered()), this, SLOT(saveDeck()));
+		QAction * saveAsAction = menu->addAction(QIcon(":/document-save-as.png"), tr("Save as..."));
+		saveAsAction->setData(index);
+		connect(saveAsAction, SIGNAL(triggered()), this, SLOT(saveAsDeck()));
+		//add spinbox actions to settings menu
+		QMenu * settingsMenu = menu->addMenu(QIcon(":/preferences-system.png"), tr("Settings"));
+		QtSpinBoxAction * intervalAction = new QtSpinBoxAction("Update interval", "ms");
+		intervalAction->setObjectName("updateInterval");
+		settingsMenu->addAction(intervalAction);
+		connectParameter(previewInterval, intervalAction->control());
+		QtSpinBoxAction * widthAction = new QtSpinBoxAction("Preview width");
+		widthAction->setObjectName("frameBufferWidth");
+		settingsMenu->addAction(widthAction);
+		connectParameter(frameBufferWidth, widthAction->control());
+		QtSpinBoxAction * heightAction = new QtSpinBoxAction("Preview height");
+		heightAction->setObjectName("frameBufferHeight");
+		settingsMenu->addAction(heightAction);
+		connectParameter(frameBufferHeight, heightAction->control());
+		decksAdded = true;
+	}
+	if (decksAdded)
 	{
 		updateEffectMenu();
 	}
 }
 
-void MainWindow::saveAsDeckA(bool /*checked*/)
+void MainWindow::updateDeckLayers()
 {
-	if (ui->widgetDeckA->saveAsScript())
+	QVector<DeckLayer> layers;
+	for (auto deck : m_decks)
 	{
-		updateEffectMenu();
+		layers.append(deck->layer());
+	}
+	//the render thread gets the layers with the next mix settings
+	m_displayImageConverter.setLayers(layers);
+}
+
+void MainWindow::deckCountChanged(int count)
+{
+	//the count is also set when reading the settings, before the decks are created
+	if (!m_decks.isEmpty() && count != m_decks.size())
+	{
+		ui->statusbar->showMessage(tr("The number of decks changes to %1 when NerDisco is started again.").arg(count), 5000);
 	}
 }
 
-void MainWindow::loadDeckB(bool /*checked*/)
+void MainWindow::loadDeck(bool /*checked*/)
 {
 	QAction * action = qobject_cast<QAction*>(sender());
 	if (action)
 	{
-		ui->widgetDeckB->loadScript(action->data().toString());
+		Deck * deck = m_decks.value(action->property("deck").toInt());
+		if (deck)
+		{
+			deck->loadScript(action->data().toString());
+		}
 	}
 }
 
-void MainWindow::saveDeckB(bool /*checked*/)
+void MainWindow::saveDeck(bool /*checked*/)
 {
-	if (ui->widgetDeckB->saveScript())
+	QAction * action = qobject_cast<QAction*>(sender());
+	Deck * deck = action ? m_decks.value(action->data().toInt()) : nullptr;
+	if (deck && deck->saveScript())
 	{
-		updateEffectMenu();
+		m_scriptLibrary.update();
 	}
 }
 
-void MainWindow::saveAsDeckB(bool /*checked*/)
+void MainWindow::saveAsDeck(bool /*checked*/)
 {
-	if (ui->widgetDeckB->saveAsScript())
+	QAction * action = qobject_cast<QAction*>(sender());
+	Deck * deck = action ? m_decks.value(action->data().toInt()) : nullptr;
+	if (deck && deck->saveAsScript())
 	{
-		updateEffectMenu();
+		m_scriptLibrary.update();
 	}
 }
 
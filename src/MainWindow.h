@@ -3,14 +3,20 @@
 #include "Deck.h"
 #include "DisplayThread.h"
 //#include "AudioInterface.h"
-#include "SignalJoiner.h"
+#include "RenderThread.h"
+#include "RenderClock.h"
+#include "ScriptLibrary.h"
 #include "MIDIInterface.h"
 #include "MIDIParameterMapping.h"
 #include "DisplayImageConverter.h"
+#include "ShowPlayer.h"
 #include "Parameters.h"
 
 #include <QMainWindow>
 #include <QTimer>
+#include <QLabel>
+#include <QHash>
+#include <QVector>
 
 
 namespace Ui { class MainWindow; }
@@ -36,6 +42,11 @@ public:
 	ParameterInt previewInterval;
 	ParameterInt frameBufferWidth;
 	ParameterInt frameBufferHeight;
+	/// @brief Render the decks in the display size times supersampling instead of frameBufferWidth x frameBufferHeight,
+	/// so rendering work scales with the number of LEDs. The deck views keep frameBufferWidth as their size then.
+	ParameterBool matchDisplaySize;
+	/// @brief Factor the display size is multiplied with when matchDisplaySize is on, see SupersamplingFactor.
+	ParameterInt supersampling;
 	ParameterInt displayInterval;
 	ParameterInt displayWidth;
 	ParameterInt displayHeight;
@@ -43,10 +54,13 @@ public:
 	ParameterInt displayBrightness; //[-50,50]
 	ParameterInt displayContrast; //[-50,50]
 	ParameterInt crossFadeValue; //[0,100]
+	/// @brief Number of decks. Read when starting, changes are used after restarting.
+	ParameterInt deckCount;
 
 protected slots:
-    void updateDeckImages();
-	void grabDeckImages();
+	void deckFrameRendered();
+	void updateRenderSize();
+	void renderThreadError(const QString & message);
 	void updatePreview(const QImage & image);
 	void updateDisplay(const QImage & image);
 
@@ -78,25 +92,41 @@ protected slots:
 	void displaySerialPortSelected();
 	void displayBaudrateSelected();
 	void displayScanlineDirectionSelected();
+	void displaySupersamplingSelected();
 	void displaySerialPortChanged(const QString & name);
 	void displayBaudrateChanged(int rate);
 	void displayScanlineDirectionChanged(ScanlineDirection direction);
+	void displaySupersamplingChanged(int factor);
 	void displayStartSending(bool checked);
 	void displayStopSending();
 	void displayPortStatusChanged(bool opened);
 	void displaySendStatusChanged(bool sending);
 	void displayFlipChanged(bool horizontal, bool vertical);
+	void displayLoadLayout();
+	void displayClearLayout();
+	void displayReadyForFrame();
+	void displayIntervalChanged(int interval);
+	void displayShowLatency();
+	void displaySaveLatency();
+	void displayResetLatency();
+	void displayRecordShow(bool checked);
+	void displayPlayShow(bool checked);
+	void displayMenuAboutToShow();
+	void showFrameChanged(const QImage & image);
+	void displayStatisticsChanged(int segment, const QString & portName, float bytesPerFrame, float framesPerSecond, int droppedFrames, int lateFrames, int frameLag);
+	void renderClockStatisticsChanged(float ticksPerSecond, float averageJitter, float maxJitter, int missedTicks);
 
 	void updateScreenMenu();
 
 	void updateEffectMenu();
-	void updateDeckMenu();
-    void loadDeckA(bool checked = false);
-    void saveDeckA(bool checked = false);
-    void saveAsDeckA(bool checked = false);
-    void loadDeckB(bool checked = false);
-    void saveDeckB(bool checked = false);
-    void saveAsDeckB(bool checked = false);
+	void scriptLibraryChanged();
+	void scriptCompileStatusChanged(const QString & path);
+	void precompilationFinished(int scriptCount, int failedCount);
+	void updateDeckLayers();
+	void deckCountChanged(int count);
+	void loadDeck(bool checked = false);
+	void saveDeck(bool checked = false);
+	void saveAsDeck(bool checked = false);
 
     void showResponse(const QString &s);
     void processError(const QString &s);
@@ -106,14 +136,35 @@ public slots:
 	void exitApplication();
 
 private:
+	/// @brief Create decks and their menus until there are deckCount decks.
+	void createDecks();
+
     Ui::MainWindow *ui;
 
-    QTimer m_displayTimer;
 	QString m_settingsFileName;
+	QLabel * m_displayStatisticsLabel;
+	QLabel * m_renderStatisticsLabel;
+	QStringList m_displayStatistics;
+	FrameTiming m_frameTiming;
+	/// @brief Scripts in the effects directory. Serves the effect menus and the decks.
+	ScriptLibrary m_scriptLibrary;
+	/// @brief Actions loading a script in the effect menus by script path.
+	QHash<QString, QList<QAction *>> m_scriptActions;
+	/// @brief Decks from the bottom to the top layer. Deck i is rendered as deck i by the render thread.
+	QVector<Deck *> m_decks;
+	/// @brief Actions holding the effect menu of every deck.
+	QVector<QAction *> m_loadDeckActions;
+	RenderThread m_renderThread;
+	//the clock must be destroyed before the render thread it passes ticks to
+	RenderClock m_renderClock;
 
 	DisplayImageConverter m_displayImageConverter;
+	//the player must be destroyed after the display thread, as outputs may still reference frames of the mapped show file
+	ShowPlayer m_showPlayer;
+	QAction * m_recordShowAction;
+	QAction * m_playShowAction;
+	QMenu * m_supersamplingMenu;
     DisplayThread m_displayThread;
 //    AudioInterface m_audioInterface;
-	SignalJoiner m_signalJoiner;
 	MIDIInterface::SPtr m_midiInterface;
 };
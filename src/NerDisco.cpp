@@ -1,9 +1,66 @@
 #include <QApplication>
+#include <QGuiApplication>
+#include <QCommandLineParser>
+#include <QTextStream>
+#include <cstring>
 
 #include "MainWindow.h"
+#include "HeadlessRunner.h"
+#include "LiveView.h"
+
+/// @brief Render and send frames without a GUI, using the settings written by the GUI.
+/// On machines without a GPU or display, run with "-platform offscreen" or "-platform minimal" and e.g. LIBGL_ALWAYS_SOFTWARE=1 for Mesa.
+int runHeadless(int argc, char *argv[])
+{
+	//all contexts share resources, so the deck textures can be mixed on the GPU
+	QCoreApplication::setAttribute(Qt::AA_ShareOpenGLContexts);
+	QGuiApplication app(argc, argv);
+	app.setApplicationName("NerDisco");
+	app.setOrganizationName("HorstBaerbel Inc.");
+	QCommandLineParser parser;
+	parser.setApplicationDescription("Render decks and send them to the LED display without a GUI.");
+	parser.addHelpOption();
+	parser.addOption(QCommandLineOption("headless", "Run without GUI."));
+	parser.addOption(QCommandLineOption("settings", "Settings file to read.", "file", "settings.xml"));
+	parser.addOption(QCommandLineOption("duration", "Seconds to run for. 0 runs until interrupted.", "seconds", "0"));
+	parser.addOption(QCommandLineOption("no-output", "Render and convert frames, but do not send them."));
+	parser.process(app);
+	QTextStream out(stdout);
+	QTextStream err(stderr);
+	QSurfaceFormat::setDefaultFormat(LiveView::getDefaultFormat());
+	HeadlessRunner runner;
+	try
+	{
+		runner.loadSettings(parser.value("settings"));
+	}
+	catch (std::runtime_error e)
+	{
+		err << "Failed to read settings from \"" << parser.value("settings") << "\". " << e.what() << "\n";
+		return 1;
+	}
+	if (parser.isSet("no-output"))
+	{
+		runner.displayThread.sending = false;
+	}
+	QObject::connect(&runner, SIGNAL(finished()), &app, SLOT(quit()));
+	runner.start(parser.value("duration").toInt());
+	const int result = app.exec();
+	out << runner.summary() << "\n";
+	return result;
+}
 
 int main(int argc, char *argv[])
 {
+	//check for headless mode before creating the application, because it must not create widgets
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "--headless") == 0)
+		{
+			return runHeadless(argc, argv);
+		}
+	}
+	//all contexts share resources, so the deck textures can be mixed on the GPU
+	QCoreApplication::setAttribute(Qt::AA_ShareOpenGLContexts);
     QApplication app(argc, argv);
     app.setApplicationName("NerDisco");
     app.setOrganizationName("HorstBaerbel Inc.");
@@ -0,0 +1,400 @@
+#include "NetworkOutput.h"
+#include "DisplayEncoder.h"
+
+#include <QUdpSocket>
+#include <QHostInfo>
+#include <QUuid>
+#include <cstring>
+
+#if defined(Q_OS_LINUX)
+	#include <sys/socket.h>
+	#include <netinet/in.h>
+	#include <arpa/inet.h>
+#endif
+
+
+namespace
+{
+	const quint16 E131Port = 5568;
+	const quint16 ArtNetPort = 6454;
+	const quint16 DDPPort = 4048;
+	//number of RGB LEDs in a DMX universe
+	const int LedsPerUniverse = 170;
+	//number of RGB LEDs in a DDP packet. keeps packets below a standard ethernet MTU
+	const int LedsPerDDPPacket = 480;
+
+	inline void putU16(unsigned char * data, int value)
+	{
+		data[0] = (value >> 8) & 0xFF;
+		data[1] = value & 0xFF;
+	}
+
+	inline void putU32(unsigned char * data, quint32 value)
+	{
+		data[0] = (value >> 24) & 0xFF;
+		data[1] = (value >> 16) & 0xFF;
+		data[2] = (value >> 8) & 0xFF;
+		data[3] = value & 0xFF;
+	}
+
+	/// @brief Get the E1.31 multicast address of a universe.
+	QHostAddress e131MulticastAddress(int universe)
+	{
+		return QHostAddress((quint32)((239 << 24) | (255 << 16) | (((universe >> 8) & 0xFF) << 8) | (universe & 0xFF)));
+	}
+
+	/// @brief Write the E1.31 root layer.
+	/// @param packet Packet data.
+	/// @param size Size of the whole packet.
+	/// @param vector Root layer vector.
+	/// @param cid Component identifier of the sender.
+	void writeE131RootLayer(unsigned char * packet, int size, quint32 vector, const QByteArray & cid)
+	{
+		static const unsigned char acnIdentifier[12] = { 'A', 'S', 'C', '-', 'E', '1', '.', '1', '7', 0, 0, 0 };
+		putU16(packet, 0x0010); //preamble size
+		putU16(packet + 2, 0x0000); //postamble size
+		memcpy(packet + 4, acnIdentifier, 12);
+		putU16(packet + 16, 0x7000 | (size - 16)); //flags and length
+		putU32(packet + 18, vector);
+		memcpy(packet + 22, cid.constData(), 16);
+	}
+}
+
+
+NetworkOutput::NetworkOutput(QObject *parent)
+	: LEDOutput(parent)
+	, protocol("protocol", E131, E131, DDP)
+	, host("host", "")
+	, universe("universe", 1, 0, 63999)
+	, sync("sync", false)
+	, m_protocol(E131)
+	, m_universe(1)
+	, m_sync(false)
+	, m_currentProtocol(E131)
+	, m_currentUniverse(1)
+	, m_currentSync(false)
+	, m_currentSettingsChanged(true)
+	, m_cid(QUuid::createUuid().toRfc4122())
+	, m_sequence(0)
+	, m_packetsSize(0)
+{
+	connect(protocol.GetSharedParameter().get(), SIGNAL(valueChanged(int)), this, SLOT(setSettings()));
+	connect(host.GetSharedParameter().get(), SIGNAL(valueChanged(const QString &)), this, SLOT(setSettings()));
+	connect(universe.GetSharedParameter().get(), SIGNAL(valueChanged(int)), this, SLOT(setSettings()));
+	connect(sync.GetSharedParameter().get(), SIGNAL(valueChanged(bool)), this, SLOT(setSettings()));
+}
+
+NetworkOutput::~NetworkOutput()
+{
+	stop();
+}
+
+QString NetworkOutput::typeName() const
+{
+	return "network";
+}
+
+QString NetworkOutput::targetName() const
+{
+	static const char * protocolNames[3] = { "E1.31", "Art-Net", "DDP" };
+	const QString hostName = host;
+	return QString("%1 %2").arg(protocolNames[qBound(0, (int)protocol, 2)]).arg(hostName.isEmpty() ? (protocol == E131 ? "multicast" : "broadcast") : hostName);
+}
+
+void NetworkOutput::toXML(QDomElement & element) const
+{
+	LEDOutput::toXML(element);
+	protocol.toXML(element);
+	host.toXML(element);
+	universe.toXML(element);
+	sync.toXML(element);
+}
+
+NetworkOutput & NetworkOutput::fromXML(QDomElement & element)
+{
+	LEDOutput::fromXML(element);
+	protocol.fromXML(element);
+	host.fromXML(element);
+	universe.fromXML(element);
+	sync.fromXML(element);
+	return *this;
+}
+
+void NetworkOutput::setSettings()
+{
+	QMutexLocker locker(&m_mutex);
+	m_protocol = protocol;
+	m_host = host;
+	m_universe = universe;
+	m_sync = sync;
+	settingsChanged();
+}
+
+void NetworkOutput::takeSettings()
+{
+	if (m_currentProtocol != m_protocol || m_currentHost != m_host || m_currentUniverse != m_universe || m_currentSync != m_sync)
+	{
+		m_currentProtocol = m_protocol;
+		m_currentHost = m_host;
+		m_currentUniverse = m_universe;
+		m_currentSync = m_sync;
+		m_currentSettingsChanged = true;
+	}
+}
+
+void NetworkOutput::prepare(DisplayEncoder & encoder)
+{
+	//all protocols send plain RGB data
+	encoder.setCompression(false, 1);
+	encoder.setColorOrder(DisplayEncoder::OrderRGB);
+	if (!m_socket)
+	{
+		m_socket.reset(new QUdpSocket);
+		if (!m_socket->bind(QHostAddress::AnyIPv4, 0))
+		{
+			emit error(tr("Failed to open UDP socket: %1").arg(m_socket->errorString()));
+			emit portOpened(false);
+			return;
+		}
+		//make sure a large frame fits into the socket buffer when sending it in one burst
+		m_socket->setSocketOption(QAbstractSocket::SendBufferSizeSocketOption, 1024 * 1024);
+		m_socket->setSocketOption(QAbstractSocket::MulticastTtlOption, 1);
+		emit portOpened(true);
+	}
+	if (m_currentSettingsChanged)
+	{
+		m_currentSettingsChanged = false;
+		//resolve host name, if it is not an address
+		m_address = QHostAddress(m_currentHost);
+		if (!m_currentHost.isEmpty() && m_address.isNull())
+		{
+			const QHostInfo info = QHostInfo::fromName(m_currentHost);
+			for (const QHostAddress & address : info.addresses())
+			{
+				if (address.protocol() == QAbstractSocket::IPv4Protocol)
+				{
+					m_address = address;
+					break;
+				}
+			}
+			if (m_address.isNull())
+			{
+				emit error(tr("Failed to resolve host %1").arg(m_currentHost));
+			}
+		}
+	}
+}
+
+bool NetworkOutput::isReady() const
+{
+	return m_socket && m_socket->state() == QAbstractSocket::BoundState && (m_currentHost.isEmpty() || !m_address.isNull());
+}
+
+int NetworkOutput::writeFrame(const QImage & image, DisplayEncoder & encoder, int /*waitTimeout*/)
+{
+	if (encoder.encode(image).size() <= 0)
+	{
+		return -1;
+	}
+	//build all packets of the frame, then send them in one go
+	m_packetsSize = 0;
+	m_datagrams.resize(0);
+	switch (m_currentProtocol)
+	{
+		case ArtNet:
+			buildArtNet(encoder.ledData(), encoder.ledCount());
+			break;
+		case DDP:
+			buildDDP(encoder.ledData(), encoder.ledCount());
+			break;
+		default:
+			buildE131(encoder.ledData(), encoder.ledCount());
+			break;
+	}
+	++m_sequence;
+	return sendDatagrams();
+}
+
+void NetworkOutput::finish()
+{
+	//the socket was created in the output thread, so delete it there
+	m_socket.reset();
+}
+
+unsigned char * NetworkOutput::addDatagram(int size, const QHostAddress & address, quint16 port)
+{
+	Datagram datagram;
+	datagram.offset = m_packetsSize;
+	datagram.size = size;
+	datagram.address = address;
+	datagram.port = port;
+	m_datagrams.append(datagram);
+	m_packetsSize += size;
+	if (m_packets.size() < m_packetsSize)
+	{
+		m_packets.resize(m_packetsSize);
+	}
+	unsigned char * packet = reinterpret_cast<unsigned char *>(m_packets.data()) + datagram.offset;
+	memset(packet, 0, size);
+	return packet;
+}
+
+void NetworkOutput::buildE131(const unsigned char * data, int ledCount)
+{
+	//E1.31 universes are in the range [1,63999]
+	const int firstUniverse = qBound(1, m_currentUniverse, 63999);
+	const int syncUniverse = m_currentSync ? firstUniverse : 0;
+	for (int led = 0, dmxUniverse = firstUniverse; led < ledCount && dmxUniverse <= 63999; led += LedsPerUniverse, ++dmxUniverse)
+	{
+		const int channels = 3 * qMin(LedsPerUniverse, ledCount - led);
+		const int size = 126 + channels;
+		unsigned char * packet = addDatagram(size, m_address.isNull() ? e131MulticastAddress(dmxUniverse) : m_address, E131Port);
+		writeE131RootLayer(packet, size, 0x00000004, m_cid);
+		//framing layer
+		putU16(packet + 38, 0x7000 | (size - 38));
+		putU32(packet + 40, 0x00000002);
+		strncpy(reinterpret_cast<char *>(packet + 44), "NerDisco", 64);
+		packet[108] = 100; //priority
+		putU16(packet + 109, syncUniverse);
+		packet[111] = m_sequence;
+		packet[112] = 0; //options
+		putU16(packet + 113, dmxUniverse);
+		//DMP layer
+		putU16(packet + 115, 0x7000 | (size - 115));
+		packet[117] = 0x02; //vector
+		packet[118] = 0xA1; //address and data type
+		putU16(packet + 119, 0x0000); //first property address
+		putU16(packet + 121, 0x0001); //address increment
+		putU16(packet + 123, 1 + channels); //property value count
+		packet[125] = 0x00; //DMX start code
+		memcpy(packet + 126, data + 3 * led, channels);
+	}
+	if (m_currentSync)
+	{
+		//universe synchronization packet
+		const int size = 49;
+		unsigned char * packet = addDatagram(size, m_address.isNull() ? e131MulticastAddress(syncUniverse) : m_address, E131Port);
+		writeE131RootLayer(packet, size, 0x00000008, m_cid);
+		putU16(packet + 38, 0x7000 | (size - 38));
+		putU32(packet + 40, 0x00000001);
+		packet[44] = m_sequence;
+		putU16(packet + 45, syncUniverse);
+	}
+}
+
+void NetworkOutput::buildArtNet(const unsigned char * data, int ledCount)
+{
+	static const unsigned char artNetIdentifier[8] = { 'A', 'r', 't', '-', 'N', 'e', 't', 0 };
+	const QHostAddress address = m_address.isNull() ? QHostAddress(QHostAddress::Broadcast) : m_address;
+	//Art-Net port addresses are in the range [0,32767]
+	const int firstUniverse = qBound(0, m_currentUniverse, 32767);
+	for (int led = 0, dmxUniverse = firstUniverse; led < ledCount && dmxUniverse <= 32767; led += LedsPerUniverse, ++dmxUniverse)
+	{
+		const int channels = 3 * qMin(LedsPerUniverse, ledCount - led);
+		//the DMX data length must be even
+		const int length = (channels + 1) & ~1;
+		unsigned char * packet = addDatagram(18 + length, address, ArtNetPort);
+		memcpy(packet, artNetIdentifier, 8);
+		packet[8] = 0x00; //OpDmx, little endian
+		packet[9] = 0x50;
+		packet[10] = 0; //protocol version 14
+		packet[11] = 14;
+		//Art-Net sequence numbers are in the range [1,255]. 0 disables sequencing
+		packet[12] = m_sequence == 0 ? 1 : m_sequence;
+		packet[13] = 0; //physical port
+		packet[14] = dmxUniverse & 0xFF; //sub-net and universe
+		packet[15] = (dmxUniverse >> 8) & 0x7F; //net
+		putU16(packet + 16, length);
+		memcpy(packet + 18, data + 3 * led, channels);
+	}
+	if (m_currentSync)
+	{
+		unsigned char * packet = addDatagram(14, address, ArtNetPort);
+		memcpy(packet, artNetIdentifier, 8);
+		packet[8] = 0x00; //OpSync, little endian
+		packet[9] = 0x52;
+		packet[10] = 0; //protocol version 14
+		packet[11] = 14;
+	}
+}
+
+void NetworkOutput::buildDDP(const unsigned char * data, int ledCount)
+{
+	const QHostAddress address = m_address.isNull() ? QHostAddress(QHostAddress::Broadcast) : m_address;
+	for (int led = 0; led < ledCount; led += LedsPerDDPPacket)
+	{
+		const int length = 3 * qMin(LedsPerDDPPacket, ledCount - led);
+		const bool last = led + LedsPerDDPPacket >= ledCount;
+		unsigned char * packet = addDatagram(10 + length, address, DDPPort);
+		//version 1. the last packet of a frame has the push flag set, so the controller displays the frame
+		packet[0] = 0x40 | (last ? 0x01 : 0x00);
+		packet[1] = m_sequence & 0x0F;
+		packet[2] = 0x0B; //RGB, 8 bits per component
+		packet[3] = 0x01; //default output device
+		putU32(packet + 4, 3 * led); //data offset in bytes
+		putU16(packet + 8, length);
+		memcpy(packet + 10, data + 3 * led, length);
+	}
+}
+
+int NetworkOutput::sendDatagrams()
+{
+	const char * packets = m_packets.constData();
+	int bytesSent = 0;
+	int i = 0;
+#if defined(Q_OS_LINUX)
+	//send IPv4 packets in batches with as few system calls as possible
+	const int socket = m_socket->socketDescriptor();
+	const int BatchSize = 64;
+	sockaddr_in addresses[BatchSize];
+	iovec buffers[BatchSize];
+	mmsghdr messages[BatchSize];
+	while (socket >= 0 && i < m_datagrams.size() && m_datagrams.at(i).address.protocol() == QAbstractSocket::IPv4Protocol)
+	{
+		int count = 0;
+		for (; count < BatchSize && i + count < m_datagrams.size(); ++count)
+		{
+			const Datagram & datagram = m_datagrams.at(i + count);
+			if (datagram.address.protocol() != QAbstractSocket::IPv4Protocol)
+			{
+				break;
+			}
+			memset(&addresses[count], 0, sizeof(sockaddr_in));
+			addresses[count].sin_family = AF_INET;
+			addresses[count].sin_port = htons(datagram.port);
+			addresses[count].sin_addr.s_addr = htonl(datagram.address.toIPv4Address());
+			buffers[count].iov_base = const_cast<char *>(packets + datagram.offset);
+			buffers[count].iov_len = datagram.size;
+			memset(&messages[count], 0, sizeof(mmsghdr));
+			messages[count].msg_hdr.msg_name = &addresses[count];
+			messages[count].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+			messages[count].msg_hdr.msg_iov = &buffers[count];
+			messages[count].msg_hdr.msg_iovlen = 1;
+		}
+		const int sent = sendmmsg(socket, messages, count, 0);
+		if (sent <= 0)
+		{
+			emit timeout(tr("Failed to send UDP packets to %1").arg(m_address.toString()));
+			return -1;
+		}
+		for (int j = 0; j < sent; ++j)
+		{
+			bytesSent += messages[j].msg_len;
+		}
+		i += sent;
+	}
+#endif
+	//send remaining packets one by one
+	for (; i < m_datagrams.size(); ++i)
+	{
+		const Datagram & datagram = m_datagrams.at(i);
+		const qint64 sent = m_socket->writeDatagram(packets + datagram.offset, datagram.size, datagram.address, datagram.port);
+		if (sent < 0)
+		{
+			emit timeout(tr("Failed to send UDP packets to %1: %2").arg(datagram.address.toString()).arg(m_socket->errorString()));
+			return -1;
+		}
+		bytesSent += sent;
+	}
+	return bytesSent;
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include "LEDOutput.h"
+
+#include <QHostAddress>
+#include <QByteArray>
+#include <QVector>
+#include <memory>
+
+class QUdpSocket;
+
+
+/// @brief Sends display frames to LED controllers over UDP using E1.31 (sACN), Art-Net or DDP.
+/// LED data is sent as RGB. For E1.31 and Art-Net 170 LEDs are packed into a universe, starting at the first universe set.
+/// If no host is set E1.31 data is sent to the universe multicast addresses and Art-Net and DDP data is broadcast.
+/// If sync is enabled an E1.31 universe synchronization packet (to the first universe) or an ArtSync packet is sent
+/// after every frame, so the controllers update all universes at the same time. DDP uses its push flag for that.
+/// All packets of a frame are built into one buffer first and then sent in one burst, using sendmmsg() on Linux.
+class NetworkOutput : public LEDOutput
+{
+	Q_OBJECT
+
+public:
+	/// brief Shared pointer of NetworkOutput object.
+	typedef std::shared_ptr<NetworkOutput> SPtr;
+
+	enum Protocol { E131 = 0, ArtNet = 1, DDP = 2 };
+
+	NetworkOutput(QObject *parent = 0);
+	~NetworkOutput();
+
+	virtual QString typeName() const;
+	virtual QString targetName() const;
+
+	virtual void toXML(QDomElement & element) const;
+	virtual NetworkOutput & fromXML(QDomElement & element);
+
+	/// @brief Protocol used. See Protocol enum.
+	ParameterInt protocol;
+	/// @brief Host name or IP address of the controller. Empty for multicast or broadcast.
+	ParameterQString host;
+	/// @brief First universe for E1.31 and Art-Net.
+	ParameterInt universe;
+	/// @brief Send synchronization packets after every frame.
+	ParameterBool sync;
+
+protected:
+	virtual void takeSettings();
+	virtual void prepare(DisplayEncoder & encoder);
+	virtual bool isReady() const;
+	virtual int writeFrame(const QImage & image, DisplayEncoder & encoder, int waitTimeout);
+	virtual void finish();
+
+private slots:
+	void setSettings();
+
+private:
+	/// @brief A UDP packet in the packet buffer.
+	struct Datagram
+	{
+		int offset;
+		int size;
+		QHostAddress address;
+		quint16 port;
+	};
+
+	/// @brief Add a packet to the packet buffer.
+	/// @return Pointer to the packet data.
+	unsigned char * addDatagram(int size, const QHostAddress & address, quint16 port);
+	void buildE131(const unsigned char * data, int ledCount);
+	void buildArtNet(const unsigned char * data, int ledCount);
+	void buildDDP(const unsigned char * data, int ledCount);
+	/// @brief Send all packets in the buffer.
+	/// @return Number of bytes sent or -1 on error.
+	int sendDatagrams();
+
+	//settings set from the outside, protected by m_mutex
+	int m_protocol;
+	QString m_host;
+	int m_universe;
+	bool m_sync;
+	//settings used by the output thread
+	int m_currentProtocol;
+	QString m_currentHost;
+	int m_currentUniverse;
+	bool m_currentSync;
+	bool m_currentSettingsChanged;
+	QHostAddress m_address;
+	QByteArray m_cid;
+	unsigned char m_sequence;
+	//socket. created in the output thread
+	std::unique_ptr<QUdpSocket> m_socket;
+	//packets of the current frame. the buffer only grows
+	QByteArray m_packets;
+	int m_packetsSize;
+	QVector<Datagram> m_datagrams;
+};
@@ -37,6 +37,18 @@ void connect(NodeRanged::SPtr parameter, QDoubleSpinBox * spinbox)
 	QObject::connect(parameter.get(), SIGNAL(valueChanged(double)), spinbox, SLOT(setValue(double)));
 }
 
+void connect(NodeRanged::SPtr parameter, QComboBox * comboBox)
+{
+	if (!parameter || !comboBox)
+	{
+		throw std::runtime_error("connectParameter() - Invalid parameter(s) passed!");
+	}
+	//the value is the index of the entry
+	comboBox->setCurrentIndex(parameter->value());
+	QObject::connect(comboBox, SIGNAL(currentIndexChanged(int)), parameter.get(), SLOT(setValue(int)));
+	QObject::connect(parameter.get(), SIGNAL(valueChanged(int)), comboBox, SLOT(setCurrentIndex(int)));
+}
+
 void connect(NodeRanged::SPtr parameter, QAbstractButton * button)
 {
 	if (!parameter || !button)
@@ -122,6 +134,11 @@ void connectParameter(ParameterDouble parameter, QDoubleSpinBox * spinbox)
 	connect(parameter.GetSharedParameter(), spinbox);
 }
 
+void connectParameter(ParameterInt parameter, QComboBox * comboBox)
+{
+	connect(parameter.GetSharedParameter(), comboBox);
+}
+
 void connectParameter(ParameterBool parameter, QAbstractButton * button)
 {
 	connect(parameter.GetSharedParameter(), button);
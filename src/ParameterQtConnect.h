@@ -6,6 +6,7 @@
 #include <QDial>
 #include <QSpinBox>
 #include <QDoubleSpinBox>
+#include <QComboBox>
 #include <QAction>
 
 
@@ -24,5 +25,7 @@ void connectParameter(ParameterInt parameter, QDoubleSpinBox * spinbox);
 void connectParameter(ParameterFloat parameter, QDoubleSpinBox * spinbox);
 void connectParameter(ParameterDouble parameter, QDoubleSpinBox * spinbox);
 
+void connectParameter(ParameterInt parameter, QComboBox * comboBox);
+
 void connectParameter(ParameterBool parameter, QAbstractButton * button);
 void connectParameter(ParameterBool parameter, QAction * action);
@@ -0,0 +1,176 @@
+#include "RenderClock.h"
+
+#include <chrono>
+#include <thread>
+
+
+RenderClock::RenderClock(RenderThread * renderThread, QObject * parent)
+	: QThread(parent)
+	, m_renderThread(renderThread)
+	, m_quit(false)
+	, m_ticking(false)
+	, m_scheduleChanged(true)
+	, m_tickNow(false)
+	, m_interval(50000000)
+	, m_nextInterval(0)
+{
+}
+
+RenderClock::~RenderClock()
+{
+	m_mutex.lock();
+	m_quit = true;
+	m_condition.wakeAll();
+	m_mutex.unlock();
+	wait();
+}
+
+void RenderClock::wakeUp()
+{
+	if (m_quit)
+	{
+		return;
+	}
+	if (!isRunning())
+	{
+		start();
+		setPriority(QThread::TimeCriticalPriority);
+	}
+	else
+		m_condition.wakeOne();
+}
+
+void RenderClock::setInterval(int milliseconds)
+{
+	QMutexLocker locker(&m_mutex);
+	m_interval = (qint64)qMax(milliseconds, 1) * 1000000;
+	m_scheduleChanged = true;
+	wakeUp();
+}
+
+void RenderClock::setTicking(bool ticking)
+{
+	QMutexLocker locker(&m_mutex);
+	if (m_ticking != ticking)
+	{
+		m_ticking = ticking;
+		m_scheduleChanged = true;
+		wakeUp();
+	}
+}
+
+void RenderClock::tickNow(int nextInterval)
+{
+	QMutexLocker locker(&m_mutex);
+	m_tickNow = true;
+	m_nextInterval = (qint64)qMax(nextInterval, 1) * 1000000;
+	wakeUp();
+}
+
+void RenderClock::run()
+{
+	typedef std::chrono::steady_clock Clock;
+	const Clock::time_point start = Clock::now();
+	Clock::time_point deadline = start;
+	Clock::time_point lastTickTime = start;
+	quint64 frameIndex = 0;
+	//statistics
+	Clock::time_point statisticsStart = start;
+	int statisticsTicks = 0;
+	int statisticsMissed = 0;
+	int jitterCount = 0;
+	qint64 jitterSum = 0;
+	qint64 jitterMax = 0;
+
+	m_mutex.lock();
+	while (!m_quit)
+	{
+		if (!m_ticking)
+		{
+			m_condition.wait(&m_mutex);
+			continue;
+		}
+		if (m_scheduleChanged)
+		{
+			//start a new schedule with the next tick one interval after the last one, or now if that has passed
+			m_scheduleChanged = false;
+			deadline = qMax(lastTickTime + std::chrono::nanoseconds(m_interval), Clock::now());
+		}
+		//sleep until the absolute deadline. wait on the condition first, so changes wake us up, and sleep precisely for the rest
+		while (!m_quit && !m_tickNow && !m_scheduleChanged)
+		{
+			const qint64 remaining = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline - Clock::now()).count();
+			if (remaining <= 0)
+			{
+				break;
+			}
+			if (remaining > 2000000)
+			{
+				m_condition.wait(&m_mutex, (unsigned long)((remaining - 1000000) / 1000000));
+			}
+			else
+			{
+				m_mutex.unlock();
+				std::this_thread::sleep_until(deadline);
+				m_mutex.lock();
+			}
+		}
+		if (m_quit)
+		{
+			break;
+		}
+		if (m_scheduleChanged && !m_tickNow)
+		{
+			continue;
+		}
+		const Clock::time_point now = Clock::now();
+		Clock::time_point tickTime = deadline;
+		if (m_tickNow)
+		{
+			//tick now and schedule the following ticks relative to this one
+			m_tickNow = false;
+			m_scheduleChanged = false;
+			tickTime = now;
+			deadline = now + std::chrono::nanoseconds(m_nextInterval);
+		}
+		else
+		{
+			const qint64 jitter = std::chrono::duration_cast<std::chrono::nanoseconds>(now - deadline).count();
+			++jitterCount;
+			jitterSum += jitter;
+			jitterMax = qMax(jitterMax, jitter);
+			deadline += std::chrono::nanoseconds(m_interval);
+			//if we woke up more than an interval late, skip the ticks we missed instead of rendering them in a burst
+			if (now >= deadline)
+			{
+				const qint64 missed = std::chrono::duration_cast<std::chrono::nanoseconds>(now - deadline).count() / m_interval + 1;
+				deadline += std::chrono::nanoseconds(missed * m_interval);
+				statisticsMissed += (int)missed;
+			}
+		}
+		m_mutex.unlock();
+		//pass the tick to the render thread
+		RenderTick tick;
+		tick.frameIndex = frameIndex++;
+		tick.time = std::chrono::duration<double>(tickTime - start).count();
+		tick.deltaTime = std::chrono::duration<double>(tickTime - lastTickTime).count();
+		tick.timing.mark(FrameTiming::Tick);
+		lastTickTime = tickTime;
+		m_renderThread->requestFrame(tick);
+		//report statistics about once per second
+		++statisticsTicks;
+		const double statisticsTime = std::chrono::duration<double>(now - statisticsStart).count();
+		if (statisticsTime >= 1.0)
+		{
+			emit statisticsChanged(statisticsTicks / statisticsTime, jitterCount > 0 ? jitterSum / 1000000.0f / jitterCount : 0.0f, jitterMax / 1000000.0f, statisticsMissed);
+			statisticsStart = now;
+			statisticsTicks = 0;
+			statisticsMissed = 0;
+			jitterCount = 0;
+			jitterSum = 0;
+			jitterMax = 0;
+		}
+		m_mutex.lock();
+	}
+	m_mutex.unlock();
+}
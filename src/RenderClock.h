@@ -0,0 +1,56 @@
+#pragma once
+
+#include "RenderThread.h"
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+
+
+/// @brief Schedules render ticks in its own thread, so ticks do not jitter with the load of the GUI event loop.
+/// Ticks are scheduled at absolute deadlines on a steady nanosecond clock, so they do not drift, and passed to RenderThread directly.
+/// The frame time passed to the scripts is the deadline of the tick, not the time the thread actually woke up, so motion stays smooth.
+class RenderClock : public QThread
+{
+	Q_OBJECT
+
+public:
+	/// @brief Create clock. The thread is started when ticking is switched on.
+	/// @param renderThread Render thread ticks are passed to.
+	RenderClock(RenderThread * renderThread, QObject * parent = 0);
+	~RenderClock();
+
+	/// @brief Set the interval between ticks. The next tick is scheduled relative to the last one.
+	void setInterval(int milliseconds);
+	/// @brief Start or stop ticking. The frame index and time keep counting when ticking is started again.
+	void setTicking(bool ticking);
+	/// @brief Tick right away and schedule the following ticks relative to this one. Used for adaptive pacing.
+	/// @param nextInterval Interval until the next tick in milliseconds.
+	void tickNow(int nextInterval);
+
+signals:
+	/// @brief Emitted about once per second while ticking.
+	/// @param ticksPerSecond Number of ticks per second.
+	/// @param averageJitter Average time the thread woke up after the deadline of a tick in ms.
+	/// @param maxJitter Maximum time the thread woke up after the deadline of a tick in ms.
+	/// @param missedTicks Number of ticks skipped since the last report, because the thread woke up more than an interval late.
+	void statisticsChanged(float ticksPerSecond, float averageJitter, float maxJitter, int missedTicks);
+
+protected:
+	void run();
+
+private:
+	/// @brief Start thread or wake it up if it is already running. Call with m_mutex locked.
+	void wakeUp();
+
+	RenderThread * m_renderThread;
+	QMutex m_mutex;
+	QWaitCondition m_condition;
+	bool m_quit;
+	bool m_ticking;
+	/// @brief Set when the interval changed, ticking was started or tickNow() was called. The schedule is reset then.
+	bool m_scheduleChanged;
+	bool m_tickNow;
+	qint64 m_interval;
+	qint64 m_nextInterval;
+};
@@ -0,0 +1,332 @@
+#include "RenderThread.h"
+#include "DeckRenderer.h"
+#include "ShaderCache.h"
+#include "LiveView.h"
+
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+#include <QStandardPaths>
+#include <memory>
+#include <vector>
+#include <stdexcept>
+
+
+RenderThread::RenderThread(int deckCount, QObject * parent)
+	: QThread(parent)
+	, m_quit(false)
+	, m_deckCount(deckCount)
+	, m_renderSize(256, 256)
+	, m_scriptsChanged(deckCount, false)
+	, m_values(deckCount)
+	, m_framePending(false)
+	, m_tick()
+	, m_settings()
+	, m_frame()
+{
+	for (int i = 0; i < deckCount; ++i)
+	{
+		m_scripts.append(QString());
+	}
+	m_timeHandle = uniformHandle("time");
+	m_frameIndexHandle = uniformHandle("frameIndex");
+	m_deltaTimeHandle = uniformHandle("deltaTime");
+	connect(&m_precompiler, SIGNAL(scriptPrecompiled(const QString &, const QString &, float)), this, SIGNAL(scriptPrecompiled(const QString &, const QString &, float)));
+	connect(&m_precompiler, SIGNAL(precompilationFinished(int, int)), this, SIGNAL(precompilationFinished(int, int)));
+	//offscreen surfaces must be created in the GUI thread
+	m_surface.setFormat(LiveView::getDefaultFormat());
+	m_surface.create();
+}
+
+RenderThread::~RenderThread()
+{
+	m_mutex.lock();
+	m_quit = true;
+	m_condition.wakeAll();
+	m_mutex.unlock();
+	wait();
+}
+
+void RenderThread::setDeckCount(int count)
+{
+	QMutexLocker locker(&m_mutex);
+	count = qMax(count, 1);
+	while (m_deckCount < count)
+	{
+		m_scripts.append(QString());
+		m_scriptsChanged.append(false);
+		m_values.append(QVector<float>());
+		++m_deckCount;
+	}
+	while (m_deckCount > count)
+	{
+		m_scripts.removeLast();
+		m_scriptsChanged.removeLast();
+		m_values.removeLast();
+		--m_deckCount;
+	}
+}
+
+int RenderThread::deckCount() const
+{
+	QMutexLocker locker(&m_mutex);
+	return m_deckCount;
+}
+
+void RenderThread::wakeUp()
+{
+	if (m_quit)
+	{
+		return;
+	}
+	if (!isRunning())
+	{
+		start();
+		setPriority(QThread::HighPriority);
+	}
+	else
+		m_condition.wakeOne();
+}
+
+void RenderThread::setRenderSize(const QSize & size)
+{
+	QMutexLocker locker(&m_mutex);
+	m_renderSize = size;
+}
+
+void RenderThread::setScript(int deck, const QString & script)
+{
+	QMutexLocker locker(&m_mutex);
+	if (deck >= 0 && deck < m_deckCount)
+	{
+		m_scripts[deck] = script;
+		m_scriptsChanged[deck] = true;
+		wakeUp();
+	}
+}
+
+int RenderThread::uniformHandle(const QString & name)
+{
+	QMutexLocker locker(&m_mutex);
+	int handle = m_uniformNames.indexOf(name);
+	if (handle < 0)
+	{
+		handle = m_uniformNames.size();
+		m_uniformNames.append(name);
+	}
+	return handle;
+}
+
+void RenderThread::setScriptValues(int deck, const QVector<float> & values)
+{
+	QMutexLocker locker(&m_mutex);
+	if (deck >= 0 && deck < m_deckCount)
+	{
+		m_values[deck] = values;
+	}
+}
+
+void RenderThread::precompileScripts(const QMap<QString, QString> & scripts)
+{
+	m_precompiler.setScripts(scripts);
+}
+
+QString RenderThread::scriptPrefix() const
+{
+	QMutexLocker locker(&m_mutex);
+	return m_scriptPrefix;
+}
+
+void RenderThread::setMixSettings(const MixSettings & settings)
+{
+	QMutexLocker locker(&m_mutex);
+	m_settings = settings;
+}
+
+void RenderThread::requestFrame(const RenderTick & tick)
+{
+	QMutexLocker locker(&m_mutex);
+	//only the latest request is rendered. if the previous one hasn't been picked up yet, it is dropped
+	m_tick = tick;
+	m_framePending = true;
+	wakeUp();
+}
+
+RenderedFrame RenderThread::takeFrame()
+{
+	QMutexLocker locker(&m_mutex);
+	RenderedFrame frame = m_frame;
+	//release the images, so the render thread can reuse them without copying
+	m_frame.displayImage = QImage();
+	m_frame.previewImage = QImage();
+	return frame;
+}
+
+void RenderThread::run()
+{
+	//create context sharing resources with all other contexts
+	QOpenGLContext context;
+	context.setFormat(m_surface.format());
+	context.setShareContext(QOpenGLContext::globalShareContext());
+	if (!context.create() || !context.makeCurrent(&m_surface))
+	{
+		emit error("Failed to create OpenGL context for rendering.");
+		return;
+	}
+	m_mutex.lock();
+	m_scriptPrefix = context.isOpenGLES() ? LiveView::m_fragmentPrefixGLES2 : LiveView::m_fragmentPrefixGL2;
+	m_mutex.unlock();
+	//programs are shared by all decks and binaries are kept on disk. must be destroyed after the decks
+	std::unique_ptr<ShaderCache> shaderCache(new ShaderCache(QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/shaders"));
+	m_precompiler.setShaderCache(shaderCache.get());
+	//decks are created when the frame is rendered, so the deck count can change
+	std::vector<std::unique_ptr<DeckRenderer>> decks;
+	std::unique_ptr<DisplayMixer> mixer;
+	//number of decks the mixer failed to be created for
+	int mixerFailedCount = 0;
+	//tick times of the last frames mixed. the mixer returns earlier frames when reading back asynchronously
+	QList<qint64> tickTimes;
+
+	//m_quit is only read with m_mutex locked, the loop ends below
+	while (true)
+	{
+		m_mutex.lock();
+		//wait until a frame is requested or a script changed
+		while (!m_quit && !m_framePending && !m_scriptsChanged.contains(true))
+		{
+			m_condition.wait(&m_mutex);
+		}
+		if (m_quit)
+		{
+			m_mutex.unlock();
+			break;
+		}
+		const int deckCount = m_deckCount;
+		QStringList scripts;
+		QVector<bool> scriptsChanged = m_scriptsChanged;
+		for (int i = 0; i < deckCount; ++i)
+		{
+			scripts.append(scriptsChanged.at(i) ? m_scripts.at(i) : QString());
+			m_scriptsChanged[i] = false;
+		}
+		const bool renderFrame = m_framePending;
+		const RenderTick tick = m_tick;
+		FrameTiming timing = tick.timing;
+		const MixSettings settings = m_settings;
+		const QSize renderSize = m_renderSize;
+		const QStringList uniformNames = m_uniformNames;
+		QVector<QVector<float>> values = m_values;
+		m_framePending = false;
+		m_mutex.unlock();
+		//add or remove decks
+		while ((int)decks.size() < deckCount)
+		{
+			decks.push_back(std::unique_ptr<DeckRenderer>(new DeckRenderer(*shaderCache)));
+		}
+		while ((int)decks.size() > deckCount)
+		{
+			decks.pop_back();
+		}
+		//compile changed scripts
+		for (int i = 0; i < deckCount; ++i)
+		{
+			if (scriptsChanged.at(i))
+			{
+				try
+				{
+					decks[i]->setScript(scripts.at(i));
+					emit scriptChanged(i);
+				}
+				catch (std::runtime_error e)
+				{
+					emit scriptErrors(i, QString::fromStdString(e.what()));
+				}
+			}
+		}
+		if (!renderFrame)
+		{
+			continue;
+		}
+		//render all decks back-to-back. the values of the tick are the same for all decks
+		const int tickHandleCount = qMax(m_timeHandle, qMax(m_frameIndexHandle, m_deltaTimeHandle)) + 1;
+		for (int i = 0; i < deckCount; ++i)
+		{
+			QVector<float> & deckValues = values[i];
+			if (deckValues.size() < tickHandleCount)
+			{
+				deckValues.resize(tickHandleCount);
+			}
+			deckValues[m_timeHandle] = (float)tick.time;
+			deckValues[m_frameIndexHandle] = (float)tick.frameIndex;
+			deckValues[m_deltaTimeHandle] = (float)tick.deltaTime;
+			decks[i]->setValues(uniformNames, deckValues);
+			decks[i]->render(renderSize);
+		}
+		RenderedFrame frame;
+		frame.corrected = false;
+		frame.renderSize = decks[0]->size();
+		for (int i = 0; i < deckCount; ++i)
+		{
+			frame.deckTextures.append(decks[i]->texture());
+		}
+		//mix decks on the GPU. all decks are layered in one pass, so this only reads back the small result
+		if (deckCount != mixerFailedCount && !frame.renderSize.isEmpty())
+		{
+			//the mixing shader is built for the number of decks
+			if (!mixer || mixer->deckCount() != deckCount)
+			{
+				mixer.reset();
+				try
+				{
+					mixer.reset(new DisplayMixer(deckCount));
+					mixerFailedCount = 0;
+				}
+				catch (std::runtime_error e)
+				{
+					emit error(QString::fromStdString(e.what()));
+					mixerFailedCount = deckCount;
+				}
+			}
+			if (mixer)
+			{
+				const QSize deckSize = decks[0]->size();
+				mixer->setSources(frame.deckTextures, deckSize);
+				mixer->setLayers(settings.layers);
+				mixer->setCrossFade(settings.crossFade, settings.crossFadeCurve);
+				mixer->setResolveFilter(settings.resolveFilter);
+				mixer->setCorrection(settings.brightness, settings.contrast, settings.gamma);
+				//LED layouts are sampled on the GPU, so only one pixel per LED is read back
+				mixer->setSamplePositions(settings.ledPositions, settings.ledFootprint);
+				//without a display size the decks are mixed in their size
+				frame.displayImage = mixer->render(DisplayMixer::Display, settings.displaySize.isEmpty() ? deckSize : settings.displaySize, settings.correct);
+				//the preview is not corrected and always uses a box filter
+				frame.previewImage = mixer->render(DisplayMixer::Preview, deckSize.scaled(settings.previewSize, Qt::KeepAspectRatio).boundedTo(deckSize), false, false);
+				frame.corrected = settings.correct;
+				//attribute the time the display image waited in the pixel buffers to the frame it was rendered in
+				tickTimes.append(timing.time[FrameTiming::Tick]);
+				while (tickTimes.size() > 4)
+				{
+					tickTimes.removeFirst();
+				}
+				const int latency = mixer->latency(DisplayMixer::Display);
+				if (latency > 0 && latency < tickTimes.size())
+				{
+					timing.time[FrameTiming::Tick] = tickTimes.at(tickTimes.size() - 1 - latency);
+				}
+			}
+		}
+		//submit rendering, so contexts displaying the deck textures see the finished frames
+		context.functions()->glFlush();
+		timing.mark(FrameTiming::Rendered);
+		frame.timing = timing;
+		m_mutex.lock();
+		m_frame = frame;
+		m_mutex.unlock();
+		emit frameRendered();
+	}
+	//free resources with the context current
+	mixer.reset();
+	decks.clear();
+	m_precompiler.setShaderCache(nullptr);
+	shaderCache.reset();
+	context.doneCurrent();
+}
@@ -0,0 +1,139 @@
+#pragma once
+
+#include "DisplayMixer.h"
+#include "LatencyStatistics.h"
+#include "ScriptPrecompiler.h"
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QImage>
+#include <QVector>
+#include <QStringList>
+#include <QOffscreenSurface>
+
+
+/// @brief Render tick scheduled by RenderClock.
+struct RenderTick
+{
+	/// @brief Index of the tick since the clock was created. Passed to the scripts as "uniform float frameIndex".
+	quint64 frameIndex;
+	/// @brief Time of the tick since the clock was created in seconds. Passed to the scripts as "uniform float time".
+	double time;
+	/// @brief Time since the previous tick in seconds. Passed to the scripts as "uniform float deltaTime".
+	double deltaTime;
+	/// @brief Stage times of the frame. Tick is set.
+	FrameTiming timing;
+};
+
+/// @brief Frame published by RenderThread.
+struct RenderedFrame
+{
+	/// @brief Stage times of the frame. Rendered is set when all decks were rendered.
+	FrameTiming timing;
+	/// @brief True if color correction was applied to displayImage.
+	bool corrected;
+	/// @brief Display image mixed on the GPU. Null if the decks could not be mixed.
+	QImage displayImage;
+	/// @brief Preview image mixed on the GPU. Null if the decks could not be mixed.
+	QImage previewImage;
+	/// @brief Textures of the decks for displaying them in a LiveView. They are valid until the next-but-one frame is rendered.
+	QVector<GLuint> deckTextures;
+	/// @brief Size of the deck textures.
+	QSize renderSize;
+};
+
+/// @brief Renders all decks back-to-back into framebuffer objects using one OpenGL context in its own thread,
+/// mixes them and publishes the result. Scripts are compiled in the thread too, so the GUI never waits for the GPU.
+/// Only the latest frame requested is rendered. The context shares resources with all other contexts,
+/// so LiveView widgets can display the deck textures. This needs Qt::AA_ShareOpenGLContexts.
+class RenderThread : public QThread
+{
+	Q_OBJECT
+
+public:
+	/// @brief Create thread. The thread is started when the first script or frame is passed.
+	/// Must be created in the GUI thread.
+	/// @param deckCount Number of decks rendered.
+	RenderThread(int deckCount = 2, QObject * parent = 0);
+	~RenderThread();
+
+	/// @brief Set the number of decks rendered. Decks added have no script until setScript() is called, decks removed are destroyed.
+	/// If there are more than DisplayMixer::MaxDeckCount, the decks can not be mixed and error() is emitted.
+	void setDeckCount(int count);
+	/// @brief Get the number of decks rendered.
+	int deckCount() const;
+
+	/// @brief Set the size decks are rendered in.
+	void setRenderSize(const QSize & size);
+
+	/// @brief Set the script of a deck. It is compiled in the render thread, which then emits scriptChanged() or scriptErrors().
+	void setScript(int deck, const QString & script);
+	/// @brief Get the handle of a uniform passed to the scripts, e.g. "time" or "valueA". Handles are the same for all decks
+	/// and stay valid while the thread exists. The location of the uniform is looked up in the render thread once per script.
+	int uniformHandle(const QString & name);
+	/// @brief Set the uniform values passed to the script of a deck. They are used for all following frames.
+	/// @param values Values indexed by uniform handle, see uniformHandle().
+	void setScriptValues(int deck, const QVector<float> & values);
+	/// @brief Compile scripts in the background, so decks can switch to them without waiting for the compiler.
+	/// Emits scriptPrecompiled() for every script and precompilationFinished() when done. Aborts compiling the scripts passed before.
+	/// @param scripts Script text as shown in the script editor by path, see ScriptLibrary.
+	void precompileScripts(const QMap<QString, QString> & scripts);
+	/// @brief Get the prefix applied to scripts to make them compilable. Empty before the thread has created its context.
+	QString scriptPrefix() const;
+
+	/// @brief Set how to mix the decks. Used for all frames rendered afterwards.
+	void setMixSettings(const MixSettings & settings);
+
+	/// @brief Request rendering a frame. Can be called from any thread. Only the latest request is kept.
+	/// If the previous request has not been picked up yet, it is dropped.
+	/// @param tick Render tick. Its frame index, time and delta time are passed to the scripts of all decks.
+	void requestFrame(const RenderTick & tick);
+
+	/// @brief Get the frame rendered last. Call when frameRendered() was emitted.
+	RenderedFrame takeFrame();
+
+signals:
+	/// @brief Emitted when a frame was rendered and can be retrieved using takeFrame().
+	void frameRendered();
+	/// @brief Emitted when the script of a deck was compiled successfully and is used for rendering.
+	void scriptChanged(int deck);
+	/// @brief Emitted when the script of a deck failed to compile. The previous script is used for rendering then.
+	/// @param errors Error log from shader compilation / linking. Line numbers include scriptPrefix().
+	void scriptErrors(int deck, const QString & errors);
+	/// @brief Emitted for every script compiled by precompileScripts(). See ScriptPrecompiler::scriptPrecompiled().
+	void scriptPrecompiled(const QString & path, const QString & errors, float milliseconds);
+	/// @brief Emitted when all scripts passed to precompileScripts() have been compiled.
+	void precompilationFinished(int scriptCount, int failedCount);
+	/// @brief Emitted when the thread failed to create its context or the mixing shader for the decks.
+	void error(const QString & message);
+
+protected:
+	void run();
+
+private:
+	/// @brief Start thread or wake it up if it is already running. Call with m_mutex locked.
+	void wakeUp();
+
+	QOffscreenSurface m_surface;
+	/// @brief Compiles scripts into the shader cache of the thread.
+	ScriptPrecompiler m_precompiler;
+	mutable QMutex m_mutex;
+	QWaitCondition m_condition;
+	bool m_quit;
+	int m_deckCount;
+	QSize m_renderSize;
+	QStringList m_scripts;
+	QVector<bool> m_scriptsChanged;
+	QStringList m_uniformNames;
+	QVector<QVector<float>> m_values;
+	QString m_scriptPrefix;
+	/// @brief Handles of the uniforms set from the render tick.
+	int m_timeHandle;
+	int m_frameIndexHandle;
+	int m_deltaTimeHandle;
+	bool m_framePending;
+	RenderTick m_tick;
+	MixSettings m_settings;
+	RenderedFrame m_frame;
+};
@@ -0,0 +1,194 @@
+#include "ScriptLibrary.h"
+
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QRegExp>
+#include <QCryptographicHash>
+
+
+ScriptLibrary::ScriptLibrary(QObject * parent)
+	: QObject(parent)
+{
+	m_updateTimer.setSingleShot(true);
+	m_updateTimer.setInterval(500);
+	connect(&m_updateTimer, SIGNAL(timeout()), this, SLOT(update()));
+	connect(&m_watcher, SIGNAL(directoryChanged(const QString &)), this, SLOT(filesChanged()));
+	connect(&m_watcher, SIGNAL(fileChanged(const QString &)), this, SLOT(filesChanged()));
+}
+
+void ScriptLibrary::setPath(const QString & path)
+{
+	m_path = path;
+	m_scripts.clear();
+	update();
+}
+
+QString ScriptLibrary::path() const
+{
+	return m_path;
+}
+
+QStringList ScriptLibrary::scripts() const
+{
+	return m_scripts.keys();
+}
+
+bool ScriptLibrary::contains(const QString & path) const
+{
+	return m_scripts.contains(path);
+}
+
+ScriptInfo ScriptLibrary::script(const QString & path) const
+{
+	return m_scripts.value(path, ScriptInfo());
+}
+
+QString ScriptLibrary::nextScript(const QString & path) const
+{
+	if (m_scripts.isEmpty())
+	{
+		return QString();
+	}
+	auto next = m_scripts.upperBound(path);
+	return next != m_scripts.cend() ? next.key() : m_scripts.firstKey();
+}
+
+QString ScriptLibrary::libraryPath(const QString & path)
+{
+	return path.startsWith(":/") ? path : QDir::current().relativeFilePath(path);
+}
+
+QString ScriptLibrary::editorText(const QByteArray & data)
+{
+	//line feeds and non-breaking spaces are converted like QTextDocument does
+	QString text = data;
+	text.replace("\r\n", "\n");
+	text.replace(QChar::CarriageReturn, QChar::LineFeed);
+	text.replace(QChar::ParagraphSeparator, QChar::LineFeed);
+	text.replace(QChar::LineSeparator, QChar::LineFeed);
+	text.replace(QChar::Nbsp, QChar(' '));
+	return text;
+}
+
+QList<QPair<QString, QString>> ScriptLibrary::parseParameters(const QByteArray & data)
+{
+	QList<QPair<QString, QString>> parameters;
+	QRegExp commentExp("^//(\\w+)\\s*=\\s*(\\S+)$");
+	commentExp.setMinimal(true);
+	QList<QByteArray> lines = data.split(QChar::LineFeed);
+	for (auto line : lines)
+	{
+		if (commentExp.indexIn(line) >= 0)
+		{
+			//get variable name and value from line
+			parameters.append(qMakePair(commentExp.cap(1), commentExp.cap(2)));
+		}
+	}
+	return parameters;
+}
+
+void ScriptLibrary::filesChanged()
+{
+	//restart timer, so the library is updated when files have stopped changing
+	m_updateTimer.start();
+}
+
+void ScriptLibrary::update()
+{
+	QStringList changedScripts;
+	QMap<QString, ScriptInfo> scripts;
+	QStringList directories;
+	if (!m_path.isEmpty() && QFileInfo(m_path).isDir())
+	{
+		directories << m_path;
+		QDirIterator it(m_path, QStringList() << "*.fs", QDir::Files | QDir::AllDirs | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
+		while (it.hasNext())
+		{
+			it.next();
+			const QFileInfo fileInfo = it.fileInfo();
+			if (fileInfo.isDir())
+			{
+				directories << fileInfo.filePath();
+				continue;
+			}
+			const QString path = libraryPath(fileInfo.filePath());
+			//only read scripts that were added or changed
+			auto existing = m_scripts.constFind(path);
+			if (existing != m_scripts.cend() && existing->lastModified == fileInfo.lastModified() && existing->size == fileInfo.size())
+			{
+				scripts.insert(path, existing.value());
+				continue;
+			}
+			QFile file(fileInfo.filePath());
+			if (!file.open(QFile::ReadOnly))
+			{
+				continue;
+			}
+			const QByteArray data = file.readAll();
+			const QByteArray hash = QCryptographicHash::hash(data, QCryptographicHash::Sha1);
+			if (existing != m_scripts.cend() && existing->hash == hash)
+			{
+				//only the time stamp changed. keep the compile status
+				ScriptInfo info = existing.value();
+				info.lastModified = fileInfo.lastModified();
+				info.size = fileInfo.size();
+				scripts.insert(path, info);
+				continue;
+			}
+			ScriptInfo info;
+			info.path = path;
+			info.text = editorText(data);
+			info.parameters = parseParameters(data);
+			info.hash = hash;
+			info.lastModified = fileInfo.lastModified();
+			info.size = fileInfo.size();
+			scripts.insert(path, info);
+			changedScripts << path;
+		}
+	}
+	bool scriptsRemoved = false;
+	for (auto iter = m_scripts.cbegin(); iter != m_scripts.cend(); ++iter)
+	{
+		if (!scripts.contains(iter.key()))
+		{
+			scriptsRemoved = true;
+			break;
+		}
+	}
+	m_scripts = scripts;
+	//watch directories for added and removed scripts and files for changes. files are removed from the watcher when they are replaced, so add them again
+	if (!m_watcher.files().isEmpty())
+	{
+		m_watcher.removePaths(m_watcher.files());
+	}
+	if (!m_watcher.directories().isEmpty())
+	{
+		m_watcher.removePaths(m_watcher.directories());
+	}
+	if (!directories.isEmpty())
+	{
+		m_watcher.addPaths(directories);
+	}
+	if (!m_scripts.isEmpty())
+	{
+		m_watcher.addPaths(m_scripts.keys());
+	}
+	if (scriptsRemoved || !changedScripts.isEmpty())
+	{
+		emit scriptsChanged(changedScripts);
+	}
+}
+
+void ScriptLibrary::setCompileResult(const QString & path, const QString & errors, float milliseconds)
+{
+	auto iter = m_scripts.find(path);
+	if (iter != m_scripts.end())
+	{
+		iter->compileStatus = errors.isEmpty() ? ScriptInfo::Compiled : ScriptInfo::Failed;
+		iter->errors = errors;
+		iter->compileTime = milliseconds;
+		emit compileStatusChanged(path);
+	}
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QDateTime>
+#include <QList>
+#include <QPair>
+#include <QMap>
+#include <QTimer>
+#include <QFileSystemWatcher>
+
+
+/// @brief Script in the library with everything needed to load it into a deck.
+struct ScriptInfo
+{
+	enum CompileStatus { NotCompiled, Compiled, Failed };
+
+	ScriptInfo() : size(0), compileStatus(NotCompiled), compileTime(0.0f) {}
+
+	/// @brief Path of the script file relative to the working directory. Used as a key.
+	QString path;
+	/// @brief Script text as shown in the script editor, see ScriptLibrary::editorText().
+	QString text;
+	/// @brief Parameter defaults from "//valueA = 0.5" comments in the order they appear.
+	QList<QPair<QString, QString>> parameters;
+	/// @brief SHA-1 hash of the file content.
+	QByteArray hash;
+	QDateTime lastModified;
+	qint64 size;
+	CompileStatus compileStatus;
+	/// @brief Error log if the script failed to compile.
+	QString errors;
+	/// @brief Time it took to compile the script in ms.
+	float compileTime;
+};
+
+/// @brief Indexes the scripts in the effects directory once and keeps the index current by watching the directory.
+/// Scripts are read and parsed when they are added or changed, so decks and menus can be served from memory.
+class ScriptLibrary : public QObject
+{
+	Q_OBJECT
+
+public:
+	ScriptLibrary(QObject * parent = 0);
+
+	/// @brief Set the directory scripts are indexed in, including subdirectories, and index it.
+	void setPath(const QString & path);
+	QString path() const;
+
+	/// @brief Get the paths of all scripts sorted by name.
+	QStringList scripts() const;
+	/// @brief Check if a script is in the library.
+	/// @param path Path of the script file relative to the working directory, see libraryPath().
+	bool contains(const QString & path) const;
+	/// @brief Get a script. Returns an empty ScriptInfo if the script is not in the library.
+	ScriptInfo script(const QString & path) const;
+	/// @brief Get the script following a script in name order, wrapping around at the end.
+	/// Returns the first script if the script is not in the library and an empty string if the library is empty.
+	QString nextScript(const QString & path) const;
+
+	/// @brief Convert a path to the form used as a key in the library. Resource paths are kept, others are made relative to the working directory.
+	static QString libraryPath(const QString & path);
+	/// @brief Convert script text like the script editor does. QPlainTextEdit::toPlainText() returns lines separated by line feeds.
+	static QString editorText(const QByteArray & data);
+	/// @brief Find parameter defaults like "//valueA = 0.5" in script text.
+	static QList<QPair<QString, QString>> parseParameters(const QByteArray & data);
+
+public slots:
+	/// @brief Check the directory for added, removed or changed scripts. Only those are read.
+	void update();
+	/// @brief Store the result of compiling a script. Emits compileStatusChanged().
+	/// @param errors Error log if the script failed to compile. Empty if it compiled fine.
+	void setCompileResult(const QString & path, const QString & errors, float milliseconds);
+
+signals:
+	/// @brief Emitted when scripts were added, removed or changed.
+	/// @param changedScripts Paths of the scripts added or changed.
+	void scriptsChanged(const QStringList & changedScripts);
+	/// @brief Emitted when a script was compiled.
+	void compileStatusChanged(const QString & path);
+
+private slots:
+	void filesChanged();
+
+private:
+	QString m_path;
+	/// @brief Scripts by path. QMap keeps them sorted by name.
+	QMap<QString, ScriptInfo> m_scripts;
+	QFileSystemWatcher m_watcher;
+	/// @brief Waits until files have stopped changing, as editors often write files in several steps.
+	QTimer m_updateTimer;
+};
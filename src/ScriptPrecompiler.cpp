@@ -0,0 +1,154 @@
+#include "ScriptPrecompiler.h"
+#include "ShaderCache.h"
+#include "DeckRenderer.h"
+#include "LiveView.h"
+
+#include <QOpenGLContext>
+#include <QElapsedTimer>
+#include <QDebug>
+#include <stdexcept>
+
+
+ScriptPrecompiler::ScriptPrecompiler(QObject * parent)
+	: QThread(parent)
+	, m_quit(false)
+	, m_shaderCache(nullptr)
+	, m_scriptsChanged(false)
+{
+	//offscreen surfaces must be created in the GUI thread
+	m_surface.setFormat(LiveView::getDefaultFormat());
+	m_surface.create();
+}
+
+ScriptPrecompiler::~ScriptPrecompiler()
+{
+	m_mutex.lock();
+	m_quit = true;
+	m_condition.wakeAll();
+	m_mutex.unlock();
+	wait();
+}
+
+void ScriptPrecompiler::wakeUp()
+{
+	if (m_quit)
+	{
+		return;
+	}
+	if (!isRunning())
+	{
+		start();
+		setPriority(QThread::LowestPriority);
+	}
+	else
+		m_condition.wakeOne();
+}
+
+void ScriptPrecompiler::setShaderCache(ShaderCache * shaderCache)
+{
+	//wait for the script currently compiled
+	QMutexLocker cacheLocker(&m_cacheMutex);
+	QMutexLocker locker(&m_mutex);
+	m_shaderCache = shaderCache;
+	if (m_shaderCache && m_scriptsChanged)
+	{
+		wakeUp();
+	}
+}
+
+void ScriptPrecompiler::setScripts(const QMap<QString, QString> & scripts)
+{
+	QMutexLocker locker(&m_mutex);
+	m_scripts = scripts;
+	m_scriptsChanged = true;
+	wakeUp();
+}
+
+void ScriptPrecompiler::run()
+{
+	//create context sharing resources with the render thread
+	QOpenGLContext context;
+	context.setFormat(m_surface.format());
+	context.setShareContext(QOpenGLContext::globalShareContext());
+	if (!context.create() || !context.makeCurrent(&m_surface))
+	{
+		qDebug() << "Failed to create OpenGL context for precompiling scripts.";
+		return;
+	}
+	//use the same sources as DeckRenderer, so programs are found in the cache
+	const QString vertexSource = QString(context.isOpenGLES() ? LiveView::m_vertexPrefixGLES2 : LiveView::m_vertexPrefixGL2) + LiveView::m_defaultVertexCode;
+	const QString fragmentPrefix = context.isOpenGLES() ? LiveView::m_fragmentPrefixGLES2 : LiveView::m_fragmentPrefixGL2;
+
+	m_mutex.lock();
+	while (!m_quit)
+	{
+		//wait until scripts are passed and the render thread has created its cache
+		if (!m_scriptsChanged || !m_shaderCache)
+		{
+			m_condition.wait(&m_mutex);
+			continue;
+		}
+		const QMap<QString, QString> scripts = m_scripts;
+		m_scriptsChanged = false;
+		//the cache keeps all programs of the scripts in addition to the ones used recently, so they are not deleted again
+		int programCount = 0;
+		for (auto iter = scripts.cbegin(); iter != scripts.cend(); ++iter)
+		{
+			programCount += DeckRenderer::splitPasses(iter.value()).size();
+		}
+		int compiledCount = 0;
+		int failedCount = 0;
+		for (auto iter = scripts.cbegin(); iter != scripts.cend(); ++iter)
+		{
+			//start over if the list changed
+			if (m_quit || m_scriptsChanged)
+			{
+				break;
+			}
+			m_mutex.unlock();
+			QElapsedTimer timer;
+			timer.start();
+			QString errors;
+			bool cacheValid = true;
+			m_cacheMutex.lock();
+			if (m_shaderCache)
+			{
+				m_shaderCache->setPrecompiledCount(programCount);
+				try
+				{
+					//compile every pass like DeckRenderer does
+					const QVector<ScriptPass> passes = DeckRenderer::splitPasses(iter.value());
+					for (auto pass : passes)
+					{
+						m_shaderCache->precompile(vertexSource, fragmentPrefix + pass.source);
+					}
+				}
+				catch (std::runtime_error e)
+				{
+					errors = QString::fromStdString(e.what());
+				}
+			}
+			else
+			{
+				cacheValid = false;
+			}
+			m_cacheMutex.unlock();
+			const float milliseconds = timer.nsecsElapsed() / 1000000.0f;
+			m_mutex.lock();
+			if (!cacheValid)
+			{
+				//the render thread has stopped. compile everything again when it has started again
+				m_scriptsChanged = true;
+				break;
+			}
+			emit scriptPrecompiled(iter.key(), errors, milliseconds);
+			++compiledCount;
+			failedCount += errors.isEmpty() ? 0 : 1;
+		}
+		if (!m_quit && !m_scriptsChanged)
+		{
+			emit precompilationFinished(compiledCount, failedCount);
+		}
+	}
+	m_mutex.unlock();
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QStringList>
+#include <QMap>
+#include <QOffscreenSurface>
+
+class ShaderCache;
+
+
+/// @brief Compiles all scripts of the effects library in the background with its own OpenGL context and passes them to the
+/// shader cache of RenderThread, so a deck can switch to any of them without waiting for the compiler.
+/// The thread runs at the lowest priority, so it does not take time from rendering. Created and driven by RenderThread.
+class ScriptPrecompiler : public QThread
+{
+	Q_OBJECT
+
+public:
+	/// @brief Create precompiler. Must be created in the GUI thread. The thread is started when scripts are passed.
+	ScriptPrecompiler(QObject * parent = 0);
+	~ScriptPrecompiler();
+
+	/// @brief Set the cache scripts are compiled into. Called by RenderThread with its context current.
+	/// When passing nullptr, this waits until the script currently compiled is done, so the cache can be destroyed.
+	void setShaderCache(ShaderCache * shaderCache);
+
+	/// @brief Set the scripts to compile. Scripts compiled before and not changed since are skipped by the cache.
+	/// Compiling the previous scripts is aborted.
+	/// @param scripts Script text as shown in the script editor by path, see ScriptLibrary.
+	void setScripts(const QMap<QString, QString> & scripts);
+
+signals:
+	/// @brief Emitted for every script compiled.
+	/// @param path Path of the script file.
+	/// @param errors Error log if the script failed to compile. Empty if it compiled fine.
+	/// @param milliseconds Time it took to compile the script, or to find it in the cache.
+	void scriptPrecompiled(const QString & path, const QString & errors, float milliseconds);
+	/// @brief Emitted when all scripts passed have been compiled.
+	/// @param scriptCount Number of scripts compiled.
+	/// @param failedCount Number of scripts that failed to compile.
+	void precompilationFinished(int scriptCount, int failedCount);
+
+protected:
+	void run();
+
+private:
+	/// @brief Start thread or wake it up if it is already running. Call with m_mutex locked.
+	void wakeUp();
+
+	QOffscreenSurface m_surface;
+	QMutex m_mutex;
+	QWaitCondition m_condition;
+	/// @brief Locked while a script is compiled, so the cache is not destroyed meanwhile.
+	QMutex m_cacheMutex;
+	bool m_quit;
+	ShaderCache * m_shaderCache;
+	QMap<QString, QString> m_scripts;
+	bool m_scriptsChanged;
+};
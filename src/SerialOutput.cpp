@@ -0,0 +1,219 @@
+#include "SerialOutput.h"
+#include "DisplayEncoder.h"
+
+#include <QtSerialPort/QSerialPort>
+#include <QTime>
+
+#if defined(Q_OS_UNIX)
+	#include <sys/ioctl.h>
+#elif defined(Q_OS_WIN)
+	#include <windows.h>
+#endif
+
+
+SerialOutput::SerialOutput(QObject *parent)
+	: LEDOutput(parent)
+	, portName("portName", "")
+	, baudrate("baudrate", QSerialPort::Baud115200, QSerialPort::Baud1200, 500000)
+	, m_baudrate(QSerialPort::Baud115200)
+	, m_currentPortNameChanged(false)
+	, m_currentBaudrate(0)
+	, m_currentBaudrateChanged(false)
+{
+	connect(portName.GetSharedParameter().get(), SIGNAL(valueChanged(const QString &)), this, SLOT(setPortName(const QString &)));
+	connect(baudrate.GetSharedParameter().get(), SIGNAL(valueChanged(int)), this, SLOT(setBaudrate(int)));
+}
+
+SerialOutput::~SerialOutput()
+{
+	stop();
+}
+
+QString SerialOutput::typeName() const
+{
+	return "serial";
+}
+
+QString SerialOutput::targetName() const
+{
+	return portName;
+}
+
+void SerialOutput::toXML(QDomElement & element) const
+{
+	LEDOutput::toXML(element);
+	portName.toXML(element);
+	baudrate.toXML(element);
+}
+
+SerialOutput & SerialOutput::fromXML(QDomElement & element)
+{
+	LEDOutput::fromXML(element);
+	portName.fromXML(element);
+	baudrate.fromXML(element);
+	return *this;
+}
+
+void SerialOutput::setPortName(const QString &name)
+{
+	QMutexLocker locker(&m_mutex);
+	m_portName = name;
+	settingsChanged();
+}
+
+void SerialOutput::setBaudrate(int rate)
+{
+	QMutexLocker locker(&m_mutex);
+	m_baudrate = rate;
+	settingsChanged();
+}
+
+void SerialOutput::takeSettings()
+{
+	if (m_currentPortName != m_portName) {
+		m_currentPortName = m_portName;
+		m_currentPortNameChanged = true;
+	}
+	if (m_currentBaudrate != m_baudrate) {
+		m_currentBaudrate = m_baudrate;
+		m_currentBaudrateChanged = true;
+	}
+}
+
+void SerialOutput::prepare(DisplayEncoder & encoder)
+{
+	if (!m_serial)
+	{
+		m_serial.reset(new QSerialPort);
+	}
+	//open new serial port device
+	if (m_currentPortNameChanged)
+	{
+		//close old port down
+		m_serial->close();
+		m_currentPortNameChanged = false;
+		//check if a proper port name was passed
+		if (!m_currentPortName.isEmpty())
+		{
+			m_serial->setPortName(m_currentPortName);
+			//try opening
+			if (!m_serial->open(QIODevice::ReadWrite))
+			{
+				emit error(tr("Can't open %1, error code %2").arg(m_currentPortName).arg(m_serial->error()));
+				emit portOpened(false);
+			}
+			else
+			{
+				//set up serial port
+				m_serial->setBaudRate(m_currentBaudrate);
+				m_serial->setDataBits(QSerialPort::Data8);
+				m_serial->setParity(QSerialPort::NoParity);
+				m_serial->setStopBits(QSerialPort::OneStop);
+				m_serial->setFlowControl(QSerialPort::NoFlowControl);
+				m_serial->setBreakEnabled(false);
+				m_currentBaudrateChanged = false;
+				encoder.forceKeyFrame();
+				emit portOpened(true);
+			}
+		}
+	}
+	if (m_currentBaudrateChanged)
+	{
+		m_serial->setBaudRate(m_currentBaudrate);
+		m_currentBaudrateChanged = false;
+	}
+	encoder.setColorOrder(DisplayEncoder::OrderGRB);
+}
+
+bool SerialOutput::isReady() const
+{
+	return m_serial && m_serial->isOpen() && m_serial->isWritable();
+}
+
+int SerialOutput::writeFrame(const QImage & image, DisplayEncoder & encoder, int waitTimeout)
+{
+	//read some data from the device so serial port is not overrun.
+	//the device sends its identifier when idle or when it needs a key frame for the compressed protocol
+	if (m_serial->bytesAvailable() > 0 && m_serial->readAll().contains("Ada"))
+	{
+		encoder.forceKeyFrame();
+	}
+	//convert image to LED data. only do this when actually sending, as compressed frames depend on the previous frame
+	const QByteArray & data = encoder.encode(image);
+	if (data.size() <= 0)
+	{
+		return -1;
+	}
+	//now write request and wait until it has left the machine, so exactly one frame is in flight.
+	//allow for the transmission time of the frame, which can be longer than the timeout on slow links
+	m_serial->write(data.constData(), data.size());
+	if (!waitForFrameWritten(waitTimeout + transmissionTime(data.size()) / 1000))
+	{
+		emit timeout(tr("Wait write request timeout on %1 %2").arg(m_currentPortName).arg(QTime::currentTime().toString()));
+		//the device may have missed part of the frame, so the next compressed frame can not be based on it
+		encoder.forceKeyFrame();
+		return -1;
+	}
+	emit response("Sent");
+	return data.size();
+}
+
+int SerialOutput::transmissionTime(int bytes) const
+{
+	//8N1 needs 10 bits per byte
+	return (qint64)bytes * 10 * 1000000 / (m_currentBaudrate > 0 ? m_currentBaudrate : 115200);
+}
+
+void SerialOutput::finish()
+{
+	//the port was created in the output thread, so delete it there
+	m_serial.reset();
+}
+
+bool SerialOutput::waitForFrameWritten(int timeout)
+{
+	QElapsedTimer timer;
+	timer.start();
+	//hand all data over to the operating system
+	while (m_serial->bytesToWrite() > 0)
+	{
+		const int remaining = timeout - timer.elapsed();
+		if (remaining <= 0 || !m_serial->waitForBytesWritten(remaining))
+		{
+			return false;
+		}
+	}
+	//wait until the operating system has put all data on the line
+	int queued = outputQueueSize();
+	while (queued > 0)
+	{
+		if (timer.elapsed() >= timeout)
+		{
+			return false;
+		}
+		//sleep about as long as the remaining bytes need for transmission, but poll at least every 2ms
+		const int baud = m_serial->baudRate() > 0 ? m_serial->baudRate() : 115200;
+		QThread::usleep(qBound((qint64)100, (qint64)queued * 10 * 1000000 / baud, (qint64)2000));
+		queued = outputQueueSize();
+	}
+	return true;
+}
+
+int SerialOutput::outputQueueSize() const
+{
+#if defined(Q_OS_UNIX)
+	int queued = 0;
+	if (ioctl(m_serial->handle(), TIOCOUTQ, &queued) == 0)
+	{
+		return queued;
+	}
+#elif defined(Q_OS_WIN)
+	DWORD errors = 0;
+	COMSTAT status;
+	if (ClearCommError(m_serial->handle(), &errors, &status))
+	{
+		return status.cbOutQue;
+	}
+#endif
+	return 0;
+}
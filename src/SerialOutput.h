@@ -0,0 +1,59 @@
+#pragma once
+
+#include "LEDOutput.h"
+
+#include <memory>
+
+class QSerialPort;
+
+
+/// @brief Sends display frames to one LED controller connected to a serial port using the Adalight or compressed protocol.
+class SerialOutput : public LEDOutput
+{
+	Q_OBJECT
+
+public:
+	/// brief Shared pointer of SerialOutput object.
+	typedef std::shared_ptr<SerialOutput> SPtr;
+
+	SerialOutput(QObject *parent = 0);
+	~SerialOutput();
+
+	virtual QString typeName() const;
+	virtual QString targetName() const;
+
+	virtual void toXML(QDomElement & element) const;
+	virtual SerialOutput & fromXML(QDomElement & element);
+
+	ParameterQString portName;
+	ParameterInt baudrate;
+
+protected:
+	virtual void takeSettings();
+	virtual void prepare(DisplayEncoder & encoder);
+	virtual bool isReady() const;
+	virtual int writeFrame(const QImage & image, DisplayEncoder & encoder, int waitTimeout);
+	virtual void finish();
+	virtual int transmissionTime(int bytes) const;
+
+private slots:
+	void setPortName(const QString &name);
+	void setBaudrate(int baudrate = 115200);
+
+private:
+	/// @brief Wait until all data has been written to the serial port and left the operating system buffers.
+	bool waitForFrameWritten(int timeout);
+	/// @brief Get the number of bytes in the operating system output buffer of the serial port, if the system supports it.
+	int outputQueueSize() const;
+
+	//settings set from the outside, protected by m_mutex
+	QString m_portName;
+	int m_baudrate;
+	//settings used by the output thread
+	QString m_currentPortName;
+	bool m_currentPortNameChanged;
+	int m_currentBaudrate;
+	bool m_currentBaudrateChanged;
+	//serial port. created in the output thread
+	std::unique_ptr<QSerialPort> m_serial;
+};
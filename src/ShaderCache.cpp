@@ -0,0 +1,300 @@
+#include "ShaderCache.h"
+
+#include <QOpenGLContext>
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <stdexcept>
+
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#endif
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#endif
+#ifndef GL_NUM_PROGRAM_BINARY_FORMATS
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+
+
+ShaderCache::ShaderCache(const QString & directory, int maxPrograms, qint64 maxDiskSize)
+	: m_getProgramBinary(nullptr)
+	, m_programBinary(nullptr)
+	, m_programParameteri(nullptr)
+	, m_directory(directory)
+	, m_maxPrograms(maxPrograms)
+	, m_precompiledCount(0)
+	, m_maxDiskSize(maxDiskSize)
+{
+	QOpenGLContext * context = QOpenGLContext::currentContext();
+	QOpenGLFunctions * functions = context->functions();
+	m_driver.append(reinterpret_cast<const char *>(functions->glGetString(GL_VENDOR)));
+	m_driver.append(reinterpret_cast<const char *>(functions->glGetString(GL_RENDERER)));
+	m_driver.append(reinterpret_cast<const char *>(functions->glGetString(GL_VERSION)));
+	//program binaries are available on OpenGL 4.1 and OpenGL ES 3 or through extensions
+	const QPair<int, int> version = context->format().version();
+	bool binariesSupported = false;
+	if (context->isOpenGLES())
+	{
+		binariesSupported = version.first >= 3 || context->hasExtension("GL_OES_get_program_binary");
+	}
+	else
+	{
+		binariesSupported = version >= qMakePair(4, 1) || context->hasExtension("GL_ARB_get_program_binary");
+	}
+	if (binariesSupported && !m_directory.isEmpty())
+	{
+		m_getProgramBinary = reinterpret_cast<GetProgramBinaryFunction>(context->getProcAddress("glGetProgramBinary"));
+		m_programBinary = reinterpret_cast<ProgramBinaryFunction>(context->getProcAddress("glProgramBinary"));
+		if (!m_getProgramBinary || !m_programBinary)
+		{
+			m_getProgramBinary = reinterpret_cast<GetProgramBinaryFunction>(context->getProcAddress("glGetProgramBinaryOES"));
+			m_programBinary = reinterpret_cast<ProgramBinaryFunction>(context->getProcAddress("glProgramBinaryOES"));
+		}
+		m_programParameteri = reinterpret_cast<ProgramParameteriFunction>(context->getProcAddress("glProgramParameteri"));
+		//some drivers support the functions, but no binary format
+		GLint formatCount = 0;
+		functions->glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+		if (!m_getProgramBinary || !m_programBinary || formatCount <= 0)
+		{
+			m_getProgramBinary = nullptr;
+			m_programBinary = nullptr;
+			m_programParameteri = nullptr;
+		}
+	}
+}
+
+ShaderCache::~ShaderCache()
+{
+	QMutexLocker locker(&m_mutex);
+	trimPrograms(0);
+	//programs still in use are deleted by their users
+}
+
+QByteArray ShaderCache::key(const QString & vertexSource, const QString & fragmentSource) const
+{
+	QCryptographicHash hash(QCryptographicHash::Sha1);
+	hash.addData(m_driver);
+	hash.addData(vertexSource.toUtf8());
+	//separate sources, so moving code from one to the other changes the hash
+	hash.addData("\0", 1);
+	hash.addData(fragmentSource.toUtf8());
+	return hash.result().toHex();
+}
+
+QString ShaderCache::binaryPath(const QByteArray & key) const
+{
+	return m_directory + "/" + QString::fromLatin1(key) + ".bin";
+}
+
+QOpenGLShaderProgram * ShaderCache::acquire(const QString & vertexSource, const QString & fragmentSource)
+{
+	const QByteArray programKey = key(vertexSource, fragmentSource);
+	//check if the program is in memory
+	m_mutex.lock();
+	for (int i = 0; i < m_programs.size(); ++i)
+	{
+		if (m_programs.at(i).key == programKey)
+		{
+			QOpenGLShaderProgram * program = m_programs.takeAt(i).program;
+			m_acquired.insert(program, programKey);
+			m_mutex.unlock();
+			return program;
+		}
+	}
+	m_mutex.unlock();
+	//this throws if the program fails to compile
+	QOpenGLShaderProgram * program = create(programKey, vertexSource, fragmentSource);
+	QMutexLocker locker(&m_mutex);
+	m_acquired.insert(program, programKey);
+	return program;
+}
+
+void ShaderCache::precompile(const QString & vertexSource, const QString & fragmentSource)
+{
+	const QByteArray programKey = key(vertexSource, fragmentSource);
+	m_mutex.lock();
+	bool cached = !m_acquired.keys(programKey).isEmpty();
+	for (int i = 0; !cached && i < m_programs.size(); ++i)
+	{
+		cached = m_programs.at(i).key == programKey;
+	}
+	m_mutex.unlock();
+	if (cached)
+	{
+		return;
+	}
+	//this throws if the program fails to compile
+	QOpenGLShaderProgram * program = create(programKey, vertexSource, fragmentSource);
+	//make sure the program is complete before it is used in another context
+	QOpenGLContext::currentContext()->functions()->glFinish();
+	Entry entry;
+	entry.key = programKey;
+	entry.program = program;
+	QMutexLocker locker(&m_mutex);
+	m_programs.prepend(entry);
+	trimPrograms(m_maxPrograms + m_precompiledCount);
+}
+
+QOpenGLShaderProgram * ShaderCache::create(const QByteArray & key, const QString & vertexSource, const QString & fragmentSource)
+{
+	//check if the program is on disk
+	QOpenGLShaderProgram * program = loadBinary(key);
+	if (!program)
+	{
+		//compile and link from source
+		program = new QOpenGLShaderProgram();
+		if (!program->addShaderFromSourceCode(QOpenGLShader::Vertex, vertexSource)
+			|| !program->addShaderFromSourceCode(QOpenGLShader::Fragment, fragmentSource))
+		{
+			const QString errors = program->log();
+			delete program;
+			throw std::runtime_error(errors.toStdString());
+		}
+		if (m_programParameteri)
+		{
+			m_programParameteri(program->programId(), GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+		}
+		if (!program->link())
+		{
+			const QString errors = program->log();
+			delete program;
+			throw std::runtime_error(errors.toStdString());
+		}
+		storeBinary(key, program);
+	}
+	return program;
+}
+
+void ShaderCache::release(QOpenGLShaderProgram * program)
+{
+	QMutexLocker locker(&m_mutex);
+	auto iter = m_acquired.find(program);
+	if (iter == m_acquired.end())
+	{
+		delete program;
+		return;
+	}
+	//keep program as most recently used
+	Entry entry;
+	entry.key = iter.value();
+	entry.program = program;
+	m_acquired.erase(iter);
+	m_programs.prepend(entry);
+	trimPrograms(m_maxPrograms + m_precompiledCount);
+}
+
+void ShaderCache::setPrecompiledCount(int count)
+{
+	QMutexLocker locker(&m_mutex);
+	m_precompiledCount = qMax(count, 0);
+	trimPrograms(m_maxPrograms + m_precompiledCount);
+}
+
+void ShaderCache::trimPrograms(int count)
+{
+	while (m_programs.size() > qMax(count, 0))
+	{
+		delete m_programs.takeLast().program;
+	}
+}
+
+QOpenGLShaderProgram * ShaderCache::loadBinary(const QByteArray & key)
+{
+	if (!m_programBinary)
+	{
+		return nullptr;
+	}
+	const QString path = binaryPath(key);
+	QFile file(path);
+	if (!file.open(QIODevice::ReadOnly))
+	{
+		return nullptr;
+	}
+	quint32 format = 0;
+	QByteArray binary;
+	QDataStream stream(&file);
+	stream >> format >> binary;
+	if (stream.status() != QDataStream::Ok || binary.isEmpty())
+	{
+		file.close();
+		QFile::remove(path);
+		return nullptr;
+	}
+	QOpenGLShaderProgram * program = new QOpenGLShaderProgram();
+	program->create();
+	m_programBinary(program->programId(), format, binary.constData(), binary.size());
+	//link() does not link programs without shaders again, but only checks if loading the binary succeeded
+	if (!program->link())
+	{
+		//the binary is from a different driver version. it is replaced when the program has been compiled again
+		delete program;
+		file.close();
+		QFile::remove(path);
+		return nullptr;
+	}
+#if QT_VERSION >= QT_VERSION_CHECK(5, 10, 0)
+	//mark file as recently used, so it is not deleted first when the directory is trimmed
+	file.setFileTime(QDateTime::currentDateTime(), QFileDevice::FileModificationTime);
+#endif
+	return program;
+}
+
+void ShaderCache::storeBinary(const QByteArray & key, QOpenGLShaderProgram * program)
+{
+	if (!m_getProgramBinary)
+	{
+		return;
+	}
+	GLint length = 0;
+	QOpenGLContext::currentContext()->functions()->glGetProgramiv(program->programId(), GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0)
+	{
+		return;
+	}
+	QByteArray binary(length, 0);
+	GLsizei written = 0;
+	GLenum format = 0;
+	m_getProgramBinary(program->programId(), length, &written, &format, binary.data());
+	if (written <= 0)
+	{
+		return;
+	}
+	binary.resize(written);
+	//write to a temporary file first, so other instances never read partially written binaries
+	if (!QDir().mkpath(m_directory))
+	{
+		return;
+	}
+	QSaveFile file(binaryPath(key));
+	if (!file.open(QIODevice::WriteOnly))
+	{
+		return;
+	}
+	QDataStream stream(&file);
+	stream << (quint32)format << binary;
+	if (file.commit())
+	{
+		trimDirectory();
+	}
+}
+
+void ShaderCache::trimDirectory()
+{
+	//files are sorted by modification time, the most recently used one first
+	QDir dir(m_directory);
+	const QFileInfoList files = dir.entryInfoList(QStringList("*.bin"), QDir::Files, QDir::Time);
+	qint64 size = 0;
+	for (auto file : files)
+	{
+		size += file.size();
+		if (size > m_maxDiskSize)
+		{
+			QFile::remove(file.absoluteFilePath());
+		}
+	}
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <QString>
+#include <QByteArray>
+#include <QList>
+#include <QHash>
+#include <QMutex>
+#include <QOpenGLFunctions>
+#include <QOpenGLShaderProgram>
+
+
+/// @brief Caches linked shader programs, so switching to a script that was used before does not compile and link it again.
+/// Programs are identified by a hash of their vertex and fragment source and the OpenGL driver. Programs not in use are kept
+/// in memory up to a maximum count plus the number of precompiled programs, see setPrecompiledCount(), and the least recently
+/// used one is deleted when it is exceeded. If the driver supports
+/// program binaries, they are also stored on disk, so programs are loaded from there after restarting, and the least recently
+/// used files are deleted when the maximum size of the directory is exceeded.
+/// Does not own an OpenGL context. It is created and destroyed by RenderThread with its context current.
+/// It can be used from all threads with a context current that shares resources with it, see ScriptPrecompiler.
+class ShaderCache
+{
+public:
+	/// @brief Create cache.
+	/// @param directory Directory program binaries are stored in. Created if it does not exist. Pass an empty string to only cache in memory.
+	/// @param maxPrograms Maximum number of programs not in use kept in memory.
+	/// @param maxDiskSize Maximum size of all program binaries on disk in bytes.
+	ShaderCache(const QString & directory, int maxPrograms = 64, qint64 maxDiskSize = 32 * 1024 * 1024);
+	~ShaderCache();
+
+	/// @brief Get a linked program for the sources. It is taken from memory or disk or compiled and linked if it is not cached.
+	/// The program belongs to the caller until it is passed to release(). Programs are never shared, so callers can keep uniform values in them.
+	/// @throw std::runtime_error with the error log if the program fails to compile or link.
+	QOpenGLShaderProgram * acquire(const QString & vertexSource, const QString & fragmentSource);
+	/// @brief Pass a program returned by acquire() back to the cache when it is not used anymore.
+	void release(QOpenGLShaderProgram * program);
+
+	/// @brief Compile and link a program and keep it in memory, so acquire() returns it right away. Does nothing if it is cached already.
+	/// @throw std::runtime_error with the error log if the program fails to compile or link.
+	void precompile(const QString & vertexSource, const QString & fragmentSource);
+	/// @brief Set the number of programs kept in memory in addition to maxPrograms, e.g. the number of passes of all scripts precompiled.
+	/// Without it precompiling more programs than maxPrograms would delete the first ones again.
+	void setPrecompiledCount(int count);
+
+private:
+	typedef void (QOPENGLF_APIENTRYP GetProgramBinaryFunction)(GLuint program, GLsizei bufSize, GLsizei * length, GLenum * binaryFormat, void * binary);
+	typedef void (QOPENGLF_APIENTRYP ProgramBinaryFunction)(GLuint program, GLenum binaryFormat, const void * binary, GLsizei length);
+	typedef void (QOPENGLF_APIENTRYP ProgramParameteriFunction)(GLuint program, GLenum pname, GLint value);
+
+	/// @brief Program not in use kept in memory.
+	struct Entry
+	{
+		QByteArray key;
+		QOpenGLShaderProgram * program;
+	};
+
+	/// @brief Get the hash identifying a program.
+	QByteArray key(const QString & vertexSource, const QString & fragmentSource) const;
+	/// @brief Load a program from disk or compile and link it. Call with m_mutex unlocked.
+	/// @throw std::runtime_error with the error log if the program fails to compile or link.
+	QOpenGLShaderProgram * create(const QByteArray & key, const QString & vertexSource, const QString & fragmentSource);
+	/// @brief Get the path of the program binary file for a key.
+	QString binaryPath(const QByteArray & key) const;
+	/// @brief Load a program from its binary file. Returns nullptr if there is no file or the driver rejects the binary.
+	QOpenGLShaderProgram * loadBinary(const QByteArray & key);
+	/// @brief Store the binary of a linked program on disk and delete the least recently used files if the directory is too big.
+	void storeBinary(const QByteArray & key, QOpenGLShaderProgram * program);
+	/// @brief Delete the least recently used programs not in use until there are at most count of them. Call with m_mutex locked.
+	void trimPrograms(int count);
+	/// @brief Delete the least recently used program binaries until they use at most m_maxDiskSize bytes.
+	void trimDirectory();
+
+	GetProgramBinaryFunction m_getProgramBinary;
+	ProgramBinaryFunction m_programBinary;
+	ProgramParameteriFunction m_programParameteri;
+	QString m_directory;
+	int m_maxPrograms;
+	/// @brief Number of programs kept in addition to m_maxPrograms. Guarded by m_mutex.
+	int m_precompiledCount;
+	qint64 m_maxDiskSize;
+	/// @brief Vendor, renderer and version of the OpenGL driver. Part of the key, because binaries only work with the driver that created them.
+	QByteArray m_driver;
+	/// @brief Guards the programs. Programs are compiled with it unlocked, so threads do not wait for each other.
+	QMutex m_mutex;
+	/// @brief Programs not in use. The most recently used one is first.
+	QList<Entry> m_programs;
+	/// @brief Keys of the programs in use.
+	QHash<QOpenGLShaderProgram *, QByteArray> m_acquired;
+};
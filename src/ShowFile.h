@@ -0,0 +1,29 @@
+#pragma once
+
+#include <QtGlobal>
+
+
+/// @brief Header of a show file holding recorded LED frames.
+/// A show file is the header followed by frames that are appended while recording. Every frame is a quint64 timestamp
+/// in microseconds since recording started, followed by ledCount QRgb values (0xffRRGGBB) holding the LED colors in strip order.
+/// All values are in the byte order of the recording machine. A partially written frame at the end of the file is ignored.
+struct ShowFileHeader
+{
+	/// @brief "NDSF".
+	char magic[4];
+	quint16 version;
+	/// @brief Size of the header in bytes. Frames start at this offset.
+	quint16 headerSize;
+	/// @brief Number of LEDs in every frame.
+	quint32 ledCount;
+	/// @brief Average frame rate the show was recorded with, measured from the timestamps when recording stopped.
+	quint32 framesPerSecond;
+	/// @brief Hash of the display layout the show was recorded for, see DisplayThread::layoutId().
+	quint32 layoutId;
+	quint32 reserved[3];
+};
+
+static_assert(sizeof(ShowFileHeader) == 32, "Show file header must be 32 bytes");
+
+/// @brief Current show file version.
+const quint16 ShowFileVersion = 1;
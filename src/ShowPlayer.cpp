@@ -0,0 +1,159 @@
+#include "ShowPlayer.h"
+
+#include <cstring>
+#include <stdexcept>
+
+
+ShowPlayer::ShowPlayer(QObject * parent)
+	: QObject(parent)
+	, m_data(nullptr)
+	, m_frameSize(0)
+	, m_frameCount(0)
+	, m_startTime(0)
+	, m_frame(0)
+	, m_loop(true)
+{
+	memset(&m_header, 0, sizeof(m_header));
+	m_timer.setSingleShot(true);
+	m_timer.setTimerType(Qt::PreciseTimer);
+	connect(&m_timer, SIGNAL(timeout()), this, SLOT(nextFrame()));
+}
+
+ShowPlayer::~ShowPlayer()
+{
+	close();
+}
+
+void ShowPlayer::open(const QString & fileName)
+{
+	std::unique_ptr<QFile> file(new QFile(fileName));
+	if (!file->open(QIODevice::ReadOnly))
+	{
+		throw std::runtime_error(QString("Failed to open show file \"%1\"!").arg(fileName).toStdString());
+	}
+	//check header
+	ShowFileHeader header;
+	if (file->size() < (qint64)sizeof(header) || file->read(reinterpret_cast<char *>(&header), sizeof(header)) != sizeof(header)
+		|| memcmp(header.magic, "NDSF", 4) != 0 || header.version != ShowFileVersion || header.headerSize < sizeof(header) || header.ledCount == 0)
+	{
+		throw std::runtime_error(QString("\"%1\" is not a valid show file!").arg(fileName).toStdString());
+	}
+	const int frameSize = sizeof(quint64) + 4 * header.ledCount;
+	const int frameCount = (file->size() - header.headerSize) / frameSize;
+	if (frameCount <= 0)
+	{
+		throw std::runtime_error(QString("Show file \"%1\" contains no frames!").arg(fileName).toStdString());
+	}
+	//map the whole file. pages are only read from disk when a frame is played
+	const uchar * data = file->map(0, file->size());
+	if (data == nullptr)
+	{
+		throw std::runtime_error(QString("Failed to map show file \"%1\"!").arg(fileName).toStdString());
+	}
+	close();
+	m_previousFile = std::move(m_file);
+	m_file = std::move(file);
+	m_data = data + header.headerSize;
+	m_header = header;
+	m_frameSize = frameSize;
+	m_frameCount = frameCount;
+	m_startTime = 0;
+	memcpy(&m_startTime, m_data, sizeof(quint64));
+}
+
+void ShowPlayer::close()
+{
+	stop();
+	m_data = nullptr;
+	m_frameCount = 0;
+}
+
+int ShowPlayer::ledCount() const
+{
+	return m_data ? (int)m_header.ledCount : 0;
+}
+
+int ShowPlayer::frameCount() const
+{
+	return m_frameCount;
+}
+
+int ShowPlayer::framesPerSecond() const
+{
+	return m_data ? (int)m_header.framesPerSecond : 0;
+}
+
+quint32 ShowPlayer::layoutId() const
+{
+	return m_header.layoutId;
+}
+
+qint64 ShowPlayer::frameTime(int index) const
+{
+	quint64 time = 0;
+	memcpy(&time, m_data + (qint64)index * m_frameSize, sizeof(time));
+	return (qint64)time - m_startTime;
+}
+
+void ShowPlayer::play(bool loop)
+{
+	if (m_data == nullptr)
+	{
+		return;
+	}
+	m_loop = loop;
+	m_frame = 0;
+	m_clock.start();
+	nextFrame();
+}
+
+void ShowPlayer::stop()
+{
+	m_timer.stop();
+	m_clock.invalidate();
+}
+
+bool ShowPlayer::isPlaying() const
+{
+	return m_clock.isValid();
+}
+
+void ShowPlayer::nextFrame()
+{
+	if (m_data == nullptr || !m_clock.isValid())
+	{
+		return;
+	}
+	//the show (re)starts with the first frame
+	if (m_frame == 0)
+	{
+		m_clock.start();
+	}
+	//skip frames that are already late, so playback stays in time
+	const qint64 now = m_clock.nsecsElapsed() / 1000;
+	while (m_frame + 1 < m_frameCount && frameTime(m_frame + 1) <= now)
+	{
+		++m_frame;
+	}
+	//pass frame on. the image references the mapped file directly
+	const uchar * leds = m_data + (qint64)m_frame * m_frameSize + sizeof(quint64);
+	emit frameChanged(QImage(leds, m_header.ledCount, 1, QImage::Format_RGB32));
+	++m_frame;
+	if (m_frame >= m_frameCount)
+	{
+		if (!m_loop)
+		{
+			stop();
+			emit finished();
+			return;
+		}
+		//restart show one average frame interval after the last frame. the timestamps hold the real rate
+		m_frame = 0;
+		const qint64 interval = m_frameCount > 1 ? frameTime(m_frameCount - 1) / (m_frameCount - 1) : 0;
+		m_timer.start(interval > 0 ? (int)((interval + 500) / 1000) : (m_header.framesPerSecond > 0 ? 1000 / m_header.framesPerSecond : 40));
+		return;
+	}
+	//wait until the next frame is due
+	const qint64 wait = frameTime(m_frame) - m_clock.nsecsElapsed() / 1000;
+	m_timer.start(wait > 0 ? (int)((wait + 500) / 1000) : 0);
+}
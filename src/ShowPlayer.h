@@ -0,0 +1,74 @@
+#pragma once
+
+#include "ShowFile.h"
+
+#include <QObject>
+#include <QFile>
+#include <QImage>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <memory>
+
+
+/// @brief Plays back a show file recorded by ShowRecorder. See ShowFileHeader for the format.
+/// The file is memory-mapped and every frame is passed on as an image pointing directly into the mapping,
+/// so playback neither reads nor copies LED data and needs no rendering.
+class ShowPlayer : public QObject
+{
+	Q_OBJECT
+
+public:
+	ShowPlayer(QObject * parent = NULL);
+	~ShowPlayer();
+
+	/// @brief Open and map a show file. Stops playback of the current show.
+	/// @throw std::runtime_error if the file can not be opened or is invalid.
+	void open(const QString & fileName);
+
+	/// @brief Stop playback and close the show.
+	void close();
+
+	/// @brief Number of LEDs in every frame of the show.
+	int ledCount() const;
+	/// @brief Number of complete frames in the show.
+	int frameCount() const;
+	/// @brief Frame rate the show was recorded with.
+	int framesPerSecond() const;
+	/// @brief Layout id the show was recorded with.
+	quint32 layoutId() const;
+
+	/// @brief Start playing the show from the beginning.
+	/// @param loop Pass true to restart the show when it has ended.
+	void play(bool loop = true);
+	/// @brief Stop playing the show.
+	void stop();
+	/// @brief Check if the show is playing.
+	bool isPlaying() const;
+
+signals:
+	/// @brief Emitted at the time a frame was recorded at.
+	/// @param image ledCount() x 1 pixel image with the LED colors in strip order. It points into the mapped file, so it is not copied.
+	void frameChanged(const QImage & image);
+	/// @brief Emitted when a show not looping has ended.
+	void finished();
+
+private slots:
+	void nextFrame();
+
+private:
+	/// @brief Get the recording time of a frame relative to the first frame, in microseconds.
+	qint64 frameTime(int index) const;
+
+	std::unique_ptr<QFile> m_file;
+	/// @brief The show opened before is kept mapped, because outputs may still reference its last frame.
+	std::unique_ptr<QFile> m_previousFile;
+	const uchar * m_data;
+	ShowFileHeader m_header;
+	int m_frameSize;
+	int m_frameCount;
+	qint64 m_startTime;
+	int m_frame;
+	bool m_loop;
+	QTimer m_timer;
+	QElapsedTimer m_clock;
+};
@@ -0,0 +1,108 @@
+#include "ShowRecorder.h"
+
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+
+
+ShowRecorder::ShowRecorder()
+	: m_ledCount(0)
+	, m_frameCount(0)
+	, m_lastTime(0)
+{
+}
+
+ShowRecorder::~ShowRecorder()
+{
+	close();
+}
+
+void ShowRecorder::open(const QString & fileName)
+{
+	close();
+	m_file.setFileName(fileName);
+	if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+	{
+		throw std::runtime_error(QString("Failed to create show file \"%1\"!").arg(fileName).toStdString());
+	}
+	m_ledCount = 0;
+	m_frameCount = 0;
+	m_lastTime = 0;
+}
+
+void ShowRecorder::close()
+{
+	if (m_file.isOpen())
+	{
+		//the frame rate passed may differ from the real one, e.g. with adaptive pacing. store the average rate recorded
+		if (m_frameCount > 1 && m_lastTime > 0)
+		{
+			const quint32 framesPerSecond = qMax((quint64)1, ((m_frameCount - 1) * (quint64)1000000 + m_lastTime / 2) / m_lastTime);
+			if (m_file.seek(offsetof(ShowFileHeader, framesPerSecond)))
+			{
+				m_file.write(reinterpret_cast<const char *>(&framesPerSecond), sizeof(framesPerSecond));
+			}
+		}
+		m_file.close();
+	}
+	m_ledCount = 0;
+	m_frameCount = 0;
+	m_lastTime = 0;
+}
+
+bool ShowRecorder::isOpen() const
+{
+	return m_file.isOpen();
+}
+
+void ShowRecorder::writeFrame(const unsigned char * rgb, int ledCount, int framesPerSecond, quint32 layoutId)
+{
+	if (!m_file.isOpen() || ledCount <= 0)
+	{
+		return;
+	}
+	if (m_ledCount == 0)
+	{
+		//first frame. write header and start clock
+		ShowFileHeader header;
+		memset(&header, 0, sizeof(header));
+		memcpy(header.magic, "NDSF", 4);
+		header.version = ShowFileVersion;
+		header.headerSize = sizeof(header);
+		header.ledCount = ledCount;
+		header.framesPerSecond = framesPerSecond;
+		header.layoutId = layoutId;
+		if (m_file.write(reinterpret_cast<const char *>(&header), sizeof(header)) != sizeof(header))
+		{
+			const QString fileName = m_file.fileName();
+			close();
+			throw std::runtime_error(QString("Failed to write show file \"%1\"!").arg(fileName).toStdString());
+		}
+		m_ledCount = ledCount;
+		m_frame.resize(sizeof(quint64) + 4 * ledCount);
+		m_clock.start();
+	}
+	else if (ledCount != m_ledCount)
+	{
+		const QString fileName = m_file.fileName();
+		close();
+		throw std::runtime_error(QString("The number of LEDs changed while recording \"%1\". Recording stopped!").arg(fileName).toStdString());
+	}
+	//store timestamp and colors as QRgb, so frames can be used as images without converting them on playback
+	char * frame = m_frame.data();
+	const quint64 time = m_clock.nsecsElapsed() / 1000;
+	memcpy(frame, &time, sizeof(time));
+	quint32 * leds = reinterpret_cast<quint32 *>(frame + sizeof(time));
+	for (int i = 0; i < ledCount; ++i, rgb += 3)
+	{
+		leds[i] = 0xFF000000 | ((quint32)rgb[0] << 16) | ((quint32)rgb[1] << 8) | rgb[2];
+	}
+	if (m_file.write(m_frame) != m_frame.size())
+	{
+		const QString fileName = m_file.fileName();
+		close();
+		throw std::runtime_error(QString("Failed to write show file \"%1\"!").arg(fileName).toStdString());
+	}
+	++m_frameCount;
+	m_lastTime = time;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "ShowFile.h"
+
+#include <QFile>
+#include <QByteArray>
+#include <QElapsedTimer>
+
+
+/// @brief Appends LED frames to a show file. See ShowFileHeader for the format.
+class ShowRecorder
+{
+public:
+	ShowRecorder();
+	~ShowRecorder();
+
+	/// @brief Create a show file and start recording. The header is written with the first frame.
+	/// @throw std::runtime_error if the file can not be created.
+	void open(const QString & fileName);
+
+	/// @brief Stop recording and close the file. The frame rate in the header is replaced by the one measured from the timestamps.
+	void close();
+
+	/// @brief Check if a show is being recorded.
+	bool isOpen() const;
+
+	/// @brief Append a frame to the show file.
+	/// @param rgb LED colors in strip order, 3 bytes (red, green, blue) per LED.
+	/// @param ledCount Number of LEDs. Must be the same for all frames of a show.
+	/// @param framesPerSecond Frame rate stored in the header until close() stores the measured one.
+	/// @param layoutId Layout id stored in the header.
+	/// @throw std::runtime_error if the LED count changed or writing failed. The file is closed then.
+	void writeFrame(const unsigned char * rgb, int ledCount, int framesPerSecond, quint32 layoutId);
+
+private:
+	QFile m_file;
+	QElapsedTimer m_clock;
+	int m_ledCount;
+	/// @brief Number of frames written and timestamp of the last one in microseconds, to measure the frame rate.
+	qint64 m_frameCount;
+	quint64 m_lastTime;
+	/// @brief Buffer for one frame record, reused for every frame.
+	QByteArray m_frame;
+};